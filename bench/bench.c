@@ -0,0 +1,497 @@
+#define _POSIX_C_SOURCE 200809L
+#include "generator.h"
+#include "assembler.h"
+#include "encoder.h"
+#include "lexer.h"
+#include "output.h"
+#include "parallel.h"
+#include "source.h"
+#include "symbol_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE 65536
+#define MAX_SIZES 16
+#define MIN_WORK_PER_SIZE 1000000 // small sizes are repeated until about this many instructions were timed
+#define MAX_ITERATIONS 1000
+
+typedef enum {
+    PHASE_READ,
+    PHASE_PARSE,
+    PHASE_VALIDATE,
+    PHASE_RESOLVE,
+    PHASE_ENCODE,
+    PHASE_ENCODE_BATCH,
+    PHASE_OUTPUT,
+    PHASE_ASSEMBLE,
+    PHASE_ASSEMBLE_PARALLEL,
+    PHASE_COUNT,
+} Phase;
+
+static const char *const phase_names[PHASE_COUNT] = {
+    [PHASE_READ] = "read",
+    [PHASE_PARSE] = "parse",
+    [PHASE_VALIDATE] = "validate",
+    [PHASE_RESOLVE] = "resolve",
+    [PHASE_ENCODE] = "encode",
+    [PHASE_ENCODE_BATCH] = "encode_batch",
+    [PHASE_OUTPUT] = "output",
+    [PHASE_ASSEMBLE] = "assemble",
+    [PHASE_ASSEMBLE_PARALLEL] = "assemble_parallel",
+};
+
+typedef struct {
+    const char *name;
+    uint32_t length;
+    uint32_t instruction;
+} LabelDefinition;
+
+// One block's instructions split by type into the field arrays the batch encoders take, with the position
+// of each in the block.
+typedef struct {
+    uint8_t opcode[BLOCK_SIZE];
+    uint8_t rs[BLOCK_SIZE];
+    uint8_t rt[BLOCK_SIZE];
+    uint8_t rd[BLOCK_SIZE];
+    uint8_t shamt[BLOCK_SIZE];
+    uint8_t funct[BLOCK_SIZE];
+    int16_t immediate[BLOCK_SIZE];
+    uint32_t address[BLOCK_SIZE];
+    uint32_t position[BLOCK_SIZE];
+    uint32_t words[BLOCK_SIZE];
+} BatchFields;
+
+// Buffers for the phase-by-phase run, sized for one program.
+typedef struct {
+    Instruction *instructions;
+    LabelDefinition *labels;
+    uint32_t *machine_code;
+    uint32_t *symbols;
+    uint8_t *types;
+    BatchFields *batch[3]; // by InstructionType
+    uint32_t *batch_words; // one block encoded through batch
+} Workspace;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static bool workspace_init(Workspace *workspace, uint64_t instruction_count) {
+    size_t count = instruction_count ? (size_t) instruction_count : 1;
+    workspace->instructions = malloc(sizeof(Instruction) * BLOCK_SIZE);
+    workspace->labels = malloc(sizeof(LabelDefinition) * BLOCK_SIZE);
+    workspace->machine_code = malloc(sizeof(uint32_t) * count);
+    workspace->symbols = malloc(sizeof(uint32_t) * count);
+    workspace->types = malloc(sizeof(uint8_t) * count);
+    workspace->batch_words = malloc(sizeof(uint32_t) * BLOCK_SIZE);
+    bool ok = workspace->instructions && workspace->labels && workspace->machine_code && workspace->symbols &&
+              workspace->types && workspace->batch_words;
+    for (int type = R_TYPE; type <= J_TYPE; type++) {
+        workspace->batch[type] = malloc(sizeof(BatchFields));
+        ok = ok && workspace->batch[type];
+    }
+    return ok;
+}
+
+static void workspace_free(Workspace *workspace) {
+    free(workspace->instructions);
+    free(workspace->labels);
+    free(workspace->machine_code);
+    free(workspace->symbols);
+    free(workspace->types);
+    for (int type = R_TYPE; type <= J_TYPE; type++) free(workspace->batch[type]);
+    free(workspace->batch_words);
+}
+
+// Encodes a block into batch_words the way a caller holding field arrays would: gathers each type's fields,
+// runs the batch encoder for it and scatters the words back.
+static bool encode_block_batch(Workspace *workspace, uint32_t count) {
+    BatchFields *r = workspace->batch[R_TYPE];
+    BatchFields *i_fields = workspace->batch[I_TYPE];
+    BatchFields *j = workspace->batch[J_TYPE];
+    uint32_t counts[3] = {0};
+    for (uint32_t k = 0; k < count; k++) {
+        const Instruction *instruction = &workspace->instructions[k];
+        uint32_t n;
+        switch (instruction->type) {
+            case R_TYPE:
+                n = counts[R_TYPE]++;
+                r->opcode[n] = instruction->data.r.opcode;
+                r->rs[n] = instruction->data.r.rs;
+                r->rt[n] = instruction->data.r.rt;
+                r->rd[n] = instruction->data.r.rd;
+                r->shamt[n] = instruction->data.r.shamt;
+                r->funct[n] = instruction->data.r.funct;
+                r->position[n] = k;
+                break;
+            case I_TYPE:
+                n = counts[I_TYPE]++;
+                i_fields->opcode[n] = instruction->data.i.opcode;
+                i_fields->rs[n] = instruction->data.i.rs;
+                i_fields->rt[n] = instruction->data.i.rt;
+                i_fields->immediate[n] = instruction->data.i.immediate;
+                i_fields->position[n] = k;
+                break;
+            case J_TYPE:
+                n = counts[J_TYPE]++;
+                j->opcode[n] = instruction->data.j.opcode;
+                j->address[n] = instruction->data.j.address;
+                j->position[n] = k;
+                break;
+            default:
+                return false;
+        }
+    }
+
+    RTypeBatch r_batch = {r->opcode, r->rs, r->rt, r->rd, r->shamt, r->funct};
+    ITypeBatch i_batch = {i_fields->opcode, i_fields->rs, i_fields->rt, i_fields->immediate};
+    JTypeBatch j_batch = {j->opcode, j->address};
+    bool ok = encode_r_type_batch(&r_batch, counts[R_TYPE], r->words) == counts[R_TYPE] &&
+              encode_i_type_batch(&i_batch, counts[I_TYPE], i_fields->words) == counts[I_TYPE] &&
+              encode_j_type_batch(&j_batch, counts[J_TYPE], j->words) == counts[J_TYPE];
+
+    for (int type = R_TYPE; type <= J_TYPE && ok; type++) {
+        const BatchFields *fields = workspace->batch[type];
+        for (uint32_t n = 0; n < counts[type]; n++) workspace->batch_words[fields->position[n]] = fields->words[n];
+    }
+    return ok;
+}
+
+static bool run_read(const char *path, double *seconds) {
+    double start = now();
+    SourceFile source;
+    if (!source_open(path, &source)) return false;
+    // Touch every page so a lazily mapped file is actually read.
+    volatile uint8_t sink = 0;
+    for (size_t i = 0; i < source.size; i += 4096) sink ^= (uint8_t) source.data[i];
+    (void) sink;
+    source_close(&source);
+    *seconds = now() - start;
+    return true;
+}
+
+// Runs parse, validation, label resolution and encoding as separate passes over blocks of instructions,
+// timing each pass on its own. Resolution interns every label and reference, then patches the words.
+static bool run_phases(const char *path, Workspace *workspace, uint64_t instruction_count, double seconds[]) {
+    SourceFile source;
+    if (!source_open(path, &source)) return false;
+
+    SymbolTable table;
+    if (!symbol_table_init(&table)) {
+        source_close(&source);
+        return false;
+    }
+
+    Lexer lexer;
+    SourceLine line;
+    lexer_init(&lexer, source.data, source.size);
+    uint32_t base = 0;
+    bool ok = true;
+    bool more = true;
+
+    while (more && ok) {
+        uint32_t count = 0;
+        uint32_t label_count = 0;
+
+        double start = now();
+        while (count < BLOCK_SIZE && label_count < BLOCK_SIZE && (more = lexer_next_line(&lexer, &line))) {
+            if (line.label) {
+                workspace->labels[label_count].name = line.label;
+                workspace->labels[label_count].length = line.label_length;
+                workspace->labels[label_count].instruction = base + count;
+                label_count++;
+            }
+            if (line.token_count == 0) continue;
+            workspace->instructions[count++] = parse_source_line(&line, NULL);
+        }
+        double parsed = now();
+        seconds[PHASE_PARSE] += parsed - start;
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (!assembler_validate_instruction(&workspace->instructions[i])) ok = false;
+        }
+        double validated = now();
+        seconds[PHASE_VALIDATE] += validated - parsed;
+
+        for (uint32_t i = 0; i < label_count; i++) {
+            const LabelDefinition *label = &workspace->labels[i];
+            uint32_t symbol = symbol_table_intern(&table, label->name, label->length);
+            if (symbol_table_define(&table, symbol, label->instruction) != SYMBOL_TABLE_OK) ok = false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            const Instruction *instruction = &workspace->instructions[i];
+            workspace->types[base + i] = (uint8_t) instruction->type;
+            workspace->symbols[base + i] = instruction->label_ref
+                                               ? symbol_table_intern(&table, instruction->label_ref,
+                                                                     instruction->label_length)
+                                               : ASSEMBLER_NO_SYMBOL;
+        }
+        double interned = now();
+        seconds[PHASE_RESOLVE] += interned - validated;
+
+        uint32_t *words = workspace->machine_code + base;
+        for (uint32_t i = 0; i < count; i++) {
+            const Instruction *instruction = &workspace->instructions[i];
+            switch (instruction->type) {
+                case R_TYPE:
+                    words[i] = r_type_to_machine_code(&instruction->data.r);
+                    break;
+                case I_TYPE:
+                    words[i] = i_type_to_machine_code(&instruction->data.i);
+                    break;
+                case J_TYPE:
+                    words[i] = j_type_to_machine_code(&instruction->data.j);
+                    break;
+                default:
+                    ok = false;
+                    break;
+            }
+        }
+        double encoded = now();
+        seconds[PHASE_ENCODE] += encoded - interned;
+
+        if (!encode_block_batch(workspace, count)) ok = false;
+        seconds[PHASE_ENCODE_BATCH] += now() - encoded;
+        if (memcmp(workspace->batch_words, words, sizeof(uint32_t) * count) != 0) ok = false;
+        base += count;
+    }
+
+    double start = now();
+    for (uint32_t i = 0; i < base && ok; i++) {
+        uint32_t symbol = workspace->symbols[i];
+        if (symbol == ASSEMBLER_NO_SYMBOL) continue;
+        uint32_t label_line = table.labels[symbol].instruction_line;
+        if (label_line == SYMBOL_UNDEFINED || assembler_patch_word(&workspace->machine_code[i], workspace->types[i], i,
+                                                                   label_line) != ASSEMBLER_SUCCESS) {
+            ok = false;
+        }
+    }
+    seconds[PHASE_RESOLVE] += now() - start;
+
+    symbol_table_free(&table);
+    source_close(&source);
+    return ok && base == instruction_count;
+}
+
+static bool run_output(const Workspace *workspace, uint32_t count, const char *listing_path,
+                       const char *binary_path, double *seconds) {
+    double start = now();
+    FILE *listing = fopen(listing_path, "w");
+    FILE *binary = fopen(binary_path, "wb");
+    bool ok = listing && binary;
+    ok = ok && output_write_listing(listing, workspace->machine_code, count);
+    ok = ok && output_write_binary(binary, workspace->machine_code, count);
+    if (listing) ok = fclose(listing) == 0 && ok;
+    if (binary) ok = fclose(binary) == 0 && ok;
+    *seconds = now() - start;
+    return ok;
+}
+
+// The same serial one-pass assembly as the assembler executable, without writing output.
+static bool run_assemble(const char *path, const uint32_t *expected, uint32_t count, double *seconds) {
+    double start = now();
+    SourceFile source;
+    if (!source_open(path, &source)) return false;
+    Assembler *assembler = assembler_create();
+    if (!assembler) {
+        source_close(&source);
+        return false;
+    }
+
+    bool ok = assembler_assemble_source(assembler, source.data, source.size) == ASSEMBLER_SUCCESS;
+    *seconds = now() - start;
+
+    ok = ok && assembler->instruction_count == count &&
+         memcmp(assembler->machine_code, expected, sizeof(uint32_t) * count) == 0;
+    assembler_destroy(assembler);
+    source_close(&source);
+    return ok;
+}
+
+static bool run_assemble_parallel(const char *path, ThreadPool *pool, const uint32_t *expected, uint32_t count,
+                                  double *seconds) {
+    double start = now();
+    SourceFile source;
+    if (!source_open(path, &source)) return false;
+    Assembler *assembler = assembler_create();
+    if (!assembler) {
+        source_close(&source);
+        return false;
+    }
+
+    bool ok = assembler_assemble_parallel(assembler, pool, source.data, source.size) == ASSEMBLER_SUCCESS;
+    const uint32_t *machine_code = ok ? assembler_generate_machine_code(assembler) : NULL;
+    *seconds = now() - start;
+
+    ok = machine_code && assembler->instruction_count == count &&
+         memcmp(machine_code, expected, sizeof(uint32_t) * count) == 0;
+    assembler_destroy(assembler);
+    source_close(&source);
+    return ok;
+}
+
+static uint32_t parse_sizes(const char *text, uint64_t sizes[]) {
+    uint32_t count = 0;
+    const char *p = text;
+    while (*p && count < MAX_SIZES) {
+        char *end;
+        uint64_t size = strtoull(p, &end, 10);
+        if (end == p) return 0;
+        if (*end == 'K' || *end == 'k') size *= 1000, end++;
+        else if (*end == 'M' || *end == 'm') size *= 1000000, end++;
+        sizes[count++] = size;
+        if (*end == ',') end++;
+        else if (*end != '\0') return 0;
+        p = end;
+    }
+    return count;
+}
+
+static void print_usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-n sizes] [-r repeats] [-j threads] [-d directory] [-o results.csv]\n"
+            "          [-s seed] [-m r,i,m,b,j] [-l label_density] [-f forward_ratio]\n"
+            "sizes is a comma-separated list of instruction counts, e.g. 1K,1M,100M (default 1K,10K,100K,1M,10M).\n"
+            "Results are written as CSV to the -o file, or to stdout.\n",
+            program);
+}
+
+int main(int argc, char *argv[]) {
+    GeneratorConfig config;
+    generator_default_config(&config);
+    uint64_t sizes[MAX_SIZES];
+    uint32_t size_count = parse_sizes("1K,10K,100K,1M,10M", sizes);
+    uint32_t repeats = 3;
+    uint32_t thread_count = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+    const char *directory = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    const char *results_path = NULL;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:r:j:d:o:s:m:l:f:")) != -1) {
+        switch (option) {
+            case 'n':
+                size_count = parse_sizes(optarg, sizes);
+                break;
+            case 'r':
+                repeats = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            case 'j':
+                thread_count = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                directory = optarg;
+                break;
+            case 'o':
+                results_path = optarg;
+                break;
+            case 's':
+                config.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'm':
+                if (!generator_parse_mix(&config, optarg)) size_count = 0;
+                break;
+            case 'l':
+                config.label_density = strtod(optarg, NULL);
+                break;
+            case 'f':
+                config.forward_ratio = strtod(optarg, NULL);
+                break;
+            default:
+                size_count = 0;
+                break;
+        }
+    }
+    if (size_count == 0 || repeats == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (thread_count == 0) thread_count = 1;
+
+    FILE *results = results_path ? fopen(results_path, "w") : stdout;
+    if (!results) {
+        fprintf(stderr, "failed to open results file: %s\n", results_path);
+        return 1;
+    }
+    ThreadPool *pool = thread_count > 1 ? thread_pool_create(thread_count) : NULL;
+
+    char source_path[4096];
+    char listing_path[4096];
+    char binary_path[4096];
+    long pid = (long) getpid();
+    snprintf(source_path, sizeof(source_path), "%s/asmbench-%ld.asm", directory, pid);
+    snprintf(listing_path, sizeof(listing_path), "%s/asmbench-%ld.txt", directory, pid);
+    snprintf(binary_path, sizeof(binary_path), "%s/asmbench-%ld.bin", directory, pid);
+
+    fprintf(results, "instructions,lines,phase,threads,seconds,lines_per_second,ns_per_instruction\n");
+    fprintf(stderr, "encode_batch uses the %s kernel\n", encoder_kernel_name(encoder_active_kernel()));
+    fprintf(stderr, "%12s %-18s %12s %16s %10s\n", "instructions", "phase", "seconds", "lines/s", "ns/instr");
+
+    int status = 0;
+    for (uint32_t s = 0; s < size_count && status == 0; s++) {
+        config.instructions = sizes[s];
+        GeneratorStats stats;
+        FILE *stream = fopen(source_path, "w");
+        bool ok = stream && generator_write(&config, stream, &stats);
+        if (stream) ok = fclose(stream) == 0 && ok;
+
+        Workspace workspace;
+        ok = ok && workspace_init(&workspace, stats.instructions);
+        if (!ok) {
+            fprintf(stderr, "failed to prepare %llu instructions\n", (unsigned long long) sizes[s]);
+            status = 1;
+            break;
+        }
+
+        uint32_t count = (uint32_t) stats.instructions;
+        uint64_t iterations = count ? MIN_WORK_PER_SIZE / count : 1;
+        if (iterations < repeats) iterations = repeats;
+        if (iterations > MAX_ITERATIONS) iterations = MAX_ITERATIONS;
+
+        double best[PHASE_COUNT];
+        for (int p = 0; p < PHASE_COUNT; p++) best[p] = -1;
+        for (uint64_t iteration = 0; iteration < iterations && ok; iteration++) {
+            double seconds[PHASE_COUNT] = {0};
+            ok = run_read(source_path, &seconds[PHASE_READ]) &&
+                 run_phases(source_path, &workspace, stats.instructions, seconds) &&
+                 run_output(&workspace, count, listing_path, binary_path, &seconds[PHASE_OUTPUT]) &&
+                 run_assemble(source_path, workspace.machine_code, count, &seconds[PHASE_ASSEMBLE]) &&
+                 (!pool || run_assemble_parallel(source_path, pool, workspace.machine_code, count,
+                                                 &seconds[PHASE_ASSEMBLE_PARALLEL]));
+            for (int p = 0; p < PHASE_COUNT; p++) {
+                if (best[p] < 0 || seconds[p] < best[p]) best[p] = seconds[p];
+            }
+        }
+        workspace_free(&workspace);
+        if (!ok) {
+            fprintf(stderr, "benchmark run failed at %llu instructions\n", (unsigned long long) sizes[s]);
+            status = 1;
+            break;
+        }
+
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            if (p == PHASE_ASSEMBLE_PARALLEL && !pool) continue;
+            double seconds = best[p];
+            double lines_per_second = seconds > 0 ? (double) stats.lines / seconds : 0;
+            double ns_per_instruction = count ? seconds * 1e9 / count : 0;
+            uint32_t threads = p == PHASE_ASSEMBLE_PARALLEL ? thread_count : 1;
+            fprintf(results, "%u,%llu,%s,%u,%.9f,%.0f,%.3f\n", count, (unsigned long long) stats.lines,
+                    phase_names[p], threads, seconds, lines_per_second, ns_per_instruction);
+            fprintf(stderr, "%12u %-18s %12.6f %16.0f %10.3f\n", count, phase_names[p], seconds, lines_per_second,
+                    ns_per_instruction);
+        }
+        fflush(results);
+    }
+
+    remove(source_path);
+    remove(listing_path);
+    remove(binary_path);
+    thread_pool_destroy(pool);
+    if (results != stdout) fclose(results);
+    return status;
+}
@@ -0,0 +1,115 @@
+#include "assembler.h"
+#include "encoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs every batch kernel this CPU supports over random field arrays, mostly valid rows with the odd
+// invalid field, and checks each returns the scalar kernel's index of the first invalid instruction and
+// the same words before it.
+
+#define ROUNDS 2000
+#define MAX_COUNT 700
+#define INVALID_ONE_IN 4000
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t random_next(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) (random_state >> 32);
+}
+
+static bool random_invalid(void) {
+    return random_next() % INVALID_ONE_IN == 0;
+}
+
+static const InstructionDef *random_row(InstructionType type) {
+    for (;;) {
+        const InstructionDef *def = instruction_def((IsaRow) (random_next() % ISA_ROW_COUNT));
+        if (def->type == type) return def;
+    }
+}
+
+static uint8_t random_register(void) {
+    return random_invalid() ? (uint8_t) (32 + random_next() % 224) : (uint8_t) (random_next() % 32);
+}
+
+typedef struct {
+    uint8_t opcode[MAX_COUNT];
+    uint8_t rs[MAX_COUNT];
+    uint8_t rt[MAX_COUNT];
+    uint8_t rd[MAX_COUNT];
+    uint8_t shamt[MAX_COUNT];
+    uint8_t funct[MAX_COUNT];
+    int16_t immediate[MAX_COUNT];
+    uint32_t address[MAX_COUNT];
+} Fields;
+
+static void fill_fields(Fields *fields, size_t count, InstructionType type) {
+    for (size_t i = 0; i < count; i++) {
+        const InstructionDef *def = random_row(type);
+        fields->opcode[i] = random_invalid() ? (uint8_t) random_next() : def->opcode;
+        fields->rs[i] = random_register();
+        fields->rt[i] = random_register();
+        fields->rd[i] = random_register();
+        fields->shamt[i] = random_register();
+        fields->funct[i] = random_invalid() ? (uint8_t) random_next() : def->funct;
+        int16_t immediate = (int16_t) random_next();
+        if (!random_invalid()) immediate = (int16_t) (immediate & ~(def->width - 1));
+        fields->immediate[i] = immediate;
+        fields->address[i] = random_invalid() ? random_next() : random_next() & 0x3FFFFFF;
+    }
+}
+
+typedef size_t (*BatchEncoder)(const Fields *fields, size_t count, uint32_t *out);
+
+static size_t encode_r(const Fields *fields, size_t count, uint32_t *out) {
+    RTypeBatch batch = {fields->opcode, fields->rs, fields->rt, fields->rd, fields->shamt, fields->funct};
+    return encode_r_type_batch(&batch, count, out);
+}
+
+static size_t encode_i(const Fields *fields, size_t count, uint32_t *out) {
+    ITypeBatch batch = {fields->opcode, fields->rs, fields->rt, fields->immediate};
+    return encode_i_type_batch(&batch, count, out);
+}
+
+static size_t encode_j(const Fields *fields, size_t count, uint32_t *out) {
+    JTypeBatch batch = {fields->opcode, fields->address};
+    return encode_j_type_batch(&batch, count, out);
+}
+
+int main(void) {
+    static const BatchEncoder encoders[] = {[R_TYPE] = encode_r, [I_TYPE] = encode_i, [J_TYPE] = encode_j};
+    static const char *const encoder_names[] = {[R_TYPE] = "R", [I_TYPE] = "I", [J_TYPE] = "J"};
+    EncoderKernel widest = encoder_active_kernel();
+
+    static Fields fields;
+    uint32_t expected[MAX_COUNT];
+    uint32_t words[MAX_COUNT];
+    uint64_t checked = 0;
+    for (uint32_t round = 0; round < ROUNDS; round++) {
+        for (InstructionType e = R_TYPE; e <= J_TYPE; e++) {
+            size_t count = random_next() % (MAX_COUNT + 1);
+            fill_fields(&fields, count, e);
+            encoder_use_kernel(ENCODER_KERNEL_SCALAR);
+            size_t expected_end = encoders[e](&fields, count, expected);
+            for (EncoderKernel kernel = ENCODER_KERNEL_SSE2; kernel <= widest; kernel++) {
+                encoder_use_kernel(kernel);
+                size_t end = encoders[e](&fields, count, words);
+                if (end != expected_end || memcmp(words, expected, sizeof(uint32_t) * end) != 0) {
+                    fprintf(stderr, "%s kernel disagrees on %s-type round %u: first invalid %zu, scalar %zu\n",
+                            encoder_kernel_name(kernel), encoder_names[e], round, end, expected_end);
+                    return 1;
+                }
+                checked += end;
+            }
+        }
+    }
+    encoder_use_kernel(widest);
+    printf("%llu words agree with the scalar kernel, widest kernel %s\n", (unsigned long long) checked,
+           encoder_kernel_name(widest));
+    return 0;
+}
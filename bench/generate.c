@@ -0,0 +1,62 @@
+#define _POSIX_C_SOURCE 200809L
+#include "generator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void print_usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-n instructions] [-s seed] [-m r,i,m,b,j] [-l label_density] [-f forward_ratio] [output]\n"
+            "Writes a synthetic program to output, or to stdout when it is omitted.\n",
+            program);
+}
+
+int main(int argc, char *argv[]) {
+    GeneratorConfig config;
+    generator_default_config(&config);
+
+    int option;
+    while ((option = getopt(argc, argv, "n:s:m:l:f:")) != -1) {
+        switch (option) {
+            case 'n':
+                config.instructions = strtoull(optarg, NULL, 10);
+                break;
+            case 's':
+                config.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'm':
+                if (!generator_parse_mix(&config, optarg)) {
+                    fprintf(stderr, "invalid instruction mix: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'l':
+                config.label_density = strtod(optarg, NULL);
+                break;
+            case 'f':
+                config.forward_ratio = strtod(optarg, NULL);
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    FILE *stream = stdout;
+    if (optind < argc) {
+        stream = fopen(argv[optind], "w");
+        if (!stream) {
+            fprintf(stderr, "failed to open output file: %s\n", argv[optind]);
+            return 1;
+        }
+    }
+
+    bool ok = generator_write(&config, stream, NULL);
+    if (stream != stdout) ok = fclose(stream) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "failed to generate program\n");
+        return 1;
+    }
+    return 0;
+}
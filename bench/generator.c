@@ -0,0 +1,247 @@
+#include "generator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Branches pick among this many labels on either side, which also keeps them within 16-bit offsets.
+#define BRANCH_WINDOW 8
+#define MAX_BRANCH_DISTANCE 32000
+#define MAX_JUMP_TARGET 0x3FFFFFFu
+#define WRITE_BUFFER_SIZE (1 << 16)
+#define MAX_LINE_LENGTH 64
+
+static const char *const registers[] = {
+    "$zero", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3", "$a4", "$r0", "$r1", "$r2", "$r3", "$r4", "$r5",
+    "$r6", "$r7", "$r8", "$r9", "$r10", "$r11", "$r12", "$r13", "$r14", "$r15", "$s0", "$s1", "$s2",
+    "$s3", "$s4", "$sp", "$ra",
+};
+
+static const char *const r_type_mnemonics[] = {"add", "sub", "and", "or", "xor", "sll", "srl", "sra"};
+static const char *const memory_mnemonics[] = {"lw", "sw", "lh", "sh", "lb", "sb"};
+static const char *const branch_mnemonics[] = {"beq", "bneq", "bltz", "bgtz", "blt", "bgt"};
+static const char *const jump_mnemonics[] = {"j", "jal"};
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+typedef struct {
+    uint64_t state;
+} Random;
+
+// xorshift64*: fast, and the sequence only depends on the seed.
+static uint64_t random_next(Random *random) {
+    uint64_t x = random->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    random->state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+static uint32_t random_below(Random *random, uint32_t bound) {
+    return (uint32_t) ((random_next(random) >> 32) * bound >> 32);
+}
+
+static double random_unit(Random *random) {
+    return (double) (random_next(random) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static const char *random_register(Random *random) {
+    return registers[random_below(random, COUNT_OF(registers))];
+}
+
+void generator_default_config(GeneratorConfig *config) {
+    config->instructions = 1000000;
+    config->seed = 1;
+    config->mix[GENERATOR_R_TYPE] = 50;
+    config->mix[GENERATOR_IMMEDIATE] = 15;
+    config->mix[GENERATOR_MEMORY] = 15;
+    config->mix[GENERATOR_BRANCH] = 15;
+    config->mix[GENERATOR_JUMP] = 5;
+    config->label_density = 0.05;
+    config->forward_ratio = 0.5;
+}
+
+bool generator_parse_mix(GeneratorConfig *config, const char *text) {
+    uint32_t mix[GENERATOR_KIND_COUNT];
+    uint64_t total = 0;
+    const char *p = text;
+    for (int kind = 0; kind < GENERATOR_KIND_COUNT; kind++) {
+        char *end;
+        unsigned long weight = strtoul(p, &end, 10);
+        if (end == p || weight > UINT32_MAX) return false;
+        mix[kind] = (uint32_t) weight;
+        total += weight;
+        if (kind + 1 < GENERATOR_KIND_COUNT) {
+            if (*end != ',') return false;
+            p = end + 1;
+        } else if (*end != '\0') {
+            return false;
+        }
+    }
+    if (total == 0) return false;
+    memcpy(config->mix, mix, sizeof(mix));
+    return true;
+}
+
+// Label positions are decided up front so that forward branches have somewhere to go.
+static uint32_t *plan_labels(const GeneratorConfig *config, Random *random, uint64_t *label_count) {
+    uint64_t capacity = 1024;
+    uint64_t count = 0;
+    uint32_t *positions = malloc(sizeof(uint32_t) * capacity);
+    if (!positions) return NULL;
+
+    for (uint64_t i = 0; i < config->instructions; i++) {
+        // The first instruction always carries a label so every backward search finds one.
+        if (i != 0 && random_unit(random) >= config->label_density) continue;
+        if (count == capacity) {
+            capacity *= 2;
+            uint32_t *new_positions = realloc(positions, sizeof(uint32_t) * capacity);
+            if (!new_positions) {
+                free(positions);
+                return NULL;
+            }
+            positions = new_positions;
+        }
+        positions[count++] = (uint32_t) i;
+    }
+    *label_count = count;
+    return positions;
+}
+
+static GeneratorKind pick_kind(const GeneratorConfig *config, Random *random, uint64_t total_weight) {
+    uint64_t pick = random_next(random) % total_weight;
+    for (int kind = 0; kind < GENERATOR_KIND_COUNT; kind++) {
+        if (pick < config->mix[kind]) return (GeneratorKind) kind;
+        pick -= config->mix[kind];
+    }
+    return GENERATOR_R_TYPE;
+}
+
+// Picks a label among the BRANCH_WINDOW nearest ones in the preferred direction, falling back to the other
+// direction. next_label is the first label positioned after instruction. Returns UINT64_MAX if none fit.
+static uint64_t pick_target(const uint32_t *labels, uint64_t label_count, uint64_t next_label, uint64_t instruction,
+                            bool forward, uint64_t max_distance, Random *random) {
+    for (int attempt = 0; attempt < 2; attempt++, forward = !forward) {
+        uint64_t available = forward ? label_count - next_label : next_label;
+        if (available == 0) continue;
+        uint64_t window = available < BRANCH_WINDOW ? available : BRANCH_WINDOW;
+        uint64_t step = random_below(random, (uint32_t) window);
+        uint64_t label = forward ? next_label + step : next_label - 1 - step;
+        uint64_t distance = forward ? labels[label] - instruction : instruction - labels[label];
+        if (distance <= max_distance) return label;
+        // The nearest label in this direction is the best remaining candidate.
+        label = forward ? next_label : next_label - 1;
+        distance = forward ? labels[label] - instruction : instruction - labels[label];
+        if (distance <= max_distance) return label;
+    }
+    return UINT64_MAX;
+}
+
+typedef struct {
+    FILE *stream;
+    char *buffer;
+    size_t used;
+    uint64_t total;
+    bool failed;
+} Writer;
+
+static void writer_flush(Writer *writer) {
+    if (writer->used > 0 && fwrite(writer->buffer, 1, writer->used, writer->stream) != writer->used) {
+        writer->failed = true;
+    }
+    writer->total += writer->used;
+    writer->used = 0;
+}
+
+static char *writer_reserve(Writer *writer) {
+    if (WRITE_BUFFER_SIZE - writer->used < MAX_LINE_LENGTH) writer_flush(writer);
+    return writer->buffer + writer->used;
+}
+
+bool generator_write(const GeneratorConfig *config, FILE *stream, GeneratorStats *stats) {
+    uint64_t total_weight = 0;
+    for (int kind = 0; kind < GENERATOR_KIND_COUNT; kind++) total_weight += config->mix[kind];
+    if (total_weight == 0 || config->instructions > UINT32_MAX) return false;
+
+    Random random = {config->seed * 0x9E3779B97F4A7C15ull + 1};
+    uint64_t label_count = 0;
+    uint32_t *labels = plan_labels(config, &random, &label_count);
+    if (!labels) return false;
+
+    Writer writer = {stream, malloc(WRITE_BUFFER_SIZE), 0, 0, false};
+    if (!writer.buffer) {
+        free(labels);
+        return false;
+    }
+
+    uint64_t next_label = 0;
+    uint64_t lines = 0;
+    for (uint64_t i = 0; i < config->instructions && !writer.failed; i++) {
+        if (next_label < label_count && labels[next_label] == i) {
+            char *line = writer_reserve(&writer);
+            writer.used += (size_t) snprintf(line, MAX_LINE_LENGTH, "L%llu:\n", (unsigned long long) next_label);
+            next_label++;
+            lines++;
+        }
+
+        GeneratorKind kind = pick_kind(config, &random, total_weight);
+        bool forward = random_unit(&random) < config->forward_ratio;
+        uint64_t target = UINT64_MAX;
+        if (kind == GENERATOR_BRANCH) {
+            target = pick_target(labels, label_count, next_label, i, forward, MAX_BRANCH_DISTANCE, &random);
+        } else if (kind == GENERATOR_JUMP) {
+            target = pick_target(labels, label_count, next_label, i, forward, UINT64_MAX, &random);
+            if (target != UINT64_MAX && labels[target] > MAX_JUMP_TARGET) target = UINT64_MAX;
+        }
+        if ((kind == GENERATOR_BRANCH || kind == GENERATOR_JUMP) && target == UINT64_MAX) {
+            kind = GENERATOR_R_TYPE;
+        }
+
+        char *line = writer_reserve(&writer);
+        int length = 0;
+        switch (kind) {
+            case GENERATOR_R_TYPE:
+                length = snprintf(line, MAX_LINE_LENGTH, "%s %s, %s, %s\n",
+                                  r_type_mnemonics[random_below(&random, COUNT_OF(r_type_mnemonics))],
+                                  random_register(&random), random_register(&random), random_register(&random));
+                break;
+            case GENERATOR_IMMEDIATE:
+                length = snprintf(line, MAX_LINE_LENGTH, "addi %s, %s, %d\n", random_register(&random),
+                                  random_register(&random), (int) random_below(&random, 65536) - 32768);
+                break;
+            case GENERATOR_MEMORY:
+                length = snprintf(line, MAX_LINE_LENGTH, "%s %s, %d(%s)\n",
+                                  memory_mnemonics[random_below(&random, COUNT_OF(memory_mnemonics))],
+                                  random_register(&random), ((int) random_below(&random, 512) - 256) * 4,
+                                  random_register(&random));
+                break;
+            case GENERATOR_BRANCH:
+                length = snprintf(line, MAX_LINE_LENGTH, "%s %s, %s, L%llu\n",
+                                  branch_mnemonics[random_below(&random, COUNT_OF(branch_mnemonics))],
+                                  random_register(&random), random_register(&random),
+                                  (unsigned long long) target);
+                break;
+            case GENERATOR_JUMP:
+                length = snprintf(line, MAX_LINE_LENGTH, "%s L%llu\n",
+                                  jump_mnemonics[random_below(&random, COUNT_OF(jump_mnemonics))],
+                                  (unsigned long long) target);
+                break;
+            default:
+                break;
+        }
+        writer.used += (size_t) length;
+        lines++;
+    }
+    writer_flush(&writer);
+
+    if (stats) {
+        stats->lines = lines;
+        stats->instructions = config->instructions;
+        stats->labels = label_count;
+        stats->bytes = writer.total;
+    }
+
+    free(writer.buffer);
+    free(labels);
+    return !writer.failed;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum {
+    GENERATOR_R_TYPE,   // add, sub, and, or, xor, sll, srl, sra
+    GENERATOR_IMMEDIATE, // addi
+    GENERATOR_MEMORY,   // lw, sw, lh, sh, lb, sb
+    GENERATOR_BRANCH,   // beq, bneq, bltz, bgtz, blt, bgt
+    GENERATOR_JUMP,     // j, jal
+    GENERATOR_KIND_COUNT,
+} GeneratorKind;
+
+typedef struct {
+    uint64_t instructions;
+    uint64_t seed;
+    uint32_t mix[GENERATOR_KIND_COUNT]; // relative weights of each kind of instruction
+    double label_density;                // probability that an instruction carries a label
+    double forward_ratio;                // share of branches and jumps that target a later label
+} GeneratorConfig;
+
+typedef struct {
+    uint64_t lines;
+    uint64_t instructions;
+    uint64_t labels;
+    uint64_t bytes;
+} GeneratorStats;
+
+void generator_default_config(GeneratorConfig *config);
+
+// Parses "r,i,m,b,j" into config->mix.
+bool generator_parse_mix(GeneratorConfig *config, const char *text);
+
+// Writes a program that assembles without errors: branch targets are chosen among nearby labels so their
+// offsets fit in 16 bits, and the same config and seed always produce the same bytes.
+bool generator_write(const GeneratorConfig *config, FILE *stream, GeneratorStats *stats);
@@ -0,0 +1,143 @@
+#include "assembler.h"
+#include "incremental.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Edits each program given on the command line through the incremental assembler and checks every edit
+// against assembling the edited source from scratch: both must fail, or both give the same words. Before
+// each line in turn it inserts a pseudo-instruction that expands to several words, so everything after it
+// moves, then deletes it again; then it deletes the line itself and puts it back.
+
+#define INSERTED_LINE "    li $r13, 0x12345\n"
+
+typedef struct {
+    const char *start;
+    size_t length; // newline included
+} Line;
+
+typedef struct {
+    Line *lines;
+    uint32_t count;
+    char *text; // scratch for the edited source
+    size_t text_size;
+} Program;
+
+static char *read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    char *data = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long length = ftell(file);
+        data = length >= 0 ? malloc((size_t) length + 1) : NULL;
+        if (data && (fseek(file, 0, SEEK_SET) != 0 || fread(data, 1, (size_t) length, file) != (size_t) length)) {
+            free(data);
+            data = NULL;
+        }
+        *size = (size_t) length;
+    }
+    fclose(file);
+    return data;
+}
+
+static bool split_lines(Program *program, const char *source, size_t size) {
+    program->count = 0;
+    program->lines = malloc(sizeof(Line) * (size + 1));
+    program->text_size = size + sizeof(INSERTED_LINE);
+    program->text = malloc(program->text_size);
+    if (!program->lines || !program->text) return false;
+    for (const char *p = source, *end = source + size; p < end; program->count++) {
+        const char *newline = memchr(p, '\n', (size_t) (end - p));
+        const char *next = newline ? newline + 1 : end;
+        program->lines[program->count] = (Line) {p, (size_t) (next - p)};
+        p = next;
+    }
+    return true;
+}
+
+// The source with line skip (0-based) left out, or UINT32_MAX for none, and extra inserted before line at.
+static size_t edited_source(const Program *program, uint32_t skip, uint32_t at, const char *extra) {
+    size_t size = 0;
+    for (uint32_t i = 0; i <= program->count; i++) {
+        if (i == at && extra) {
+            memcpy(program->text + size, extra, strlen(extra));
+            size += strlen(extra);
+        }
+        if (i == program->count || i == skip) continue;
+        memcpy(program->text + size, program->lines[i].start, program->lines[i].length);
+        size += program->lines[i].length;
+    }
+    return size;
+}
+
+static bool matches_rebuild(const char *path, const IncrementalAssembler *incremental, const Program *program,
+                            size_t size, const char *edit, uint32_t line) {
+    AssemblyOutput output;
+    bool assembled = assembler_assemble(program->text, size, &output) == ASSEMBLER_SUCCESS;
+    const Assembler *assembler = incremental->assembler;
+    bool same = assembled == (incremental_error_count(incremental) == 0) &&
+                (!assembled || (output.instruction_count == assembler->instruction_count &&
+                                memcmp(output.machine_code, assembler->machine_code,
+                                       sizeof(uint32_t) * output.instruction_count) == 0));
+    assembly_output_free(&output);
+    if (!same) {
+        fprintf(stderr, "%s: %s at line %u differs from a full rebuild (%s, %u incremental errors)\n", path, edit,
+                line, assembled ? "assembles" : "fails", incremental_error_count(incremental));
+    }
+    return same;
+}
+
+static bool check_program(const char *path, uint32_t *edits) {
+    size_t size;
+    char *source = read_file(path, &size);
+    if (!source) {
+        fprintf(stderr, "failed to read %s\n", path);
+        return false;
+    }
+    Program program = {0};
+    IncrementalAssembler *incremental = NULL;
+    bool ok = split_lines(&program, source, size) && (incremental = incremental_create(source, size));
+    if (!ok) fprintf(stderr, "%s: out of memory\n", path);
+
+    for (uint32_t line = 0; ok && line <= program.count; line++) {
+        ok = incremental_edit(incremental, line + 1, 0, INSERTED_LINE, strlen(INSERTED_LINE), NULL) ==
+                     ASSEMBLER_SUCCESS &&
+             matches_rebuild(path, incremental, &program, edited_source(&program, UINT32_MAX, line, INSERTED_LINE),
+                             "insert", line + 1) &&
+             incremental_edit(incremental, line + 1, 1, "", 0, NULL) == ASSEMBLER_SUCCESS &&
+             matches_rebuild(path, incremental, &program, edited_source(&program, UINT32_MAX, 0, NULL),
+                             "delete of the inserted line", line + 1);
+        *edits += 2;
+    }
+    for (uint32_t line = 0; ok && line < program.count; line++) {
+        const Line *removed = &program.lines[line];
+        ok = incremental_edit(incremental, line + 1, 1, "", 0, NULL) == ASSEMBLER_SUCCESS &&
+             matches_rebuild(path, incremental, &program, edited_source(&program, line, 0, NULL), "delete",
+                             line + 1) &&
+             incremental_edit(incremental, line + 1, 0, removed->start, removed->length, NULL) ==
+                     ASSEMBLER_SUCCESS &&
+             matches_rebuild(path, incremental, &program, edited_source(&program, UINT32_MAX, 0, NULL),
+                             "reinsert", line + 1);
+        *edits += 2;
+    }
+
+    incremental_destroy(incremental);
+    free(program.lines);
+    free(program.text);
+    free(source);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <assembly_file>...\n", argv[0]);
+        return 1;
+    }
+    uint32_t edits = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!check_program(argv[i], &edits)) return 1;
+    }
+    printf("%u edits match a full rebuild\n", edits);
+    return 0;
+}
@@ -0,0 +1,41 @@
+# Assembles each source in SOURCES to an object, links them in order and checks the listing and image
+# match assembling the sources concatenated into one file.
+#
+#   cmake -DASSEMBLER=... -DASMLINK=... -DSOURCES=a.asm;b.asm... -DWORK_DIR=... -P link_objects.cmake
+cmake_minimum_required(VERSION 3.25)
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(whole ${WORK_DIR}/whole.asm)
+file(WRITE ${whole} "")
+set(objects)
+foreach(source ${SOURCES})
+    get_filename_component(name ${source} NAME_WE)
+    execute_process(COMMAND ${ASSEMBLER} -q -c ${source} ${WORK_DIR}/${name}.o RESULT_VARIABLE result)
+    if(result)
+        message(FATAL_ERROR "assembling ${source} to an object failed: ${result}")
+    endif()
+    list(APPEND objects ${WORK_DIR}/${name}.o)
+    file(READ ${source} text)
+    file(APPEND ${whole} "${text}")
+endforeach()
+
+execute_process(COMMAND ${ASMLINK} -q ${WORK_DIR}/linked.txt ${WORK_DIR}/linked.bin ${objects}
+        RESULT_VARIABLE result)
+if(result)
+    message(FATAL_ERROR "asmlink failed: ${result}")
+endif()
+
+execute_process(COMMAND ${ASSEMBLER} -q ${whole} ${WORK_DIR}/whole.txt ${WORK_DIR}/whole.bin RESULT_VARIABLE result)
+if(result)
+    message(FATAL_ERROR "assembling the concatenated sources failed: ${result}")
+endif()
+
+foreach(extension txt bin)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK_DIR}/linked.${extension}
+            ${WORK_DIR}/whole.${extension} RESULT_VARIABLE result)
+    if(result)
+        message(FATAL_ERROR "linked .${extension} differs from the single-file build")
+    endif()
+endforeach()
+list(LENGTH objects count)
+message(STATUS "linking ${count} objects matches the single-file build")
@@ -0,0 +1,53 @@
+# Assembles every program in PROGRAM_DIR with and without -O and runs both in the simulator: they must halt
+# with the same registers, and the optimized one after no more instructions. $ra is left out, since jal
+# stores a byte address that moves with the code.
+#
+#   cmake -DASSEMBLER=... -DASMSIM=... -DPROGRAM_DIR=... -DWORK_DIR=... -P optimizer_equivalence.cmake
+cmake_minimum_required(VERSION 3.25)
+
+set(MAX_INSTRUCTIONS 10000000)
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+file(GLOB programs ${PROGRAM_DIR}/*.asm)
+if(NOT programs)
+    message(FATAL_ERROR "no programs in ${PROGRAM_DIR}")
+endif()
+
+# Sets <prefix>_registers and <prefix>_retired from a simulator run of binary.
+function(simulate binary prefix)
+    execute_process(COMMAND ${ASMSIM} -r -n ${MAX_INSTRUCTIONS} ${binary}
+            OUTPUT_VARIABLE report ERROR_VARIABLE report RESULT_VARIABLE result)
+    if(result OR NOT report MATCHES "halted after ([0-9]+) instructions")
+        message(FATAL_ERROR "${binary} did not halt: ${report}")
+    endif()
+    set(${prefix}_retired ${CMAKE_MATCH_1} PARENT_SCOPE)
+    # The register dump is every line up to the halt report.
+    string(FIND "${report}" "halted after" halt)
+    string(SUBSTRING "${report}" 0 ${halt} registers)
+    string(REGEX REPLACE "\\$31 +0x[0-9a-f]+" "" registers "${registers}")
+    set(${prefix}_registers "${registers}" PARENT_SCOPE)
+endfunction()
+
+foreach(program ${programs})
+    get_filename_component(name ${program} NAME_WE)
+    foreach(variant plain optimized)
+        set(flags -q)
+        if(variant STREQUAL "optimized")
+            list(APPEND flags -O)
+        endif()
+        execute_process(COMMAND ${ASSEMBLER} ${flags} ${program} ${WORK_DIR}/${name}.${variant}.txt
+                ${WORK_DIR}/${name}.${variant}.bin RESULT_VARIABLE result)
+        if(result)
+            message(FATAL_ERROR "assembling ${program} (${variant}) failed: ${result}")
+        endif()
+        simulate(${WORK_DIR}/${name}.${variant}.bin ${variant})
+    endforeach()
+
+    if(NOT plain_registers STREQUAL optimized_registers)
+        message(FATAL_ERROR "${name}: registers differ under -O\n${plain_registers}\n${optimized_registers}")
+    endif()
+    if(optimized_retired GREATER plain_retired)
+        message(FATAL_ERROR "${name}: -O retired ${optimized_retired} instructions, plain ${plain_retired}")
+    endif()
+    message(STATUS "${name}: same registers, ${plain_retired} instructions retired, ${optimized_retired} with -O")
+endforeach()
@@ -0,0 +1,54 @@
+# Streams a generated program through `assembler -s`, checks the image matches the serial build and that
+# the words held at once stay under the bound documented at assemble_stream in src/main.c.
+#
+#   cmake -DASSEMBLER=... -DASMGEN=... -DWORK_DIR=... [-DINSTRUCTIONS=n] -P stream_memory.cmake
+#
+# Generated branches and jumps reach at most MAX_BRANCH_DISTANCE or eight labels ahead, well under
+# STREAM_FLUSH_WORDS, so the bound is 2 * STREAM_FLUSH_WORDS + STREAM_READ_SIZE.
+cmake_minimum_required(VERSION 3.25)
+
+if(NOT DEFINED INSTRUCTIONS)
+    set(INSTRUCTIONS 2000000)
+endif()
+set(STREAM_FLUSH_WORDS 65536)
+set(STREAM_READ_SIZE 65536)
+math(EXPR held_limit "2 * ${STREAM_FLUSH_WORDS} + ${STREAM_READ_SIZE}")
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(source ${WORK_DIR}/stream.asm)
+
+execute_process(COMMAND ${ASMGEN} -n ${INSTRUCTIONS} -s 7 ${source} RESULT_VARIABLE result)
+if(result)
+    message(FATAL_ERROR "asmgen failed: ${result}")
+endif()
+
+execute_process(COMMAND ${ASSEMBLER} -s INPUT_FILE ${source} OUTPUT_FILE ${WORK_DIR}/stream.bin
+        ERROR_VARIABLE report RESULT_VARIABLE result)
+if(result)
+    message(FATAL_ERROR "assembler -s failed: ${report}")
+endif()
+
+execute_process(COMMAND ${ASSEMBLER} -q ${source} ${WORK_DIR}/serial.txt ${WORK_DIR}/serial.bin
+        RESULT_VARIABLE result)
+if(result)
+    message(FATAL_ERROR "serial assembly failed: ${result}")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK_DIR}/stream.bin ${WORK_DIR}/serial.bin
+        RESULT_VARIABLE result)
+if(result)
+    message(FATAL_ERROR "streamed image differs from the serial build")
+endif()
+
+if(NOT report MATCHES "streamed ([0-9]+) words, at most ([0-9]+) held at once")
+    message(FATAL_ERROR "no stream report in: ${report}")
+endif()
+set(words ${CMAKE_MATCH_1})
+set(held ${CMAKE_MATCH_2})
+if(NOT words EQUAL INSTRUCTIONS)
+    message(FATAL_ERROR "streamed ${words} words, expected ${INSTRUCTIONS}")
+endif()
+if(held GREATER_EQUAL held_limit)
+    message(FATAL_ERROR "held ${held} words at once, bound is ${held_limit}")
+endif()
+message(STATUS "streamed ${words} words, at most ${held} held, bound ${held_limit}")
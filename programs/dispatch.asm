@@ -0,0 +1,24 @@
+# Calls routines through addresses held in registers, as a jump table would: la loads a routine's byte
+# address and the return address, and jr jumps to them. The addresses are cleared at the end.
+    li $a0, 21
+    la $s2, double
+    la $ra, doubled
+    jr $zero, $s2, $zero
+doubled:
+    move $s0, $v0
+    la $s2, negate
+    la $ra, negated
+    jr $zero, $s2, $zero
+negated:
+    move $s1, $v0
+    move $s2, $zero
+    move $ra, $zero
+    j finish
+double:
+    add $v0, $a0, $a0
+    jr $zero, $ra, $zero
+negate:
+    sub $v0, $zero, $s0
+    jr $zero, $ra, $zero
+finish:
+    nop
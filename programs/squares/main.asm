@@ -0,0 +1,13 @@
+# Sums the squares of 1 to 6 with the square routine in square.asm; assembling this file with square.asm
+# appended builds the same image as linking the two objects.
+    .extern square
+    .extern done
+    li $s0, 0
+    li $s1, 6
+loop:
+    move $a0, $s1
+    jal square
+    add $s0, $s0, $v0
+    addi $s1, $s1, -1
+    bgt $s1, $zero, loop
+    j done
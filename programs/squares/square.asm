@@ -0,0 +1,13 @@
+# Squares $a0 into $v0 by repeated addition, and holds the label main.asm ends on.
+    .globl square
+    .globl done
+square:
+    move $v0, $zero
+    move $a1, $a0
+again:
+    add $v0, $v0, $a0
+    addi $a1, $a1, -1
+    bgt $a1, $zero, again
+    jr $zero, $ra, $zero
+done:
+    nop
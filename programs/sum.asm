@@ -0,0 +1,33 @@
+# Sums the words of table through a call per element, then folds the sum through the stack, so the
+# registers end up holding something to check the simulator and the optimizer against. No address is left
+# in a register but $ra, as the optimizer may move the code and data.
+    li $s0, 0               # running sum
+    li $s1, 5               # words left
+    la $a0, table
+loop:
+    jal load_next
+    add $s0, $s0, $v0
+    addi $a0, $a0, 4
+    addi $s1, $s1, -1
+    bgt $s1, $zero, loop
+    li $r1, 100000
+    move $r2, $s0
+    j finish
+load_next:
+    lw $v0, 0($a0)
+    jr $zero, $ra, $zero
+finish:
+    sub $r3, $r1, $r2
+    push $r3
+    nop
+    pop $r4
+    bneq $r4, $r3, finish
+    lb $r5, table
+    add $r6, $r4, $r5
+    la $r7, table
+    sub $a0, $a0, $r7
+    move $r7, $zero
+
+    .data
+table:
+    .word 3, 14, 15, 92, 65
@@ -0,0 +1,107 @@
+#include "arena.h"
+
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGNMENT alignof(max_align_t)
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+void arena_init(Arena *arena) {
+    memset(arena, 0, sizeof(*arena));
+}
+
+static void arena_free_blocks(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->stats.capacity = 0;
+}
+
+void arena_free(Arena *arena) {
+    if (arena) arena_free_blocks(arena);
+}
+
+static ArenaBlock *arena_add_block(Arena *arena, size_t size) {
+    if (size > SIZE_MAX - sizeof(ArenaBlock)) return NULL;
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    if (!block) return NULL;
+
+    block->next = arena->head;
+    block->size = size;
+    block->used = 0;
+    arena->head = block;
+    arena->stats.block_allocations++;
+    arena->stats.capacity += size;
+    return block;
+}
+
+static size_t arena_round(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    if (!arena) return malloc(size);
+    if (size > SIZE_MAX - ARENA_ALIGNMENT) return NULL;
+
+    size = arena_round(size);
+    ArenaBlock *block = arena->head;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = block && block->size <= SIZE_MAX / 2 ? block->size * 2 : ARENA_BLOCK_SIZE;
+        if (block_size < size) block_size = size;
+        block = arena_add_block(arena, block_size);
+        if (!block) return NULL;
+    }
+
+    arena->last = block->used;
+    block->used += size;
+    arena->stats.allocations++;
+    arena->stats.used += size;
+    return block->data + arena->last;
+}
+
+void *arena_grow(Arena *arena, void *memory, size_t old_size, size_t new_size) {
+    if (!arena) return realloc(memory, new_size);
+    if (!memory) return arena_alloc(arena, new_size);
+
+    ArenaBlock *block = arena->head;
+    if (block && memory == block->data + arena->last && new_size <= SIZE_MAX - ARENA_ALIGNMENT &&
+        arena_round(new_size) <= block->size - arena->last) {
+        size_t used = arena->last + arena_round(new_size);
+        arena->stats.used = arena->stats.used - block->used + used;
+        block->used = used;
+        return memory;
+    }
+
+    void *grown = arena_alloc(arena, new_size);
+    if (grown) memcpy(grown, memory, old_size < new_size ? old_size : new_size);
+    return grown;
+}
+
+void arena_release(Arena *arena, void *memory) {
+    if (!arena) free(memory);
+}
+
+void arena_reset(Arena *arena) {
+    arena->stats.resets++;
+    arena->stats.used = 0;
+    arena->last = 0;
+    if (arena->head && arena->head->next) {
+        size_t total = arena->stats.capacity;
+        arena_free_blocks(arena);
+        arena_add_block(arena, total);
+    } else if (arena->head) {
+        arena->head->used = 0;
+    }
+}
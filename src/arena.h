@@ -0,0 +1,45 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Region allocator. Allocations are carved out of large blocks and are never freed one by one: arena_reset
+// rewinds the whole region for reuse, keeping its capacity, and arena_free returns it. Only new blocks
+// reach malloc, and blocks grow geometrically, so a reused arena settles at one block and no allocator
+// calls at all.
+//
+// A NULL arena stands for the heap: arena_alloc and arena_grow become malloc and realloc and
+// arena_release frees, which lets a structure take either without two code paths.
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    uint64_t block_allocations; // malloc calls made for blocks
+    uint64_t allocations;       // allocations that needed new space, growth in place excluded
+    uint64_t resets;
+    size_t capacity;            // bytes held in blocks
+    size_t used;                // bytes carved since the last reset, space given up by grown allocations included
+} ArenaStats;
+
+typedef struct {
+    ArenaBlock *head; // block carved from; the ones filled before it follow
+    size_t last;      // offset in head of the most recent allocation, the only one arena_grow extends in place
+    ArenaStats stats;
+} Arena;
+
+void arena_init(Arena *arena);
+
+void arena_free(Arena *arena);
+
+// Memory aligned for any type, or NULL when a block cannot be allocated.
+void *arena_alloc(Arena *arena, size_t size);
+
+// realloc for arena memory: extends the most recent allocation in place when its block has room and
+// otherwise copies old_size bytes into a new one, leaving the old space unused until the next reset. The
+// old memory stays valid when NULL is returned.
+void *arena_grow(Arena *arena, void *memory, size_t old_size, size_t new_size);
+
+// Frees heap memory; arena memory is only reclaimed by arena_reset and arena_free.
+void arena_release(Arena *arena, void *memory);
+
+// Invalidates every allocation. When the last run spilled over several blocks they are replaced by a
+// single one as large as all of them, so the same work fits without further blocks.
+void arena_reset(Arena *arena);
@@ -0,0 +1,108 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "assembler.h"
+#include "diagnostics.h"
+#include "object.h"
+#include "output.h"
+#include "source.h"
+
+static void print_usage(const char *program) {
+    printf("Usage: %s [-q | -v] <output_file> <binary_output_file> <object_file>...\n", program);
+}
+
+static void close_objects(SourceFile *files, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) source_close(&files[i]);
+    free(files);
+}
+
+int main(int argc, char *argv[]) {
+    int option;
+    while ((option = getopt(argc, argv, "qv")) != -1) {
+        switch (option) {
+            case 'q':
+                diagnostics_set_level(DIAGNOSTIC_ERROR);
+                break;
+            case 'v':
+                diagnostics_set_level(DIAGNOSTIC_TRACE);
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind < 3) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *listing_path = argv[optind];
+    const char *binary_path = argv[optind + 1];
+    char **object_paths = argv + optind + 2;
+    uint32_t object_count = (uint32_t) (argc - optind - 2);
+
+    // The objects stay mapped until the link is done; the linker reads them in place.
+    SourceFile *files = calloc(object_count, sizeof(SourceFile));
+    ObjectFile *objects = calloc(object_count, sizeof(ObjectFile));
+    if (!files || !objects) {
+        diag_error("failed to allocate object list");
+        free(files);
+        free(objects);
+        return 1;
+    }
+    for (uint32_t i = 0; i < object_count; i++) {
+        if (!source_open(object_paths[i], &files[i])) {
+            diag_error("failed to open object file: %s", object_paths[i]);
+            close_objects(files, i);
+            free(objects);
+            return 1;
+        }
+        if (!object_load(&objects[i], files[i].data, files[i].size)) {
+            diag_error("not a valid object file: %s", object_paths[i]);
+            close_objects(files, i + 1);
+            free(objects);
+            return 1;
+        }
+        diag_trace("%s: %u instructions, %u symbols, %u relocations", object_paths[i], objects[i].instruction_count,
+                   objects[i].symbol_count, objects[i].relocation_count);
+    }
+
+    Assembler *assembler = assembler_create();
+    if (!assembler) {
+        diag_error("failed to create assembler");
+        close_objects(files, object_count);
+        free(objects);
+        return 1;
+    }
+    object_link(assembler, objects, object_count);
+    close_objects(files, object_count);
+    free(objects);
+    if (assembler->error_count > 0) {
+        for (uint32_t i = 0; i < assembler->error_count; i++) diag_error("%s", assembler->errors[i].message);
+        diag_info("link failed with %u errors", assembler->error_count);
+        assembler_destroy(assembler);
+        return 1;
+    }
+
+    FILE *assembly_dest = fopen(listing_path, "w");
+    FILE *binary_dest = assembly_dest ? fopen(binary_path, "wb") : NULL;
+    if (!assembly_dest || !binary_dest) {
+        diag_error("failed to open output file: %s", assembly_dest ? binary_path : listing_path);
+        if (assembly_dest) fclose(assembly_dest);
+        assembler_destroy(assembler);
+        return 1;
+    }
+    bool written = output_write_listing(assembly_dest, assembler->machine_code, assembler->instruction_count);
+    written = output_write_binary(binary_dest, assembler->machine_code, assembler->instruction_count) && written;
+    written = fclose(assembly_dest) == 0 && written;
+    written = fclose(binary_dest) == 0 && written;
+    if (!written) {
+        diag_error("failed to write output files");
+        assembler_destroy(assembler);
+        return 1;
+    }
+    diag_info("linked %u objects, %u instructions", object_count, assembler->instruction_count);
+
+    assembler_destroy(assembler);
+    return 0;
+}
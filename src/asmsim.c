@@ -0,0 +1,111 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "diagnostics.h"
+#include "simulator.h"
+#include "source.h"
+
+#define DEFAULT_MEMORY_SIZE (16u << 20)
+
+static void print_usage(const char *program) {
+    printf("Usage: %s [-q | -v] [-r] [-m memory_bytes] [-n max_instructions] <binary_file>\n", program);
+}
+
+static double cpu_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+static void print_registers(const Simulator *simulator) {
+    for (uint32_t i = 0; i < 32; i++) {
+        printf("$%-2u 0x%08" PRIx32 "%s", i, simulator->registers[i], i % 4 == 3 ? "\n" : "    ");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t memory_size = DEFAULT_MEMORY_SIZE;
+    uint64_t max_instructions = UINT64_MAX;
+    bool show_registers = false;
+    int option;
+    while ((option = getopt(argc, argv, "m:n:qrv")) != -1) {
+        switch (option) {
+            case 'm':
+                memory_size = (uint32_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                max_instructions = strtoull(optarg, NULL, 0);
+                break;
+            case 'q':
+                diagnostics_set_level(DIAGNOSTIC_ERROR);
+                break;
+            case 'r':
+                show_registers = true;
+                break;
+            case 'v':
+                diagnostics_set_level(DIAGNOSTIC_TRACE);
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind < 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *binary_path = argv[optind];
+
+    SourceFile binary_source;
+    if (!source_open(binary_path, &binary_source)) {
+        diag_error("failed to open binary file: %s", binary_path);
+        return 1;
+    }
+    if (binary_source.size % sizeof(uint32_t) != 0 || binary_source.size / sizeof(uint32_t) > UINT32_MAX - 2) {
+        diag_error("not a binary image: %s", binary_path);
+        source_close(&binary_source);
+        return 1;
+    }
+    uint32_t count = (uint32_t) (binary_source.size / sizeof(uint32_t));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const uint32_t *machine_code = (const uint32_t *) binary_source.data;
+    uint32_t *copy = NULL;
+#else
+    uint32_t *copy = malloc(sizeof(uint32_t) * ((size_t) count + 1));
+    const uint32_t *machine_code = copy;
+    const uint8_t *bytes = (const uint8_t *) binary_source.data;
+    for (uint32_t i = 0; copy && i < count; i++) {
+        copy[i] = (uint32_t) bytes[4 * i] | (uint32_t) bytes[4 * i + 1] << 8 | (uint32_t) bytes[4 * i + 2] << 16 |
+                  (uint32_t) bytes[4 * i + 3] << 24;
+    }
+#endif
+
+    // The image is only read while predecoding.
+    Simulator *simulator = machine_code ? simulator_create(machine_code, count, memory_size) : NULL;
+    free(copy);
+    source_close(&binary_source);
+    if (!simulator) {
+        diag_error("failed to create simulator");
+        return 1;
+    }
+
+    double start = cpu_seconds();
+    SimulatorStatus status = simulator_run(simulator, max_instructions);
+    double seconds = cpu_seconds() - start;
+
+    if (show_registers) print_registers(simulator);
+    if (status == SIMULATOR_HALTED || status == SIMULATOR_STEP_LIMIT) {
+        diag_info("%s after %" PRIu64 " instructions", simulator_status_name(status), simulator->retired);
+    } else {
+        diag_error("%s: %s at instruction %u after %" PRIu64 " instructions", binary_path,
+                   simulator_status_name(status), simulator->pc, simulator->retired);
+    }
+    diag_info("%.3f s, %.1f M instructions/s", seconds,
+              seconds > 0 ? (double) simulator->retired / seconds / 1e6 : 0.0);
+
+    simulator_destroy(simulator);
+    return status == SIMULATOR_HALTED ? 0 : 1;
+}
@@ -3,27 +3,64 @@
 //
 
 #include "assembler.h"
+#include "pseudo.h"
+#include "source.h"
 
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define BUFFER_SIZE 1024
+#define DATA_MAX_ALIGN 12
+#define INCBIN_PATH_MAX 4096
+
+// Carves every buffer out of the arena at the capacities the assembler records, which start at BUFFER_SIZE
+// (or nothing for the buffers only some programs need) and only grow, so a reused assembler keeps its size.
+static bool assembler_allocate(Assembler *assembler) {
+    Arena *arena = &assembler->arena;
+    assembler->machine_code = arena_alloc(arena, sizeof(uint32_t) * assembler->machine_code_size);
+    assembler->instruction_types = arena_alloc(arena, sizeof(uint8_t) * assembler->instruction_capacity);
+    assembler->instruction_symbols = arena_alloc(arena, sizeof(uint32_t) * assembler->instruction_capacity);
+    assembler->data = assembler->data_capacity ? arena_alloc(arena, assembler->data_capacity) : NULL;
+    assembler->fixups = assembler->fixup_capacity ? arena_alloc(arena, sizeof(Fixup) * assembler->fixup_capacity)
+                                                  : NULL;
+    assembler->errors = assembler->error_capacity
+                            ? arena_alloc(arena, sizeof(AssemblerError) * assembler->error_capacity)
+                            : NULL;
+    bool labels = symbol_table_init_arena(&assembler->labels, arena, assembler->labels.label_capacity,
+                                          assembler->labels.strings_capacity);
+    return labels && assembler->machine_code && assembler->instruction_types && assembler->instruction_symbols &&
+           (assembler->data || !assembler->data_capacity) && (assembler->fixups || !assembler->fixup_capacity) &&
+           (assembler->errors || !assembler->error_capacity);
+}
 
 Assembler *assembler_create() {
     Assembler *assembler = malloc(sizeof(Assembler));
     if (!assembler) return NULL;
 
-    assembler->instructions = malloc(sizeof(Instruction) * BUFFER_SIZE);
-    assembler->machine_code = malloc(sizeof(uint32_t) * BUFFER_SIZE);
-    assembler->labels = malloc(sizeof(Label) * BUFFER_SIZE);
+    arena_init(&assembler->arena);
     assembler->instruction_count = 0;
+    assembler->instruction_capacity = BUFFER_SIZE;
     assembler->machine_code_size = BUFFER_SIZE;
-    assembler->label_count = 0;
+    assembler->window_start = 0;
+    assembler->labels.label_capacity = 0;
+    assembler->labels.strings_capacity = 0;
+    assembler->data_size = 0;
+    assembler->data_capacity = 0;
+    assembler->data_alignment = 1;
+    assembler->in_data = false;
+    assembler->one_pass = false;
+    assembler->fixup_capacity = 0;
+    assembler->fixup_count = 0;
+    assembler->free_fixup = ASSEMBLER_NO_FIXUP;
+    assembler->pending_fixups = 0;
+    assembler->source_line = 0;
+    assembler->source_column = 0;
+    assembler->error_count = 0;
+    assembler->error_capacity = 0;
     assembler->last_error = ASSEMBLER_SUCCESS;
     memset(assembler->error_message, 0, sizeof(assembler->error_message));
 
-    if (!assembler->instructions || !assembler->machine_code) {
+    if (!assembler_allocate(assembler)) {
         assembler_destroy(assembler);
         return NULL;
     }
@@ -33,13 +70,274 @@ Assembler *assembler_create() {
 
 void assembler_destroy(Assembler *assembler) {
     if (assembler) {
-        free(assembler->instructions);
-        free(assembler->machine_code);
-        free(assembler->labels);
+        arena_free(&assembler->arena);
         free(assembler);
     }
 }
 
+bool assembler_reset(Assembler *assembler) {
+    if (!assembler) return false;
+
+    assembler->instruction_count = 0;
+    assembler->window_start = 0;
+    assembler->data_size = 0;
+    assembler->data_alignment = 1;
+    assembler->in_data = false;
+    assembler->fixup_count = 0;
+    assembler->free_fixup = ASSEMBLER_NO_FIXUP;
+    assembler->pending_fixups = 0;
+    assembler->source_line = 0;
+    assembler->source_column = 0;
+    assembler->error_count = 0;
+    assembler->last_error = ASSEMBLER_SUCCESS;
+    assembler->error_message[0] = '\0';
+    arena_reset(&assembler->arena);
+    return assembler_allocate(assembler);
+}
+
+ArenaStats assembler_arena_stats(const Assembler *assembler) {
+    return assembler->arena.stats;
+}
+
+bool assembler_set_one_pass(Assembler *assembler, bool one_pass) {
+    if (!assembler || assembler->instruction_count > 0) {
+        return false;
+    }
+
+    // One-pass mode lets machine_code outgrow the per-instruction arrays; catch them up before leaving it.
+    // Nothing is stored yet, so the arrays are replaced rather than copied.
+    if (assembler->one_pass && !one_pass && assembler->machine_code_size > assembler->instruction_capacity) {
+        uint8_t *new_types = arena_alloc(&assembler->arena, sizeof(uint8_t) * assembler->machine_code_size);
+        uint32_t *new_symbols = arena_alloc(&assembler->arena, sizeof(uint32_t) * assembler->machine_code_size);
+        if (!new_types || !new_symbols) {
+            return false;
+        }
+        assembler->instruction_types = new_types;
+        assembler->instruction_symbols = new_symbols;
+        assembler->instruction_capacity = assembler->machine_code_size;
+    }
+
+    assembler->one_pass = one_pass;
+    return true;
+}
+
+bool assembler_reserve(Assembler *assembler, uint32_t count) {
+    if (!assembler) return false;
+    count -= assembler->window_start; // discarded instructions no longer take room
+    if (count <= assembler->machine_code_size) return true;
+
+    size_t new_size = assembler->machine_code_size;
+    while (new_size < count) new_size *= 2;
+    if (new_size > UINT32_MAX) new_size = UINT32_MAX;
+
+    uint32_t *new_machine_code = arena_grow(&assembler->arena, assembler->machine_code,
+                                            sizeof(uint32_t) * assembler->machine_code_size,
+                                            sizeof(uint32_t) * new_size);
+    if (!new_machine_code) return false;
+    assembler->machine_code = new_machine_code;
+
+    // One-pass mode never looks at the per-instruction arrays again, so they are left small.
+    if (!assembler->one_pass) {
+        uint32_t capacity = assembler->instruction_capacity;
+        uint8_t *new_types = arena_grow(&assembler->arena, assembler->instruction_types, sizeof(uint8_t) * capacity,
+                                        sizeof(uint8_t) * new_size);
+        if (new_types) assembler->instruction_types = new_types;
+        uint32_t *new_symbols = arena_grow(&assembler->arena, assembler->instruction_symbols,
+                                           sizeof(uint32_t) * capacity, sizeof(uint32_t) * new_size);
+        if (new_symbols) assembler->instruction_symbols = new_symbols;
+
+        if (!new_types || !new_symbols) {
+            return false;
+        }
+        assembler->instruction_capacity = (uint32_t) new_size;
+    }
+
+    assembler->machine_code_size = (uint32_t) new_size;
+    return true;
+}
+
+// A branch gets its offset relative to the next instruction, a jump the absolute instruction index and la or
+// a memory operand the byte address as its immediate.
+InstructionValidateResult assembler_patch_word(uint32_t *word, uint8_t type, uint32_t instruction, uint32_t target) {
+    if (type == I_TYPE) {
+        int64_t offset = (int64_t) target - (int64_t) instruction - 1;
+        if (offset < INT16_MIN || offset > INT16_MAX) {
+            return ASSEMBLER_ERROR_INVALID_OFFSET;
+        }
+        *word = (*word & ~0xFFFFu) | ((uint32_t) offset & 0xFFFF);
+    } else if (type == J_TYPE) {
+        if (target > 0x3FFFFFF) {
+            return ASSEMBLER_ERROR_INVALID_OFFSET;
+        }
+        *word = (*word & ~0x3FFFFFFu) | target;
+    } else if (type == ASSEMBLER_TYPE_ADDRESS) {
+        if (target > INT16_MAX) {
+            return ASSEMBLER_ERROR_INVALID_OFFSET;
+        }
+        // The same rule parse_memory_operands applies to a numeric offset.
+        const InstructionDef *def = decode_instruction(*word);
+        if (def && def->format == OPERANDS_MEMORY && target % def->width != 0) {
+            return ASSEMBLER_ERROR_MISALIGNED_ADDRESS;
+        }
+        *word = (*word & ~0xFFFFu) | target;
+    }
+    return ASSEMBLER_SUCCESS;
+}
+
+const char *assembler_patch_message(uint8_t type, InstructionValidateResult result) {
+    if (result == ASSEMBLER_ERROR_MISALIGNED_ADDRESS) return "Label address is misaligned";
+    return type == ASSEMBLER_TYPE_ADDRESS ? "Label address is out of range" : "Branch target is out of range";
+}
+
+static bool assembler_add_fixup(Assembler *assembler, Label *label, uint32_t instruction, uint8_t type) {
+    uint32_t node = assembler->free_fixup;
+    if (node != ASSEMBLER_NO_FIXUP) {
+        assembler->free_fixup = assembler->fixups[node].next;
+    } else {
+        if (assembler->fixup_count >= assembler->fixup_capacity) {
+            uint32_t new_capacity = assembler->fixup_capacity ? assembler->fixup_capacity * 2 : BUFFER_SIZE;
+            Fixup *new_fixups = arena_grow(&assembler->arena, assembler->fixups,
+                                           sizeof(Fixup) * assembler->fixup_capacity, sizeof(Fixup) * new_capacity);
+            if (!new_fixups) return false;
+            assembler->fixups = new_fixups;
+            assembler->fixup_capacity = new_capacity;
+        }
+        node = assembler->fixup_count++;
+    }
+
+    assembler->fixups[node].instruction = instruction;
+    assembler->fixups[node].type = type;
+    assembler->fixups[node].next = label->first_fixup;
+    label->first_fixup = node;
+    assembler->pending_fixups++;
+    return true;
+}
+
+uint32_t assembler_location(const Assembler *assembler) {
+    return assembler->in_data ? SYMBOL_DATA | assembler->data_size : assembler->instruction_count;
+}
+
+// Byte address of the .data section: right after the instructions, aligned for its largest .align.
+static uint64_t assembler_data_start(const Assembler *assembler) {
+    uint64_t alignment = assembler->data_alignment;
+    return ((uint64_t) assembler->instruction_count * 4 + alignment - 1) / alignment * alignment;
+}
+
+uint32_t assembler_label_address(const Assembler *assembler, uint32_t instruction_line) {
+    if (instruction_line == SYMBOL_UNDEFINED || !(instruction_line & SYMBOL_DATA)) return instruction_line;
+    uint64_t address = assembler_data_start(assembler) + (instruction_line & ~SYMBOL_DATA);
+    return address < SYMBOL_DATA ? (uint32_t) address : SYMBOL_UNDEFINED;
+}
+
+uint32_t assembler_reference_target(const Assembler *assembler, uint8_t type, uint32_t instruction_line) {
+    if (type != ASSEMBLER_TYPE_ADDRESS || instruction_line == SYMBOL_UNDEFINED || (instruction_line & SYMBOL_DATA)) {
+        return assembler_label_address(assembler, instruction_line);
+    }
+    return instruction_line < SYMBOL_DATA / 4 ? instruction_line * 4 : SYMBOL_UNDEFINED;
+}
+
+// Patches every reference waiting on a label now known to be at instruction_line and returns the nodes to
+// the free list. The first reference that does not fit is reported.
+static bool assembler_resolve_fixups(Assembler *assembler, Label *label, uint32_t instruction_line) {
+    bool ok = true;
+    uint32_t node = label->first_fixup;
+    while (node != ASSEMBLER_NO_FIXUP) {
+        Fixup *fixup = &assembler->fixups[node];
+        uint32_t next = fixup->next;
+        uint32_t *word = &assembler->machine_code[fixup->instruction - assembler->window_start];
+        uint32_t target = assembler_reference_target(assembler, fixup->type, instruction_line);
+        InstructionValidateResult patched = assembler_patch_word(word, fixup->type, fixup->instruction, target);
+        if (patched != ASSEMBLER_SUCCESS && ok) {
+            assembler_set_error(assembler, patched, assembler_patch_message(fixup->type, patched));
+            ok = false;
+        }
+        fixup->instruction = ASSEMBLER_NO_FIXUP;
+        fixup->next = assembler->free_fixup;
+        assembler->free_fixup = node;
+        assembler->pending_fixups--;
+        node = next;
+    }
+    label->first_fixup = ASSEMBLER_NO_FIXUP;
+    return ok;
+}
+
+uint32_t assembler_settled_count(const Assembler *assembler) {
+    // The last two words stay for assembler_generate_machine_code to check against the image trailer.
+    uint32_t oldest = assembler->instruction_count > 2 ? assembler->instruction_count - 2 : 0;
+    if (oldest < assembler->window_start) oldest = assembler->window_start;
+    if (assembler->pending_fixups > 0) {
+        // Resolved nodes hold ASSEMBLER_NO_FIXUP, so the smallest index is the oldest reference still waiting.
+        for (uint32_t node = 0; node < assembler->fixup_count; node++) {
+            if (assembler->fixups[node].instruction < oldest) oldest = assembler->fixups[node].instruction;
+        }
+    }
+    return oldest - assembler->window_start;
+}
+
+void assembler_discard(Assembler *assembler, uint32_t count) {
+    uint32_t held = assembler->instruction_count - assembler->window_start;
+    memmove(assembler->machine_code, assembler->machine_code + count, sizeof(uint32_t) * (held - count));
+    assembler->window_start += count;
+}
+
+static uint32_t instruction_to_machine_code(const Instruction *instruction) {
+    switch (instruction->type) {
+        case R_TYPE:
+            return r_type_to_machine_code(&instruction->data.r);
+        case I_TYPE:
+            return i_type_to_machine_code(&instruction->data.i);
+        case J_TYPE:
+            return j_type_to_machine_code(&instruction->data.j);
+        default:
+            return 0;
+    }
+}
+
+// Appends a validated instruction, recorded with the given instruction_types entry.
+static InstructionValidateResult assembler_append(Assembler *assembler, const Instruction *instruction,
+                                                  uint8_t type) {
+    if (assembler->instruction_count == UINT32_MAX ||
+        !assembler_reserve(assembler, assembler->instruction_count + 1)) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand instruction buffer");
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
+
+    uint32_t symbol = ASSEMBLER_NO_SYMBOL;
+    if (instruction->label_ref) {
+        symbol = symbol_table_intern(&assembler->labels, instruction->label_ref, instruction->label_length);
+        if (symbol == SYMBOL_TABLE_EMPTY) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand label table");
+            return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+
+    uint32_t machine_code = instruction_to_machine_code(instruction);
+    uint32_t index = assembler->instruction_count;
+    if (assembler->one_pass) {
+        if (symbol != ASSEMBLER_NO_SYMBOL) {
+            // .data labels only get their address once every instruction is in.
+            Label *label = &assembler->labels.labels[symbol];
+            if (label->instruction_line < SYMBOL_DATA) {
+                InstructionValidateResult patched = assembler_patch_word(
+                    &machine_code, type, index, assembler_reference_target(assembler, type, label->instruction_line));
+                if (patched != ASSEMBLER_SUCCESS) {
+                    assembler_set_error(assembler, patched, assembler_patch_message(type, patched));
+                    return patched;
+                }
+            } else if (!assembler_add_fixup(assembler, label, index, type)) {
+                assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand fixup list");
+                return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+            }
+        }
+    } else {
+        assembler->instruction_types[index] = type;
+        assembler->instruction_symbols[index] = symbol;
+    }
+    assembler->machine_code[index - assembler->window_start] = machine_code;
+    assembler->instruction_count++;
+    return ASSEMBLER_SUCCESS;
+}
+
 InstructionValidateResult assembler_add_and_validate_instruction(Assembler *assembler, Instruction instruction) {
     if (!assembler) {
         return ASSEMBLER_ERROR_NULL_POINTER;
@@ -49,30 +347,283 @@ InstructionValidateResult assembler_add_and_validate_instruction(Assembler *asse
         assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Invalid instruction provided");
         return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
     }
+    return assembler_append(assembler, &instruction, assembler_instruction_type(&instruction));
+}
 
-    if (assembler->instruction_count >= assembler->machine_code_size) {
-        size_t new_size = assembler->machine_code_size * 2;
-        void *new_instructions = realloc(assembler->instructions, sizeof(Instruction) * new_size);
-        void *new_machine_code = realloc(assembler->machine_code, sizeof(uint32_t) * new_size);
+uint8_t assembler_instruction_type(const Instruction *instruction) {
+    if (instruction->label_ref && instruction->type == I_TYPE) {
+        const InstructionDef *def = decode_instruction(i_type_to_machine_code(&instruction->data.i));
+        if (def && def->format == OPERANDS_MEMORY) return ASSEMBLER_TYPE_ADDRESS;
+    }
+    return (uint8_t) instruction->type;
+}
 
-        if (!new_instructions || !new_machine_code) {
-            assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand instruction buffer");
-            return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+// Every instruction of the expansion is validated before any is added, so a bad line adds nothing.
+static InstructionValidateResult assembler_add_pseudo(Assembler *assembler, const SourceLine *line) {
+    PseudoExpansion expansion;
+    const char *message = "Invalid instruction provided";
+    InstructionValidateResult result = pseudo_expand(line, &expansion, &message);
+    for (uint32_t i = 0; result == ASSEMBLER_SUCCESS && i < expansion.count; i++) {
+        if (!assembler_validate_instruction(&expansion.instructions[i])) result = ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+    }
+    if (result != ASSEMBLER_SUCCESS) {
+        assembler_set_error(assembler, result, message);
+        return result;
+    }
+
+    for (uint32_t i = 0; i < expansion.count; i++) {
+        result = assembler_append(assembler, &expansion.instructions[i], expansion.types[i]);
+        if (result != ASSEMBLER_SUCCESS) return result;
+    }
+    return ASSEMBLER_SUCCESS;
+}
+
+static bool directive_is(const Token *token, const char *name) {
+    size_t length = strlen(name);
+    return token->length == length && memcmp(token->start, name, length) == 0;
+}
+
+// Checks the values after a .word, .half or .byte directive, read from the line's text so there can be any
+// number of them, against [min, max]. Returns how many there are, or 0 once an error is set.
+static uint32_t assembler_count_values(Assembler *assembler, const SourceLine *line, int64_t min, int64_t max,
+                                       const char *message) {
+    const char *cursor = line->tokens[0].start + line->tokens[0].length;
+    Token value;
+    uint32_t count = 0;
+    while (lexer_scan_token(line, &cursor, &value)) {
+        if (value.kind != TOKEN_NUMBER || value.base >= 0 || value.value < min || value.value > max) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_IMMEDIATE, message);
+            return 0;
+        }
+        count++;
+    }
+    if (count == 0) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INCOMPLETE_INSTRUCTION, "Directive needs values");
+    }
+    return count;
+}
+
+// `.word value...` stores raw words, which is how the disassembler writes words that decode to no
+// instruction.
+static InstructionValidateResult assembler_add_words(Assembler *assembler, const SourceLine *line) {
+    uint32_t count = assembler_count_values(assembler, line, INT32_MIN, UINT32_MAX,
+                                            "Word value does not fit in 32 bits");
+    if (count == 0) return assembler->last_error;
+
+    if (assembler->instruction_count > UINT32_MAX - count ||
+        !assembler_reserve(assembler, assembler->instruction_count + count)) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand instruction buffer");
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
+    const char *cursor = line->tokens[0].start + line->tokens[0].length;
+    Token value;
+    while (lexer_scan_token(line, &cursor, &value)) {
+        uint32_t index = assembler->instruction_count++;
+        if (!assembler->one_pass) {
+            assembler->instruction_types[index] = ASSEMBLER_TYPE_DATA;
+            assembler->instruction_symbols[index] = ASSEMBLER_NO_SYMBOL;
+        }
+        assembler->machine_code[index - assembler->window_start] = (uint32_t) value.value;
+    }
+    return ASSEMBLER_SUCCESS;
+}
+
+// Makes room for size more bytes of .data, keeping every .data address below SYMBOL_DATA.
+static bool assembler_reserve_data(Assembler *assembler, uint64_t size) {
+    uint64_t needed = (uint64_t) assembler->data_size + size;
+    if (needed >= SYMBOL_DATA) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_BUFFER_FULL, "Data section is too large");
+        return false;
+    }
+    if (needed <= assembler->data_capacity) return true;
+
+    uint64_t new_capacity = assembler->data_capacity ? assembler->data_capacity : BUFFER_SIZE;
+    while (new_capacity < needed) new_capacity *= 2;
+    uint8_t *new_data = arena_grow(&assembler->arena, assembler->data, assembler->data_capacity,
+                                   (size_t) new_capacity);
+    if (!new_data) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand data section");
+        return false;
+    }
+    assembler->data = new_data;
+    assembler->data_capacity = (uint32_t) (new_capacity < SYMBOL_DATA ? new_capacity : SYMBOL_DATA);
+    return true;
+}
+
+// .word, .half and .byte in .data: each value is stored little-endian in width bytes.
+static InstructionValidateResult assembler_add_data_values(Assembler *assembler, const SourceLine *line,
+                                                           uint32_t width) {
+    int64_t min = -((int64_t) 1 << (8 * width - 1));
+    int64_t max = ((int64_t) 1 << (8 * width)) - 1;
+    uint32_t count = assembler_count_values(assembler, line, min, max, "Data value does not fit its width");
+    if (count == 0) return assembler->last_error;
+    if (!assembler_reserve_data(assembler, (uint64_t) width * count)) {
+        return assembler->last_error;
+    }
+
+    uint8_t *out = assembler->data + assembler->data_size;
+    const char *cursor = line->tokens[0].start + line->tokens[0].length;
+    Token value;
+    while (lexer_scan_token(line, &cursor, &value)) {
+        for (uint32_t byte = 0; byte < width; byte++) *out++ = (uint8_t) ((uint64_t) value.value >> (8 * byte));
+    }
+    assembler->data_size = (uint32_t) (out - assembler->data);
+    return ASSEMBLER_SUCCESS;
+}
+
+static InstructionValidateResult assembler_add_zeros(Assembler *assembler, uint64_t count) {
+    if (!assembler_reserve_data(assembler, count)) return assembler->last_error;
+    memset(assembler->data + assembler->data_size, 0, (size_t) count);
+    assembler->data_size += (uint32_t) count;
+    return ASSEMBLER_SUCCESS;
+}
+
+// .space n and .align n.
+static InstructionValidateResult assembler_add_padding(Assembler *assembler, const SourceLine *line, bool align) {
+    const Token *amount = &line->tokens[1];
+    int64_t max = align ? DATA_MAX_ALIGN : (int64_t) SYMBOL_DATA;
+    if (line->token_count != 2 || amount->kind != TOKEN_NUMBER || amount->base >= 0 || amount->value < 0 ||
+        amount->value > max) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_IMMEDIATE,
+                            align ? "Alignment must be a power of two up to 2^12" : "Invalid .space size");
+        return ASSEMBLER_ERROR_INVALID_IMMEDIATE;
+    }
+    if (!align) return assembler_add_zeros(assembler, (uint64_t) amount->value);
+
+    uint32_t alignment = 1u << amount->value;
+    if (alignment > assembler->data_alignment) assembler->data_alignment = alignment;
+    return assembler_add_zeros(assembler, (alignment - assembler->data_size % alignment) % alignment);
+}
+
+// .incbin "path" or .incbin path, relative to the working directory. The lexer has no string tokens, so
+// the path is taken from the line's text.
+static InstructionValidateResult assembler_add_file(Assembler *assembler, const SourceLine *line) {
+    const char *p = line->tokens[0].start + line->tokens[0].length;
+    const char *end = line->text + line->length;
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    const char *path_end = p;
+    if (p < end && *p == '"') {
+        p++;
+        path_end = memchr(p, '"', (size_t) (end - p));
+    } else {
+        while (path_end < end && *path_end != ' ' && *path_end != '\t' && *path_end != '#' && *path_end != ';') {
+            path_end++;
         }
+    }
+
+    char path[INCBIN_PATH_MAX];
+    if (!path_end || path_end == p || (size_t) (path_end - p) >= sizeof(path)) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INCOMPLETE_INSTRUCTION, "Directive needs a file name");
+        return ASSEMBLER_ERROR_INCOMPLETE_INSTRUCTION;
+    }
+    memcpy(path, p, (size_t) (path_end - p));
+    path[path_end - p] = '\0';
+
+    SourceFile file;
+    if (!source_open(path, &file)) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Failed to open .incbin file");
+        return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+    }
+    InstructionValidateResult result = ASSEMBLER_SUCCESS;
+    if (!assembler_reserve_data(assembler, file.size)) {
+        result = assembler->last_error;
+    } else if (file.size > 0) {
+        memcpy(assembler->data + assembler->data_size, file.data, file.size);
+        assembler->data_size += (uint32_t) file.size;
+    }
+    source_close(&file);
+    return result;
+}
 
-        assembler->instructions = (Instruction *) new_instructions;
-        assembler->machine_code = (uint32_t *) new_machine_code;
-        assembler->machine_code_size = new_size;
+static InstructionValidateResult assembler_add_directive(Assembler *assembler, const SourceLine *line) {
+    const Token *directive = &line->tokens[0];
+    uint32_t flag;
+    if (directive_is(directive, ".text") || directive_is(directive, ".data")) {
+        if (line->token_count != 1) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Section directive takes no operands");
+            return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+        }
+        assembler->in_data = directive_is(directive, ".data");
+        return ASSEMBLER_SUCCESS;
+    } else if (directive_is(directive, ".word")) {
+        if (assembler->in_data) return assembler_add_data_values(assembler, line, 4);
+        return assembler_add_words(assembler, line);
+    } else if (directive_is(directive, ".half") || directive_is(directive, ".byte") ||
+               directive_is(directive, ".space") || directive_is(directive, ".align") ||
+               directive_is(directive, ".incbin")) {
+        if (!assembler->in_data) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Directive needs the .data section");
+            return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+        }
+        if (directive_is(directive, ".half")) return assembler_add_data_values(assembler, line, 2);
+        if (directive_is(directive, ".byte")) return assembler_add_data_values(assembler, line, 1);
+        if (directive_is(directive, ".incbin")) return assembler_add_file(assembler, line);
+        if (line->token_count < 2) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_INCOMPLETE_INSTRUCTION, "Directive needs values");
+            return ASSEMBLER_ERROR_INCOMPLETE_INSTRUCTION;
+        }
+        return assembler_add_padding(assembler, line, directive_is(directive, ".align"));
+    } else if (directive_is(directive, ".globl") || directive_is(directive, ".global")) {
+        flag = SYMBOL_GLOBAL;
+    } else if (directive_is(directive, ".extern")) {
+        flag = SYMBOL_EXTERN;
+    } else {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Unknown directive");
+        return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
     }
 
-    assembler->instructions[assembler->instruction_count++] = instruction;
+    if (line->token_count < 2 || line->token_count > LEXER_MAX_TOKENS) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INCOMPLETE_INSTRUCTION, "Directive needs label names");
+        return ASSEMBLER_ERROR_INCOMPLETE_INSTRUCTION;
+    }
+    for (uint32_t i = 1; i < line->token_count; i++) {
+        if (line->tokens[i].kind != TOKEN_IDENTIFIER) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_LABEL, "Directive operand is not a label");
+            return ASSEMBLER_ERROR_INVALID_LABEL;
+        }
+    }
+
+    for (uint32_t i = 1; i < line->token_count; i++) {
+        uint32_t symbol = symbol_table_intern(&assembler->labels, line->tokens[i].start, line->tokens[i].length);
+        if (symbol == SYMBOL_TABLE_EMPTY) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand label table");
+            return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+        }
+        assembler->labels.labels[symbol].flags |= flag;
+    }
     return ASSEMBLER_SUCCESS;
 }
 
+InstructionValidateResult assembler_add_statement(Assembler *assembler, const SourceLine *line) {
+    if (!assembler || !line) {
+        return ASSEMBLER_ERROR_NULL_POINTER;
+    }
+    if (line->token_count == 0) {
+        return ASSEMBLER_SUCCESS;
+    }
+    if (lexer_is_directive(line)) {
+        return assembler_add_directive(assembler, line);
+    }
+    if (assembler->in_data) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Instructions belong in the .text section");
+        return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+    }
+    if (pseudo_is_mnemonic(&line->tokens[0])) {
+        return assembler_add_pseudo(assembler, line);
+    }
+    ParseResult parsed;
+    Instruction instruction = parse_source_line(line, &parsed);
+    if (parsed == PARSE_ERROR_IMMEDIATE) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_IMMEDIATE, "Immediate does not fit in 16 bits");
+        return ASSEMBLER_ERROR_INVALID_IMMEDIATE;
+    }
+    return assembler_add_and_validate_instruction(assembler, instruction);
+}
+
 uint32_t r_type_to_machine_code(const RTypeInstruction *r_instr) {
     uint32_t machine_code = 0;
 
-    machine_code |= (r_instr->opcode & 0x3F) << 26;
+    machine_code |= (uint32_t) (r_instr->opcode & 0x3F) << 26;
     machine_code |= (r_instr->rs & 0x1F) << 21;
     machine_code |= (r_instr->rt & 0x1F) << 16;
     machine_code |= (r_instr->rd & 0x1F) << 11;
@@ -85,7 +636,7 @@ uint32_t r_type_to_machine_code(const RTypeInstruction *r_instr) {
 uint32_t i_type_to_machine_code(const ITypeInstruction *i_instr) {
     uint32_t machine_code = 0;
 
-    machine_code |= (i_instr->opcode & 0x3F) << 26;
+    machine_code |= (uint32_t) (i_instr->opcode & 0x3F) << 26;
     machine_code |= (i_instr->rs & 0x1F) << 21;
     machine_code |= (i_instr->rt & 0x1F) << 16;
     machine_code |= (i_instr->immediate & 0xFFFF);
@@ -95,54 +646,177 @@ uint32_t i_type_to_machine_code(const ITypeInstruction *i_instr) {
 
 uint32_t j_type_to_machine_code(const JTypeInstruction *j_instr) {
     uint32_t machine_code = 0;
-    machine_code |= (j_instr->opcode & 0x3F) << 26;
+    machine_code |= (uint32_t) (j_instr->opcode & 0x3F) << 26;
     machine_code |= (j_instr->address & 0x3FFFFFF);
     return machine_code;
 }
 
+static bool ends_like_trailer(const uint32_t *end, uint32_t count) {
+    return count >= 2 && end[-1] == ASSEMBLER_IMAGE_MAGIC && end[-2] <= count - 2;
+}
+
+uint32_t assembler_image_text_count(const uint32_t *image, uint32_t *count) {
+    if (!ends_like_trailer(image + *count, *count)) return *count;
+    *count -= 2;
+    return image[*count];
+}
+
+// Moves the .data section behind the instructions as little-endian words, the last one zero-padded, and
+// ends the image with its trailer. Zero words in between align it as assembler_data_start says. Without
+// .data the trailer is only added when the instructions end in what would be read as one; streaming keeps
+// those last two words in memory for this (see assembler_settled_count).
+static bool assembler_append_data(Assembler *assembler) {
+    uint32_t count = assembler->instruction_count;
+    uint32_t words = (uint32_t) (((uint64_t) assembler->data_size + 3) / 4);
+    if (words == 0 && !ends_like_trailer(assembler->machine_code + (count - assembler->window_start), count)) {
+        return true;
+    }
+    uint32_t padding = words ? (uint32_t) (assembler_data_start(assembler) / 4 - count) : 0;
+    if (count > UINT32_MAX - words - padding - 2 || !assembler_reserve(assembler, count + padding + words + 2)) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand instruction buffer");
+        return false;
+    }
+
+    uint32_t *out = assembler->machine_code + (count - assembler->window_start) + padding;
+    memset(out - padding, 0, sizeof(uint32_t) * padding);
+    if (words) out[words - 1] = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (words) memcpy(out, assembler->data, assembler->data_size);
+#else
+    memset(out, 0, sizeof(uint32_t) * words);
+    for (uint32_t i = 0; i < assembler->data_size; i++) out[i / 4] |= (uint32_t) assembler->data[i] << (8 * (i % 4));
+#endif
+    out[words] = count;
+    out[words + 1] = ASSEMBLER_IMAGE_MAGIC;
+    words += padding + 2;
+    if (!assembler->one_pass) {
+        memset(assembler->instruction_types + count, ASSEMBLER_TYPE_DATA, words);
+        memset(assembler->instruction_symbols + count, 0xFF, sizeof(uint32_t) * words);
+    }
+    assembler->instruction_count += words;
+    assembler->data_size = 0;
+    return true;
+}
+
 uint32_t *assembler_generate_machine_code(Assembler *assembler) {
-    if (!assembler || !assembler->instructions) {
+    if (!assembler || !assembler->machine_code) {
         return NULL;
     }
 
-    for (size_t i = 0; i < assembler->instruction_count; i++) {
-        Instruction *instr = &assembler->instructions[i];
-        uint32_t machine_code = 0;
+    if (assembler->one_pass) {
+        Label *labels = assembler->labels.labels;
+        for (uint32_t symbol = 0; symbol < assembler->labels.label_count; symbol++) {
+            uint32_t line = labels[symbol].instruction_line;
+            if (line == SYMBOL_UNDEFINED || line < SYMBOL_DATA) continue;
+            if (!assembler_resolve_fixups(assembler, &labels[symbol], line)) return NULL;
+        }
+        if (assembler->pending_fixups > 0) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_LABEL, "Reference to an undefined label");
+            return NULL;
+        }
+        return assembler_append_data(assembler) ? assembler->machine_code : NULL;
+    }
 
-        if (strlen(instr->label_ref) > 0) {
-            int32_t label_line = assembler_find_label(assembler, instr->label_ref);
-            printf("Found label at: %d\n", label_line);
-            if (label_line < 0) {
-                return NULL;
-            }
+    const uint8_t *types = assembler->instruction_types;
+    const uint32_t *symbols = assembler->instruction_symbols;
+    uint32_t *machine_code = assembler->machine_code;
 
-            if (instr->type == I_TYPE) {
-                int32_t offset = label_line - (int32_t) i - 1;
-                instr->data.i.immediate = (int16_t) offset;
-            } else if (instr->type == J_TYPE) {
-                instr->data.j.address = (uint32_t) label_line;
-            }
+    for (uint32_t i = 0; i < assembler->instruction_count; i++) {
+        if (symbols[i] == ASSEMBLER_NO_SYMBOL) {
+            continue;
+        }
+
+        uint32_t label_line = assembler->labels.labels[symbols[i]].instruction_line;
+        if (label_line == SYMBOL_UNDEFINED) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_LABEL, "Reference to an undefined label");
+            return NULL;
+        }
+
+        InstructionValidateResult patched = assembler_patch_word(
+            &machine_code[i], types[i], i, assembler_reference_target(assembler, types[i], label_line));
+        if (patched != ASSEMBLER_SUCCESS) {
+            assembler_set_error(assembler, patched, assembler_patch_message(types[i], patched));
+            return NULL;
         }
+    }
+
+    return assembler_append_data(assembler) ? assembler->machine_code : NULL;
+}
+
+InstructionValidateResult assembler_assemble_source(Assembler *assembler, const char *source, size_t size) {
+    if (!assembler || (!source && size > 0)) {
+        return ASSEMBLER_ERROR_NULL_POINTER;
+    }
+    if (!assembler_set_one_pass(assembler, true) || assembler->labels.label_count > 0) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Assembly needs an empty assembler");
+        return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+    }
 
-        switch (instr->type) {
-            case R_TYPE:
-                machine_code = r_type_to_machine_code(&instr->data.r);
-                break;
-            case I_TYPE:
-                machine_code = i_type_to_machine_code(&instr->data.i);
-                break;
-            case J_TYPE:
-                machine_code = j_type_to_machine_code(&instr->data.j);
-                break;
-            default:
-                machine_code = 0;
-                break;
+    uint32_t first_error = assembler->error_count;
+    Lexer lexer;
+    SourceLine line;
+    lexer_init(&lexer, source, size);
+    while (lexer_next_line(&lexer, &line)) {
+        if (line.label) {
+            assembler_set_location(assembler, line.line_number, (uint32_t) (line.label - line.text) + 1);
+            assembler_add_label_span(assembler, line.label, line.label_length, assembler_location(assembler));
         }
+        if (line.token_count == 0) {
+            continue;
+        }
+
+        assembler_set_location(assembler, line.line_number, (uint32_t) (line.tokens[0].start - line.text) + 1);
+        assembler_add_statement(assembler, &line);
+    }
+    assembler_set_location(assembler, 0, 0);
+
+    if (assembler->error_count > first_error) {
+        return assembler->errors[first_error].code;
+    }
+    return assembler_generate_machine_code(assembler) ? ASSEMBLER_SUCCESS : assembler->last_error;
+}
+
+InstructionValidateResult assembler_assemble(const char *source, size_t size, AssemblyOutput *output) {
+    if (!output) {
+        return ASSEMBLER_ERROR_NULL_POINTER;
+    }
+    memset(output, 0, sizeof(*output));
+
+    Assembler *assembler = assembler_create();
+    if (!assembler) {
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
 
-        assembler->machine_code[i] = machine_code;
+    InstructionValidateResult result = assembler_assemble_source(assembler, source, size);
+
+    // The assembler's buffers go away with its arena, so the results are copied to the heap.
+    if (result == ASSEMBLER_SUCCESS) {
+        output->machine_code = malloc(sizeof(uint32_t) * ((size_t) assembler->instruction_count + 1));
+        if (output->machine_code) {
+            memcpy(output->machine_code, assembler->machine_code, sizeof(uint32_t) * assembler->instruction_count);
+            output->instruction_count = assembler->instruction_count;
+        } else {
+            result = ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+    if (assembler->error_count > 0) {
+        output->errors = malloc(sizeof(AssemblerError) * assembler->error_count);
+        if (output->errors) {
+            memcpy(output->errors, assembler->errors, sizeof(AssemblerError) * assembler->error_count);
+            output->error_count = assembler->error_count;
+        }
     }
 
-    return assembler->machine_code;
+    assembler_destroy(assembler);
+    return result;
+}
+
+void assembly_output_free(AssemblyOutput *output) {
+    if (output) {
+        free(output->machine_code);
+        free(output->errors);
+        memset(output, 0, sizeof(*output));
+    }
 }
 
 bool assembler_validate_instruction(const Instruction *instruction) {
@@ -152,16 +826,18 @@ bool assembler_validate_instruction(const Instruction *instruction) {
 
     switch (instruction->type) {
         case R_TYPE:
-            return !assembler_validate_r_type(&instruction->data.r); // change all of these to error enums
+            return assembler_validate_r_type(&instruction->data.r) == ASSEMBLER_SUCCESS;
         case I_TYPE:
-            return assembler_validate_i_type(&instruction->data.i);
+            return assembler_validate_i_type(&instruction->data.i) == ASSEMBLER_SUCCESS;
         case J_TYPE:
-            return assembler_validate_j_type(&instruction->data.j);
+            return assembler_validate_j_type(&instruction->data.j) == ASSEMBLER_SUCCESS;
         default:
             return false;
     }
 }
 
+// Field widths are fixed by the encoding; which opcodes and functs exist, and the offset alignment of
+// memory instructions, come from the rows of isa.h through instruction_row.
 InstructionValidateResult assembler_validate_r_type(const RTypeInstruction *r_instr) {
     if (!r_instr) {
         return ASSEMBLER_ERROR_NULL_POINTER;
@@ -175,54 +851,48 @@ InstructionValidateResult assembler_validate_r_type(const RTypeInstruction *r_in
         return ASSEMBLER_ERROR_INVALID_OFFSET;
     }
 
-    if (r_instr->opcode > 63 || r_instr->funct > 63) {
+    if (!instruction_row(R_TYPE, r_instr->opcode, r_instr->funct)) {
         return ASSEMBLER_ERROR_INVALID_OPCODE;
     }
 
-    if (r_instr->opcode == 0x08 || r_instr->opcode == 0x09) {
-        if (r_instr->opcode % 4 != 0) {
-            return ASSEMBLER_ERROR_INVALID_ADDRESS;
-        }
-    }
-    if (r_instr->opcode == 0x0A || r_instr->opcode == 0x0B) {
-        if (r_instr->opcode % 2 != 0) {
-            return ASSEMBLER_ERROR_INVALID_ADDRESS;
-        }
-    }
-
     return ASSEMBLER_SUCCESS;
 }
 
-bool assembler_validate_i_type(const ITypeInstruction *i_instr) {
+InstructionValidateResult assembler_validate_i_type(const ITypeInstruction *i_instr) {
     if (!i_instr) {
-        return false;
+        return ASSEMBLER_ERROR_NULL_POINTER;
     }
 
     if (i_instr->rs > 31 || i_instr->rt > 31) {
-        return false;
+        return ASSEMBLER_ERROR_INVALID_REGISTER;
     }
 
-    if (i_instr->opcode > 63) {
-        return false;
+    const InstructionDef *def = instruction_row(I_TYPE, i_instr->opcode, 0);
+    if (!def) {
+        return ASSEMBLER_ERROR_INVALID_OPCODE;
     }
 
-    return true;
+    if (def->format == OPERANDS_MEMORY && i_instr->immediate % def->width != 0) {
+        return ASSEMBLER_ERROR_INVALID_OFFSET;
+    }
+
+    return ASSEMBLER_SUCCESS;
 }
 
-bool assembler_validate_j_type(const JTypeInstruction *j_instr) {
+InstructionValidateResult assembler_validate_j_type(const JTypeInstruction *j_instr) {
     if (!j_instr) {
-        return false;
+        return ASSEMBLER_ERROR_NULL_POINTER;
     }
 
-    if (j_instr->opcode > 63) {
-        return false;
+    if (!instruction_row(J_TYPE, j_instr->opcode, 0)) {
+        return ASSEMBLER_ERROR_INVALID_OPCODE;
     }
 
     if (j_instr->address > 0x3FFFFFF) {
-        return false;
+        return ASSEMBLER_ERROR_INVALID_ADDRESS;
     }
 
-    return true;
+    return ASSEMBLER_SUCCESS;
 }
 
 const char *assembler_get_error_message(const Assembler *assembler) {
@@ -244,24 +914,60 @@ void assembler_set_error(Assembler *assembler, InstructionValidateResult error,
     } else {
         assembler->error_message[0] = '\0';
     }
+
+    if (assembler->error_count >= assembler->error_capacity) {
+        uint32_t new_capacity = assembler->error_capacity ? assembler->error_capacity * 2 : 16;
+        AssemblerError *new_errors = arena_grow(&assembler->arena, assembler->errors,
+                                                sizeof(AssemblerError) * assembler->error_capacity,
+                                                sizeof(AssemblerError) * new_capacity);
+        if (!new_errors) return; // last_error still reports it
+        assembler->errors = new_errors;
+        assembler->error_capacity = new_capacity;
+    }
+    AssemblerError *record = &assembler->errors[assembler->error_count++];
+    record->line = assembler->source_line;
+    record->column = assembler->source_column;
+    record->code = error;
+    record->message = message ? message : "";
+}
+
+void assembler_set_location(Assembler *assembler, uint32_t line, uint32_t column) {
+    if (assembler) {
+        assembler->source_line = line;
+        assembler->source_column = column;
+    }
 }
 
 bool assembler_add_label(Assembler *assembler, const char *name, uint32_t instruction_line) {
-    if (!assembler || !name) {
+    if (!name) {
         return false;
     }
 
-    if (assembler->label_count >= BUFFER_SIZE) {
+    return assembler_add_label_span(assembler, name, strlen(name), instruction_line);
+}
+
+bool assembler_add_label_span(Assembler *assembler, const char *name, size_t length, uint32_t instruction_line) {
+    if (!assembler || !name) {
         return false;
     }
 
-    strncpy(assembler->labels[assembler->label_count].name, name,
-            sizeof(assembler->labels[assembler->label_count].name) - 1);
-    assembler->labels[assembler->label_count].name[sizeof(assembler->labels[assembler->label_count].name) - 1] = '\0';
-    assembler->labels[assembler->label_count].instruction_line = instruction_line;
-    assembler->label_count++;
+    uint32_t symbol = symbol_table_intern(&assembler->labels, name, length);
+    if (symbol == SYMBOL_TABLE_EMPTY) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand label table");
+        return false;
+    }
 
-    return true;
+    switch (symbol_table_define(&assembler->labels, symbol, instruction_line)) {
+        case SYMBOL_TABLE_OK:
+            if (instruction_line >= SYMBOL_DATA) return true;
+            return assembler_resolve_fixups(assembler, &assembler->labels.labels[symbol], instruction_line);
+        case SYMBOL_TABLE_DUPLICATE:
+            assembler_set_error(assembler, ASSEMBLER_ERROR_DUPLICATE_LABEL, "Label is already defined");
+            return false;
+        default:
+            assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand label table");
+            return false;
+    }
 }
 
 int32_t assembler_find_label(const Assembler *assembler, const char *name) {
@@ -269,13 +975,8 @@ int32_t assembler_find_label(const Assembler *assembler, const char *name) {
         return -1;
     }
 
-    for (uint32_t i = 0; i < assembler->label_count; i++) {
-        if (strcmp(assembler->labels[i].name, name) == 0) {
-            return (int32_t) assembler->labels[i].instruction_line;
-        }
-    }
-
-    return -1;
+    const Label *label = symbol_table_find(&assembler->labels, name, strlen(name));
+    return label ? (int32_t) label->instruction_line : -1;
 }
 
 bool is_label_line(const char *line) {
@@ -2,7 +2,10 @@
 // Created by William James Lagos on 7/26/25.
 //
 #pragma once
+#include "arena.h"
 #include "instruction.h"
+#include "symbol_table.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -19,39 +22,171 @@ typedef enum {
     ASSEMBLER_ERROR_INVALID_OPCODE,
     ASSEMBLER_ERROR_MEMORY_ALLOCATION,
     ASSEMBLER_ERROR_BUFFER_FULL,
+    ASSEMBLER_ERROR_DUPLICATE_LABEL,
+    ASSEMBLER_ERROR_MISALIGNED_ADDRESS,
 } InstructionValidateResult;
 
+// One reported problem. line and column are 1-based source positions, or 0 when the error is not tied to
+// a line; message is the static text passed to assembler_set_error.
 typedef struct {
-    char name[256];
-    uint32_t instruction_line;
-} Label;
-
+    uint32_t line;
+    uint32_t column;
+    InstructionValidateResult code;
+    const char *message;
+} AssemblerError;
+
+#define ASSEMBLER_NO_SYMBOL UINT32_MAX
+#define ASSEMBLER_NO_FIXUP UINT32_MAX
+#define ASSEMBLER_TYPE_DATA 3 // instruction_types entry for a raw word stored by .word
+#define ASSEMBLER_TYPE_ADDRESS 4 // instruction_types entry for la: an addi whose immediate is its label's address
+
+// A reference to a label that was not yet defined when the instruction was added in one-pass mode.
+typedef struct {
+    uint32_t instruction;
+    uint32_t next; // next fixup for the same label, or the next free node once resolved
+    uint8_t type;
+} Fixup;
+
+// Instructions are stored as parallel arrays: the type, the encoded word (whose label-dependent bits
+// stay zero until assembler_generate_machine_code patches them in place) and an interned symbol ID.
+// In one-pass mode only machine_code is kept; references are patched as soon as their label is known
+// and the ones still waiting hang off their label's fixup chain.
+//
+// Statements after .data go to a separate byte buffer instead, which assembler_generate_machine_code
+// appends to the instructions, zero-padded to the largest .align, so the address of a .data label is its
+// byte offset in the finished image. References to .data labels are therefore resolved only once the
+// program is complete. Code must not run off its end, where it would reach the data.
 typedef struct {
-    Instruction *instructions;
+    uint8_t *instruction_types;
+    uint32_t *instruction_symbols;
     uint32_t instruction_count;
+    uint32_t instruction_capacity; // entries in instruction_types and instruction_symbols
     uint32_t *machine_code;
     uint32_t machine_code_size;
-    Label *labels;
-    uint32_t label_count;
+    uint32_t window_start; // index of the instruction in machine_code[0], moved only by assembler_discard
+    SymbolTable labels;
+    uint8_t *data;
+    uint32_t data_size;
+    uint32_t data_capacity;
+    uint32_t data_alignment; // largest .align in bytes
+    bool in_data;            // statements go to .data rather than .text
+    bool one_pass;
+    Fixup *fixups;
+    uint32_t fixup_capacity;
+    uint32_t fixup_count;
+    uint32_t free_fixup;
+    uint32_t pending_fixups;
+    uint32_t source_line;
+    uint32_t source_column;
+    AssemblerError *errors;
+    uint32_t error_count;
+    uint32_t error_capacity;
     InstructionValidateResult last_error;
     char error_message[256];
+    Arena arena; // every buffer above lives here
 } Assembler;
 
+// The result of assembler_assemble. Both buffers are heap allocated and released by assembly_output_free.
+typedef struct {
+    uint32_t *machine_code; // NULL unless assembly succeeded
+    uint32_t instruction_count;
+    AssemblerError *errors;
+    uint32_t error_count;
+} AssemblyOutput;
+
 Assembler *assembler_create();
 
 void assembler_destroy(Assembler *assembler);
 
+// Empties the assembler for another program, keeping its mode. The arena is rewound and the buffers are
+// carved again at the sizes they had grown to, so a reused assembler makes no allocator calls once one
+// program has needed as much as the next. Returns false when they could not be set up again, after which
+// the assembler can only be destroyed.
+bool assembler_reset(Assembler *assembler);
+
+// Allocator activity of the assembler's arena since it was created; the Assembler itself is one malloc more.
+ArenaStats assembler_arena_stats(const Assembler *assembler);
+
+bool assembler_set_one_pass(Assembler *assembler, bool one_pass);
+
+// Makes room for count instructions, discarded ones included, without further reallocation.
+bool assembler_reserve(Assembler *assembler, uint32_t count);
+
 InstructionValidateResult assembler_add_and_validate_instruction(Assembler *assembler, Instruction instruction);
 
+// The instruction_types entry an instruction is recorded under: its InstructionType, or ASSEMBLER_TYPE_ADDRESS
+// for a load or store whose offset is a label.
+uint8_t assembler_instruction_type(const Instruction *instruction);
+
+// Adds whatever follows the label on a lexed line: an instruction, the expansion of a pseudo-instruction
+// (pseudo.h), a section directive or data, or one of the linkage directives `.globl name...` and
+// `.extern name...`, which only matter when the program is written as an object.
+//
+// `.text` and `.data` switch sections; the program starts in .text. In .text, `.word value...` stores raw
+// instruction words. In .data:
+//   .word value...  .half value...  .byte value...   little-endian values, not aligned implicitly
+//   .space n                                         n zero bytes
+//   .align n                                         zero bytes up to a multiple of 2^n, n at most 12
+//   .incbin "path"                                   the file's bytes, mapped and copied in one go
+// lw/sw and friends take `label` or `label($base)` for a label's byte address as their offset, and la loads
+// it; either way it must fit the signed 16-bit immediate.
+InstructionValidateResult assembler_add_statement(Assembler *assembler, const SourceLine *line);
+
+// Where a label defined now points: the next instruction in .text, or SYMBOL_DATA plus the offset in .data.
+uint32_t assembler_location(const Assembler *assembler);
+
+// The address a label's instruction_line stands for: the instruction index itself, or for a .data label the
+// byte offset in the image once the data follows the instruction_count instructions.
+uint32_t assembler_label_address(const Assembler *assembler, uint32_t instruction_line);
+
+// What a reference of the given instruction_types kind to a label at instruction_line encodes: the address
+// above for branches and jumps, and a byte address for la and memory operands, so a .text label there is
+// its instruction index times 4. SYMBOL_UNDEFINED when that does not fit.
+uint32_t assembler_reference_target(const Assembler *assembler, uint8_t type, uint32_t instruction_line);
+
+// An image with a .data section ends in two words after it: the number of instructions, then this, so a
+// loader knows where code stops. Images without .data are the instructions alone, unless their last two
+// words would read as such a trailer, in which case one is added for them too. The listing carries the
+// same words, so a ROM loaded from it holds the trailer after the data and must stop fetching at the
+// instruction count rather than at the end of the image.
+#define ASSEMBLER_IMAGE_MAGIC 0x41544144u
+
+// Reads the trailer of an image of *count words: returns the number of instructions and leaves in *count
+// the words before the trailer, instructions and .data. Without a trailer every word is an instruction.
+uint32_t assembler_image_text_count(const uint32_t *image, uint32_t *count);
+
+// Resolves every reference and appends the .data section, padded to whole words, and the image trailer
+// above to machine_code; instruction_count then counts those words too. machine_code holds the
+// instructions from window_start on. Returns NULL after recording an error.
 uint32_t *assembler_generate_machine_code(Assembler *assembler);
 
+// Streaming in one-pass mode. assembler_settled_count tells how many words from the start of machine_code
+// wait on no label, so they are final and can be written out; assembler_discard then drops them. Only the
+// words from the oldest reference to a label not yet defined onwards, and always the last two, stay in
+// memory, next to the label table, the pending fixups and the .data section, whose references resolve only
+// at the end. It scans the fixup nodes, so call it once per batch of lines rather than per instruction.
+uint32_t assembler_settled_count(const Assembler *assembler);
+
+void assembler_discard(Assembler *assembler, uint32_t count);
+
+// Assembles a whole source buffer into an empty assembler in one-pass mode, resolving every label. On
+// success the words are in assembler->machine_code; otherwise the first error is returned and all of them
+// are in assembler->errors. Nothing here touches the filesystem or global state, so independent
+// assemblers can be used from any number of threads at once.
+InstructionValidateResult assembler_assemble_source(Assembler *assembler, const char *source, size_t size);
+
+// One-shot form of assembler_assemble_source for callers that only want the words and the errors.
+InstructionValidateResult assembler_assemble(const char *source, size_t size, AssemblyOutput *output);
+
+void assembly_output_free(AssemblyOutput *output);
+
 bool assembler_validate_instruction(const Instruction *instruction);
 
 InstructionValidateResult assembler_validate_r_type(const RTypeInstruction *r_instr);
 
-bool assembler_validate_i_type(const ITypeInstruction *i_instr);
+InstructionValidateResult assembler_validate_i_type(const ITypeInstruction *i_instr);
 
-bool assembler_validate_j_type(const JTypeInstruction *j_instr);
+InstructionValidateResult assembler_validate_j_type(const JTypeInstruction *j_instr);
 
 uint32_t r_type_to_machine_code(const RTypeInstruction *r_instr);
 
@@ -59,12 +194,28 @@ uint32_t i_type_to_machine_code(const ITypeInstruction *i_instr);
 
 uint32_t j_type_to_machine_code(const JTypeInstruction *j_instr);
 
+// Fills the label-dependent bits of an encoded word with target, as assembler_reference_target computes it.
+// Returns ASSEMBLER_ERROR_INVALID_OFFSET when target does not fit the field and, for a load or store,
+// ASSEMBLER_ERROR_MISALIGNED_ADDRESS when it is not a multiple of the access width.
+InstructionValidateResult assembler_patch_word(uint32_t *word, uint8_t type, uint32_t instruction, uint32_t target);
+
+// The static message for a reference of the given instruction_types kind that assembler_patch_word refused.
+const char *assembler_patch_message(uint8_t type, InstructionValidateResult result);
+
 const char *assembler_get_error_message(const Assembler *assembler);
 
+// Records an error at the current source location. Every error is kept in assembler->errors in the order
+// it was reported; last_error and error_message only describe the most recent one. message must be a
+// string with static storage duration.
 void assembler_set_error(Assembler *assembler, InstructionValidateResult error, const char *message);
 
+// Sets the source position that errors reported from now on are attributed to.
+void assembler_set_location(Assembler *assembler, uint32_t line, uint32_t column);
+
 bool assembler_add_label(Assembler *assembler, const char *name, uint32_t instruction_line);
 
+bool assembler_add_label_span(Assembler *assembler, const char *name, size_t length, uint32_t instruction_line);
+
 int32_t assembler_find_label(const Assembler *assembler, const char *name);
 
 bool is_label_line(const char *line);
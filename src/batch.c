@@ -0,0 +1,184 @@
+#define _POSIX_C_SOURCE 200809L
+#include "batch.h"
+#include "output.h"
+#include "source.h"
+#include "thread_pool.h"
+
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    Batch *batch;
+    Assembler **assemblers; // one per pool participant
+} BatchContext;
+
+void batch_init(Batch *batch) {
+    batch->jobs = NULL;
+    batch->count = 0;
+    batch->capacity = 0;
+}
+
+void batch_free(Batch *batch) {
+    for (uint32_t i = 0; i < batch->count; i++) {
+        free(batch->jobs[i].source_path);
+        free(batch->jobs[i].listing_path);
+        free(batch->jobs[i].binary_path);
+    }
+    free(batch->jobs);
+    batch_init(batch);
+}
+
+static char *replace_extension(const char *path, const char *extension) {
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    size_t stem = dot && (!slash || dot > slash) ? (size_t) (dot - path) : strlen(path);
+    char *result = malloc(stem + strlen(extension) + 1);
+    if (!result) return NULL;
+    memcpy(result, path, stem);
+    strcpy(result + stem, extension);
+    return result;
+}
+
+static bool batch_add_job(Batch *batch, const char *source, const char *listing, const char *binary) {
+    if (batch->count >= batch->capacity) {
+        uint32_t new_capacity = batch->capacity ? batch->capacity * 2 : 64;
+        BatchJob *new_jobs = realloc(batch->jobs, sizeof(BatchJob) * new_capacity);
+        if (!new_jobs) return false;
+        batch->jobs = new_jobs;
+        batch->capacity = new_capacity;
+    }
+
+    BatchJob *job = &batch->jobs[batch->count];
+    memset(job, 0, sizeof(*job));
+    job->source_path = strdup(source);
+    job->listing_path = listing ? strdup(listing) : replace_extension(source, ".txt");
+    job->binary_path = binary ? strdup(binary) : replace_extension(source, ".bin");
+    if (!job->source_path || !job->listing_path || !job->binary_path) {
+        free(job->source_path);
+        free(job->listing_path);
+        free(job->binary_path);
+        return false;
+    }
+    batch->count++;
+    return true;
+}
+
+bool batch_add_input(Batch *batch, const char *pattern) {
+    glob_t matches;
+    int status = glob(pattern, 0, NULL, &matches);
+    if (status == GLOB_NOMATCH) {
+        // Not a pattern, or one without matches: keep it so the summary reports the missing file.
+        return batch_add_job(batch, pattern, NULL, NULL);
+    }
+    if (status != 0) return false;
+
+    bool ok = true;
+    for (size_t i = 0; i < matches.gl_pathc && ok; i++) {
+        ok = batch_add_job(batch, matches.gl_pathv[i], NULL, NULL);
+    }
+    globfree(&matches);
+    return ok;
+}
+
+bool batch_add_manifest(Batch *batch, const char *path) {
+    FILE *manifest = fopen(path, "r");
+    if (!manifest) return false;
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    bool ok = true;
+    while (ok && getline(&line, &line_capacity, manifest) != -1) {
+        char *save;
+        char *source = strtok_r(line, " \t\r\n", &save);
+        if (!source || source[0] == '#') continue;
+        char *listing = strtok_r(NULL, " \t\r\n", &save);
+        char *binary = listing ? strtok_r(NULL, " \t\r\n", &save) : NULL;
+        ok = batch_add_job(batch, source, listing, binary);
+    }
+
+    free(line);
+    fclose(manifest);
+    return ok;
+}
+
+static bool write_outputs(const BatchJob *job, const Assembler *assembler) {
+    FILE *listing = fopen(job->listing_path, "w");
+    FILE *binary = fopen(job->binary_path, "wb");
+    bool ok = listing && binary;
+    ok = ok && output_write_listing(listing, assembler->machine_code, assembler->instruction_count);
+    ok = ok && output_write_binary(binary, assembler->machine_code, assembler->instruction_count);
+    if (listing) ok = fclose(listing) == 0 && ok;
+    if (binary) ok = fclose(binary) == 0 && ok;
+    return ok;
+}
+
+static void assemble_job(void *context, uint32_t worker, uint32_t index) {
+    BatchContext *batch_context = context;
+    BatchJob *job = &batch_context->batch->jobs[index];
+    Assembler *assembler = batch_context->assemblers[worker];
+    if (!assembler_reset(assembler)) {
+        job->failure = "failed to reset assembler";
+        return;
+    }
+
+    SourceFile source;
+    if (!source_open(job->source_path, &source)) {
+        job->failure = "failed to open assembly file";
+        return;
+    }
+
+    job->result = assembler_assemble_source(assembler, source.data, source.size);
+    source_close(&source);
+    job->error_count = assembler->error_count;
+    job->instruction_count = assembler->instruction_count;
+    if (assembler->error_count > 0) {
+        job->first_error = assembler->errors[0];
+    }
+
+    if (job->result == ASSEMBLER_SUCCESS && !write_outputs(job, assembler)) {
+        job->failure = "failed to write output files";
+    }
+}
+
+static bool job_failed(const BatchJob *job) {
+    return job->failure || job->result != ASSEMBLER_SUCCESS;
+}
+
+uint32_t batch_run(Batch *batch, uint32_t thread_count) {
+    if (batch->count == 0) return 0;
+    if (thread_count > batch->count) thread_count = batch->count;
+
+    ThreadPool *pool = thread_pool_create(thread_count);
+    if (!pool) {
+        for (uint32_t i = 0; i < batch->count; i++) batch->jobs[i].failure = "failed to create thread pool";
+        return batch->count;
+    }
+
+    uint32_t participants = thread_pool_size(pool);
+    BatchContext context = {batch, calloc(participants, sizeof(Assembler *))};
+    bool ready = context.assemblers != NULL;
+    for (uint32_t i = 0; ready && i < participants; i++) {
+        context.assemblers[i] = assembler_create();
+        ready = context.assemblers[i] != NULL;
+    }
+
+    if (ready) {
+        thread_pool_run(pool, batch->count, assemble_job, &context);
+    } else {
+        for (uint32_t i = 0; i < batch->count; i++) batch->jobs[i].failure = "failed to create assembler";
+    }
+
+    if (context.assemblers) {
+        for (uint32_t i = 0; i < participants; i++) assembler_destroy(context.assemblers[i]);
+        free(context.assemblers);
+    }
+    thread_pool_destroy(pool);
+
+    uint32_t failures = 0;
+    for (uint32_t i = 0; i < batch->count; i++) {
+        if (job_failed(&batch->jobs[i])) failures++;
+    }
+    return failures;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "assembler.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// One input and where its listing and binary image go.
+typedef struct {
+    char *source_path;
+    char *listing_path;
+    char *binary_path;
+
+    InstructionValidateResult result;
+    const char *failure; // set when the file could not be read or written
+    AssemblerError first_error;
+    uint32_t error_count;
+    uint32_t instruction_count;
+} BatchJob;
+
+typedef struct {
+    BatchJob *jobs;
+    uint32_t count;
+    uint32_t capacity;
+} Batch;
+
+void batch_init(Batch *batch);
+
+void batch_free(Batch *batch);
+
+// Adds a path, or every match of a glob pattern. Outputs default to the input path with its extension
+// replaced by .txt and .bin.
+bool batch_add_input(Batch *batch, const char *pattern);
+
+// Reads a manifest with one input per line, optionally followed by explicit listing and binary paths.
+// Blank lines and lines starting with # are skipped.
+bool batch_add_manifest(Batch *batch, const char *path);
+
+// Assembles every job on thread_count threads, each of which reuses a single Assembler. Returns the
+// number of jobs that failed.
+uint32_t batch_run(Batch *batch, uint32_t thread_count);
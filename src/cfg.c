@@ -0,0 +1,176 @@
+#include "cfg.h"
+#include "isa.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+ControlKind cfg_control(const Assembler *assembler, uint32_t instruction) {
+    if (assembler->instruction_types[instruction] == ASSEMBLER_TYPE_DATA) return CONTROL_NONE;
+
+    uint32_t word = assembler->machine_code[instruction];
+    const InstructionDef *def = decode_instruction(word);
+    if (!def) return CONTROL_NONE;
+
+    uint32_t rs = (word >> 21) & 0x1F;
+    uint32_t rt = (word >> 16) & 0x1F;
+    switch (def->format) {
+        case OPERANDS_BRANCH:
+            switch (def->opcode) {
+                case OPCODE_BEQ:
+                    return rs == rt ? CONTROL_JUMP : CONTROL_BRANCH;
+                case OPCODE_BNEQ:
+                case OPCODE_BLT:
+                case OPCODE_BGT:
+                    return rs == rt ? CONTROL_NEVER_TAKEN : CONTROL_BRANCH;
+                case OPCODE_BLTZ:
+                case OPCODE_BGTZ:
+                    return rs == 0 ? CONTROL_NEVER_TAKEN : CONTROL_BRANCH;
+                default:
+                    return CONTROL_BRANCH;
+            }
+        case OPERANDS_JUMP:
+            return def->opcode == OPCODE_JAL ? CONTROL_CALL : CONTROL_JUMP;
+        case OPERANDS_REGISTER:
+            return def->funct == FUNCT_JR ? CONTROL_INDIRECT : CONTROL_NONE;
+        default:
+            return CONTROL_NONE;
+    }
+}
+
+uint32_t cfg_target(const Assembler *assembler, uint32_t instruction) {
+    uint32_t count = assembler->instruction_count;
+    uint32_t symbol = assembler->instruction_symbols[instruction];
+    if (symbol != ASSEMBLER_NO_SYMBOL) {
+        uint32_t line = assembler->labels.labels[symbol].instruction_line;
+        return line <= count ? line : CFG_NONE;
+    }
+
+    uint32_t word = assembler->machine_code[instruction];
+    const InstructionDef *def = decode_instruction(word);
+    if (def && def->format == OPERANDS_BRANCH) {
+        int64_t target = (int64_t) instruction + 1 + (int16_t) (word & 0xFFFF);
+        return target >= 0 && target <= count ? (uint32_t) target : CFG_NONE;
+    }
+    if (def && def->format == OPERANDS_JUMP) {
+        uint32_t target = word & 0x3FFFFFF;
+        return target <= count ? target : CFG_NONE;
+    }
+    return CFG_NONE;
+}
+
+static void add_edge(ControlFlowGraph *cfg, uint32_t block) {
+    if (block != CFG_NONE) cfg->blocks[block].predecessors++;
+}
+
+bool cfg_build(ControlFlowGraph *cfg, const Assembler *assembler) {
+    memset(cfg, 0, sizeof(*cfg));
+    uint32_t count = assembler->instruction_count;
+    cfg->block_of = calloc((size_t) count + 1, sizeof(uint32_t));
+    if (!cfg->block_of) return false;
+
+    // Leaders are marked in block_of first, then replaced by block numbers.
+    uint32_t *leaders = cfg->block_of;
+    leaders[0] = 1;
+    for (uint32_t symbol = 0; symbol < assembler->labels.label_count; symbol++) {
+        uint32_t line = assembler->labels.labels[symbol].instruction_line;
+        if (line <= count) leaders[line] = 1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (cfg_control(assembler, i) == CONTROL_NONE) continue;
+        leaders[i + 1] = 1;
+        uint32_t target = cfg_target(assembler, i);
+        if (target != CFG_NONE) leaders[target] = 1;
+    }
+
+    uint32_t block_count = 0;
+    for (uint32_t i = 0; i < count; i++) block_count += leaders[i];
+    cfg->blocks = calloc((size_t) block_count + 1, sizeof(BasicBlock));
+    if (!cfg->blocks) {
+        cfg_free(cfg);
+        return false;
+    }
+    cfg->block_count = block_count;
+
+    uint32_t block = UINT32_MAX;
+    for (uint32_t i = 0; i < count; i++) {
+        if (leaders[i]) {
+            block++;
+            cfg->blocks[block].start = i;
+        }
+        cfg->blocks[block].end = i + 1;
+        cfg->block_of[i] = block;
+    }
+    cfg->block_of[count] = block_count;
+    cfg->blocks[block_count] = (BasicBlock) {.start = count, .end = count, .taken = CFG_NONE, .fallthrough = CFG_NONE};
+
+    for (uint32_t b = 0; b < block_count; b++) {
+        BasicBlock *current = &cfg->blocks[b];
+        uint32_t last = current->end - 1;
+        current->control = cfg_control(assembler, last);
+        current->taken = CFG_NONE;
+        current->fallthrough = b + 1;
+        if (current->control == CONTROL_BRANCH || current->control == CONTROL_JUMP ||
+            current->control == CONTROL_CALL) {
+            uint32_t target = cfg_target(assembler, last);
+            if (target != CFG_NONE) current->taken = cfg->block_of[target];
+        }
+        if (current->control == CONTROL_JUMP || current->control == CONTROL_INDIRECT) {
+            current->fallthrough = CFG_NONE;
+        }
+        for (uint32_t i = current->start; i < current->end; i++) {
+            if (assembler->instruction_types[i] == ASSEMBLER_TYPE_DATA) current->root = true;
+        }
+    }
+    // A label whose address la takes may be reached by jr.
+    for (uint32_t i = 0; i < count; i++) {
+        if (assembler->instruction_types[i] != ASSEMBLER_TYPE_ADDRESS) continue;
+        uint32_t line = assembler->labels.labels[assembler->instruction_symbols[i]].instruction_line;
+        if (line < count) cfg->blocks[cfg->block_of[line]].root = true;
+    }
+    for (uint32_t b = 0; b < block_count; b++) {
+        add_edge(cfg, cfg->blocks[b].taken);
+        add_edge(cfg, cfg->blocks[b].fallthrough);
+    }
+
+    if (block_count > 0) cfg->blocks[0].root = true;
+    for (uint32_t symbol = 0; symbol < assembler->labels.label_count; symbol++) {
+        const Label *label = &assembler->labels.labels[symbol];
+        if ((label->flags & SYMBOL_GLOBAL) && label->instruction_line <= count) {
+            cfg->blocks[cfg->block_of[label->instruction_line]].root = true;
+        }
+    }
+    return true;
+}
+
+void cfg_free(ControlFlowGraph *cfg) {
+    if (!cfg) return;
+    free(cfg->blocks);
+    free(cfg->block_of);
+    memset(cfg, 0, sizeof(*cfg));
+}
+
+bool cfg_mark_reachable(const ControlFlowGraph *cfg, bool *reachable) {
+    uint32_t *stack = malloc(sizeof(uint32_t) * ((size_t) cfg->block_count + 1));
+    if (!stack) return false;
+
+    memset(reachable, 0, sizeof(bool) * ((size_t) cfg->block_count + 1));
+    uint32_t depth = 0;
+    for (uint32_t b = 0; b < cfg->block_count; b++) {
+        if (cfg->blocks[b].root) {
+            reachable[b] = true;
+            stack[depth++] = b;
+        }
+    }
+    while (depth > 0) {
+        const BasicBlock *block = &cfg->blocks[stack[--depth]];
+        uint32_t successors[2] = {block->taken, block->fallthrough};
+        for (int s = 0; s < 2; s++) {
+            uint32_t next = successors[s];
+            if (next == CFG_NONE || reachable[next]) continue;
+            reachable[next] = true;
+            if (next < cfg->block_count) stack[depth++] = next;
+        }
+    }
+    free(stack);
+    return true;
+}
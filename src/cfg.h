@@ -0,0 +1,51 @@
+#pragma once
+#include "assembler.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CFG_NONE UINT32_MAX
+
+// How control leaves an instruction. beq with the same register twice always branches and is treated as
+// a jump; bneq, blt and bgt with the same register twice, and bltz/bgtz on $zero, never branch.
+typedef enum {
+    CONTROL_NONE,        // an ordinary instruction, or a .word
+    CONTROL_BRANCH,      // conditional: to the target or to the next instruction
+    CONTROL_NEVER_TAKEN, // a branch whose condition can never hold
+    CONTROL_JUMP,        // unconditional, to the target only
+    CONTROL_CALL,        // jal: to the target, returning to the next instruction
+    CONTROL_INDIRECT,    // jr: no target known before run time
+} ControlKind;
+
+typedef struct {
+    uint32_t start;       // first instruction
+    uint32_t end;         // one past the last instruction
+    ControlKind control;  // how the last instruction leaves the block
+    uint32_t taken;       // block the last instruction branches or jumps to, CFG_NONE when unknown
+    uint32_t fallthrough; // block reached by running off the end, CFG_NONE when control cannot
+    uint32_t predecessors;
+    bool root;            // entered from outside: instruction 0, a .globl or la label, or holding .word values
+} BasicBlock;
+
+// Basic blocks of a two-pass assembler's program in program order. Blocks start at instruction 0, at every
+// label and numeric target, and after every branch or jump. blocks[block_count] is an empty exit block at
+// instruction_count that running off the end or jumping just past the program reaches.
+typedef struct {
+    BasicBlock *blocks;
+    uint32_t block_count;
+    uint32_t *block_of; // instruction -> block, with block_of[instruction_count] == block_count
+} ControlFlowGraph;
+
+ControlKind cfg_control(const Assembler *assembler, uint32_t instruction);
+
+// The instruction a branch or jump goes to once labels are resolved: its label's line, or the numeric
+// offset or address. CFG_NONE when the label is undefined or the target lies outside the program.
+uint32_t cfg_target(const Assembler *assembler, uint32_t instruction);
+
+bool cfg_build(ControlFlowGraph *cfg, const Assembler *assembler);
+
+void cfg_free(ControlFlowGraph *cfg);
+
+// Marks every block reachable from a root by following taken and fall-through edges. reachable needs
+// block_count + 1 entries; the exit block is included. Returns false when out of memory.
+bool cfg_mark_reachable(const ControlFlowGraph *cfg, bool *reachable);
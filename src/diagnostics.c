@@ -0,0 +1,39 @@
+#include "diagnostics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static DiagnosticLevel current_level = DIAGNOSTIC_INFO;
+static bool all_to_stderr = false;
+
+static const char *const level_prefixes[] = {
+    [DIAGNOSTIC_ERROR] = "error: ",
+    [DIAGNOSTIC_WARN] = "warning: ",
+    [DIAGNOSTIC_INFO] = "",
+    [DIAGNOSTIC_TRACE] = "trace: ",
+};
+
+void diagnostics_set_level(DiagnosticLevel level) {
+    current_level = level;
+}
+
+DiagnosticLevel diagnostics_level(void) {
+    return current_level;
+}
+
+void diagnostics_use_stderr(void) {
+    all_to_stderr = true;
+}
+
+void diagnostics_print(DiagnosticLevel level, const char *format, ...) {
+    if (level > current_level) return;
+
+    FILE *stream = all_to_stderr || level <= DIAGNOSTIC_WARN ? stderr : stdout;
+    fputs(level_prefixes[level], stream);
+
+    va_list arguments;
+    va_start(arguments, format);
+    vfprintf(stream, format, arguments);
+    va_end(arguments);
+    fputc('\n', stream);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdbool.h>
+
+typedef enum {
+    DIAGNOSTIC_ERROR = 0,
+    DIAGNOSTIC_WARN,
+    DIAGNOSTIC_INFO,
+    DIAGNOSTIC_TRACE,
+} DiagnosticLevel;
+
+// Messages above the current level are dropped before their arguments are evaluated. Errors and warnings
+// go to stderr, everything else to stdout. The default level is DIAGNOSTIC_INFO.
+void diagnostics_set_level(DiagnosticLevel level);
+
+DiagnosticLevel diagnostics_level(void);
+
+// Sends every message to stderr from now on, for modes where stdout carries the output itself.
+void diagnostics_use_stderr(void);
+
+void diagnostics_print(DiagnosticLevel level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#define DIAGNOSTIC(level, ...) \
+    do { \
+        if (diagnostics_level() >= (level)) diagnostics_print((level), __VA_ARGS__); \
+    } while (0)
+
+#define diag_error(...) DIAGNOSTIC(DIAGNOSTIC_ERROR, __VA_ARGS__)
+#define diag_warn(...) DIAGNOSTIC(DIAGNOSTIC_WARN, __VA_ARGS__)
+#define diag_info(...) DIAGNOSTIC(DIAGNOSTIC_INFO, __VA_ARGS__)
+
+// Per-line tracing only exists in builds that define ASSEMBLER_ENABLE_TRACE (Debug); elsewhere the calls
+// and their arguments compile to nothing.
+#ifdef ASSEMBLER_ENABLE_TRACE
+#define diag_trace(...) DIAGNOSTIC(DIAGNOSTIC_TRACE, __VA_ARGS__)
+#else
+#define diag_trace(...) ((void) 0)
+#endif
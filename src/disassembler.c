@@ -0,0 +1,276 @@
+#include "disassembler.h"
+#include "assembler.h"
+#include "instruction.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LINES_PER_FLUSH 4096
+#define MAX_LINE_LENGTH 96 // a label line followed by the longest instruction line, with memcpy slack
+#define BUFFER_SIZE (LINES_PER_FLUSH * MAX_LINE_LENGTH)
+
+typedef struct {
+    char text[8];
+    uint32_t length;
+} Name;
+
+// The spelling parse_register accepts for each register number; unnamed registers have length 0. $r14
+// and $r15 are the same registers as $s0 and $s1, which are the names used here.
+static const Name register_names[32] = {
+    [0] = {"$zero", 5}, [1] = {"$v0", 3},  [2] = {"$v1", 3},  [3] = {"$a0", 3},  [4] = {"$a1", 3},
+    [5] = {"$a2", 3},   [6] = {"$a3", 3},  [7] = {"$a4", 3},  [9] = {"$r0", 3},  [10] = {"$r1", 3},
+    [11] = {"$r2", 3},  [12] = {"$r3", 3}, [13] = {"$r4", 3}, [14] = {"$r5", 3}, [15] = {"$r6", 3},
+    [16] = {"$r7", 3},  [17] = {"$r8", 3}, [18] = {"$r9", 3}, [19] = {"$r10", 4}, [20] = {"$r11", 4},
+    [21] = {"$r12", 4}, [22] = {"$r13", 4}, [23] = {"$s0", 3}, [24] = {"$s1", 3}, [25] = {"$s2", 3},
+    [26] = {"$s3", 3},  [27] = {"$s4", 3}, [29] = {"$sp", 3}, [31] = {"$ra", 3},
+};
+
+static const char hex_digits[16] = "0123456789abcdef";
+
+static const char digit_pairs[200] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                                     "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                                     "8081828384858687888990919293949596979899";
+
+// Register fields must name a register for the line to parse back; bit n is set when register n has a name.
+#define NAMED_REGISTERS 0xAFFFFEFFu
+
+// The indented mnemonic and the operand format for one opcode or funct value.
+typedef struct {
+    char text[15];
+    uint8_t length;
+    uint8_t width;
+    OperandFormat format;
+} Form;
+
+// Rows 0-63 are indexed by opcode and rows 64-127 by funct for opcode 0.
+typedef struct {
+    Form rows[128];
+    uint32_t label_digits; // every label has this many hex digits, enough for the instruction count
+} FormTable;
+
+static uint32_t decimal_length(uint32_t value) {
+    uint32_t length = 1;
+    for (uint32_t bound = 10; length < 10 && value >= bound; bound *= 10) length++;
+    return length;
+}
+
+// Digits are written backwards straight into the output, two at a time.
+static char *put_unsigned(char *p, uint32_t value) {
+    char *end = p + decimal_length(value);
+    char *q = end;
+    while (value >= 100) {
+        q -= 2;
+        memcpy(q, &digit_pairs[2 * (value % 100)], 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        memcpy(q - 2, &digit_pairs[2 * value], 2);
+    } else {
+        q[-1] = (char) ('0' + value);
+    }
+    return end;
+}
+
+// Immediates are written as a sign and four hex digits; the sign is stored unconditionally and kept only
+// for negative values, so mixed code does not mispredict on it.
+static char *put_immediate(char *p, int16_t value) {
+    uint32_t negative = value < 0;
+    uint32_t magnitude = (uint32_t) (negative ? -(int32_t) value : value);
+    p[0] = '-';
+    p += negative;
+    memcpy(p, "0x", 2);
+    p[2] = hex_digits[(magnitude >> 12) & 0xF];
+    p[3] = hex_digits[(magnitude >> 8) & 0xF];
+    p[4] = hex_digits[(magnitude >> 4) & 0xF];
+    p[5] = hex_digits[magnitude & 0xF];
+    return p + 6;
+}
+
+static char *put_register(char *p, uint32_t reg) {
+    memcpy(p, register_names[reg].text, sizeof(register_names[reg].text));
+    return p + register_names[reg].length;
+}
+
+static char *put_separator(char *p) {
+    p[0] = ',';
+    p[1] = ' ';
+    return p + 2;
+}
+
+// Labels are L followed by the target index in fixed-width hex, which needs no division.
+static char *put_label(char *p, const FormTable *forms, uint32_t index) {
+    *p++ = 'L';
+    for (uint32_t k = forms->label_digits; k-- > 0; index >>= 4) p[k] = hex_digits[index & 0xF];
+    return p + forms->label_digits;
+}
+
+static char *put_label_definition(char *p, const FormTable *forms, uint32_t index) {
+    p = put_label(p, forms, index);
+    p[0] = ':';
+    p[1] = '\n';
+    return p + 2;
+}
+
+static char *put_word(char *p, uint32_t word) {
+    memcpy(p, "    .word 0x", 12);
+    p += 12;
+    for (int shift = 28; shift >= 0; shift -= 4) *p++ = hex_digits[(word >> shift) & 0xF];
+    *p++ = '\n';
+    return p;
+}
+
+// The instruction index a branch or jump refers to, or UINT32_MAX when it is not a label in the program.
+static uint32_t target_of(OperandFormat format, uint32_t word, uint32_t index, uint32_t count) {
+    if (format == OPERANDS_BRANCH) {
+        int64_t target = (int64_t) index + 1 + (int16_t) (word & 0xFFFF);
+        return target >= 0 && target <= count ? (uint32_t) target : UINT32_MAX;
+    }
+    if (format == OPERANDS_JUMP) {
+        uint32_t address = word & 0x3FFFFFF;
+        return address <= count ? address : UINT32_MAX;
+    }
+    return UINT32_MAX;
+}
+
+// Built from decode_instruction so the hot loop indexes a flat table and copies each mnemonic with one
+// fixed-size memcpy. Forms with length 0 decode to no instruction.
+static void build_forms(FormTable *forms) {
+    memset(forms, 0, sizeof(*forms));
+    for (uint32_t row = 1; row < 128; row++) {
+        const InstructionDef *def = decode_instruction(row < 64 ? row << 26 : row - 64);
+        if (!def) continue;
+        Form *form = &forms->rows[row];
+        size_t length = strlen(def->name);
+        memcpy(form->text, "    ", 4);
+        memcpy(form->text + 4, def->name, length);
+        form->text[4 + length] = ' ';
+        form->length = (uint8_t) (length + 5);
+        form->width = def->width;
+        form->format = def->format;
+    }
+}
+
+static char *put_mnemonic(char *p, const Form *form) {
+    memcpy(p, form->text, sizeof(form->text));
+    return p + form->length;
+}
+
+static const Form *form_of(const FormTable *forms, uint32_t word) {
+    uint32_t opcode = word >> 26;
+    uint32_t row = opcode ? opcode : 64 + (word & 0x3F);
+    return &forms->rows[row];
+}
+
+// Writes one instruction line in the operand order parse_source_line expects, or a .word line when the
+// word is not something the assembler could have produced from source. Each case checks its fields
+// before writing anything so the buffer never has to be rewound.
+static char *put_instruction(char *p, const FormTable *forms, uint32_t word, uint32_t index, uint32_t count) {
+    const Form *form = form_of(forms, word);
+    uint32_t rs = (word >> 21) & 0x1F;
+    uint32_t rt = (word >> 16) & 0x1F;
+    uint32_t rd = (word >> 11) & 0x1F;
+    int16_t immediate = (int16_t) (word & 0xFFFF);
+    uint32_t named = NAMED_REGISTERS >> rs & NAMED_REGISTERS >> rt & 1;
+    uint32_t target;
+
+    if (form->length == 0) return put_word(p, word);
+    switch (form->format) {
+        case OPERANDS_REGISTER:
+            if (((word >> 6) & 0x1F) != 0 || !(named & NAMED_REGISTERS >> rd)) return put_word(p, word);
+            p = put_mnemonic(p, form);
+            p = put_separator(put_register(p, rd));
+            p = put_separator(put_register(p, rs));
+            p = put_register(p, rt);
+            break;
+        case OPERANDS_IMMEDIATE:
+            if (!named) return put_word(p, word);
+            p = put_mnemonic(p, form);
+            p = put_separator(put_register(p, rt));
+            p = put_separator(put_register(p, rs));
+            p = put_immediate(p, immediate);
+            break;
+        case OPERANDS_MEMORY:
+            if (!named || immediate % form->width != 0) return put_word(p, word);
+            p = put_mnemonic(p, form);
+            p = put_separator(put_register(p, rt));
+            p = put_immediate(p, immediate);
+            *p++ = '(';
+            p = put_register(p, rs);
+            *p++ = ')';
+            break;
+        case OPERANDS_BRANCH:
+            target = target_of(OPERANDS_BRANCH, word, index, count);
+            if (!named || target == UINT32_MAX) return put_word(p, word);
+            p = put_mnemonic(p, form);
+            p = put_separator(put_register(p, rs));
+            p = put_separator(put_register(p, rt));
+            p = put_label(p, forms, target);
+            break;
+        case OPERANDS_JUMP:
+            target = target_of(OPERANDS_JUMP, word, index, count);
+            p = put_mnemonic(p, form);
+            p = target != UINT32_MAX ? put_label(p, forms, target) : put_unsigned(p, word & 0x3FFFFFF);
+            break;
+    }
+    *p++ = '\n';
+    return p;
+}
+
+bool disassembler_write(FILE *stream, const uint32_t *machine_code, uint32_t count) {
+    uint32_t data_end = count;
+    count = assembler_image_text_count(machine_code, &data_end);
+    // One bit per instruction index, plus one for a label just past the last instruction.
+    uint64_t *targets = calloc((size_t) count / 64 + 2, sizeof(uint64_t));
+    char *buffer = malloc(BUFFER_SIZE);
+    if (!targets || !buffer) {
+        free(targets);
+        free(buffer);
+        return false;
+    }
+
+    FormTable forms;
+    build_forms(&forms);
+    forms.label_digits = 1;
+    while (forms.label_digits < 8 && count >> (4 * forms.label_digits)) forms.label_digits++;
+    // Branch-free: words that do not name a label set a bit in the spare word past the end instead.
+    uint32_t spare = (count / 64 + 1) * 64;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t word = machine_code[i];
+        const Form *form = form_of(&forms, word);
+        uint64_t branch = (uint64_t) ((int64_t) i + 1 + (int16_t) (word & 0xFFFF));
+        uint64_t target = form->format == OPERANDS_BRANCH ? branch : word & 0x3FFFFFF;
+        bool labeled = form->length && (form->format == OPERANDS_BRANCH || form->format == OPERANDS_JUMP);
+        uint32_t bit = labeled && target <= count ? (uint32_t) target : spare;
+        targets[bit / 64] |= 1ull << (bit % 64);
+    }
+
+    bool ok = true;
+    for (uint32_t start = 0; start < count && ok; start += LINES_PER_FLUSH) {
+        uint32_t end = count - start > LINES_PER_FLUSH ? start + LINES_PER_FLUSH : count;
+        char *p = buffer;
+        for (uint32_t i = start; i < end; i++) {
+            if (targets[i / 64] & (1ull << (i % 64))) p = put_label_definition(p, &forms, i);
+            p = put_instruction(p, &forms, machine_code[i], i, count);
+        }
+        size_t size = (size_t) (p - buffer);
+        ok = fwrite(buffer, 1, size, stream) == size;
+    }
+    if (ok && (targets[count / 64] & (1ull << (count % 64)))) {
+        size_t size = (size_t) (put_label_definition(buffer, &forms, count) - buffer);
+        ok = fwrite(buffer, 1, size, stream) == size;
+    }
+    // The words between the instructions and the trailer, alignment padding included, as one .data section
+    // that starts right after the instructions again.
+    if (ok && data_end > count) ok = fputs("    .data\n", stream) != EOF;
+    for (uint32_t start = count; start < data_end && ok; start += LINES_PER_FLUSH) {
+        uint32_t end = data_end - start > LINES_PER_FLUSH ? start + LINES_PER_FLUSH : data_end;
+        char *p = buffer;
+        for (uint32_t i = start; i < end; i++) p = put_word(p, machine_code[i]);
+        size_t size = (size_t) (p - buffer);
+        ok = fwrite(buffer, 1, size, stream) == size;
+    }
+
+    free(targets);
+    free(buffer);
+    return ok;
+}
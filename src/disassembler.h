@@ -0,0 +1,11 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Writes assembly source that assembles back to exactly these words. Branch and jump targets inside the
+// program get synthetic labels named L<instruction index in hex>; a jump past the end keeps its numeric
+// address, and words that no instruction encodes to are written as .word. When the image ends in the
+// trailer described at ASSEMBLER_IMAGE_MAGIC, the words after the instructions it counts are written as a
+// .data section of .word lines, and the trailer is left for the assembler to add again.
+bool disassembler_write(FILE *stream, const uint32_t *machine_code, uint32_t count);
@@ -0,0 +1,396 @@
+#include "encoder.h"
+#include "assembler.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ENCODER_X86 1
+#include <immintrin.h>
+#endif
+
+// The scalar kernels double as the tail loop of the vector kernels and as the slow path that pinpoints
+// the first invalid instruction once a vector block fails validation.
+static size_t encode_r_scalar(const RTypeBatch *batch, size_t start, size_t count, uint32_t *out) {
+    for (size_t i = start; i < count; i++) {
+        RTypeInstruction r_instr = {batch->opcode[i], batch->rs[i], batch->rt[i],
+                                    batch->rd[i], batch->shamt[i], batch->funct[i]};
+        if (assembler_validate_r_type(&r_instr) != ASSEMBLER_SUCCESS) return i;
+        out[i] = r_type_to_machine_code(&r_instr);
+    }
+    return count;
+}
+
+static size_t encode_i_scalar(const ITypeBatch *batch, size_t start, size_t count, uint32_t *out) {
+    for (size_t i = start; i < count; i++) {
+        ITypeInstruction i_instr = {batch->opcode[i], batch->rs[i], batch->rt[i], batch->immediate[i]};
+        if (assembler_validate_i_type(&i_instr) != ASSEMBLER_SUCCESS) return i;
+        out[i] = i_type_to_machine_code(&i_instr);
+    }
+    return count;
+}
+
+static size_t encode_j_scalar(const JTypeBatch *batch, size_t start, size_t count, uint32_t *out) {
+    for (size_t i = start; i < count; i++) {
+        JTypeInstruction j_instr = {batch->opcode[i], batch->address[i]};
+        if (assembler_validate_j_type(&j_instr) != ASSEMBLER_SUCCESS) return i;
+        out[i] = j_type_to_machine_code(&j_instr);
+    }
+    return count;
+}
+
+#ifdef ENCODER_X86
+
+// The vector kernels check field widths in registers and compare each block against every row isa.h
+// defines: R-type functs, I- and J-type opcodes, and the offset bits a memory row's width must leave clear.
+#define ENCODER_FUNCT(NAME, name, funct) funct,
+#define ENCODER_I_OPCODE(NAME, name, format, opcode, width) opcode,
+#define ENCODER_I_ALIGNMENT(NAME, name, format, opcode, width) width - 1,
+#define ENCODER_J_OPCODE(NAME, name, opcode) opcode,
+#define ENCODER_WIDTH_CHECK(NAME, name, format, opcode, width) \
+    _Static_assert(((width) & ((width) - 1)) == 0, "the vector kernels test " name "'s alignment with a mask");
+
+static const uint8_t r_functs[] = {ISA_INSTRUCTIONS(ENCODER_FUNCT, ISA_IGNORE_I, ISA_IGNORE_J)};
+static const uint8_t i_opcodes[] = {ISA_INSTRUCTIONS(ISA_IGNORE_R, ENCODER_I_OPCODE, ISA_IGNORE_J)};
+static const uint8_t i_alignments[] = {ISA_INSTRUCTIONS(ISA_IGNORE_R, ENCODER_I_ALIGNMENT, ISA_IGNORE_J)};
+static const uint8_t j_opcodes[] = {ISA_INSTRUCTIONS(ISA_IGNORE_R, ISA_IGNORE_I, ENCODER_J_OPCODE)};
+ISA_INSTRUCTIONS(ISA_IGNORE_R, ENCODER_WIDTH_CHECK, ISA_IGNORE_J)
+
+// Lanes whose byte equals one of values come out as 0xFF, the others as 0.
+__attribute__((target("sse2")))
+static inline __m128i match_any_sse2(__m128i bytes, const uint8_t *values, size_t count) {
+    __m128i found = _mm_setzero_si128();
+    for (size_t k = 0; k < count; k++) {
+        found = _mm_or_si128(found, _mm_cmpeq_epi8(bytes, _mm_set1_epi8((char) values[k])));
+    }
+    return found;
+}
+
+// The offset bits of eight I-type instructions, opcodes widened to 16 bits, that their rows need clear.
+__attribute__((target("sse2")))
+static inline __m128i misaligned_sse2(__m128i opcode, __m128i immediate) {
+    __m128i mask = _mm_setzero_si128();
+    for (size_t k = 0; k < sizeof(i_opcodes); k++) {
+        if (i_alignments[k] == 0) continue;
+        __m128i row = _mm_cmpeq_epi16(opcode, _mm_set1_epi16(i_opcodes[k]));
+        mask = _mm_or_si128(mask, _mm_and_si128(row, _mm_set1_epi16(i_alignments[k])));
+    }
+    return _mm_and_si128(immediate, mask);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i match_any_avx2(__m256i bytes, const uint8_t *values, size_t count) {
+    __m256i found = _mm256_setzero_si256();
+    for (size_t k = 0; k < count; k++) {
+        found = _mm256_or_si256(found, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8((char) values[k])));
+    }
+    return found;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i misaligned_avx2(__m256i opcode, __m256i immediate) {
+    __m256i mask = _mm256_setzero_si256();
+    for (size_t k = 0; k < sizeof(i_opcodes); k++) {
+        if (i_alignments[k] == 0) continue;
+        __m256i row = _mm256_cmpeq_epi16(opcode, _mm256_set1_epi16(i_opcodes[k]));
+        mask = _mm256_or_si256(mask, _mm256_and_si256(row, _mm256_set1_epi16(i_alignments[k])));
+    }
+    return _mm256_and_si256(immediate, mask);
+}
+
+// R- and I-type words are built as two 16-bit halves: high = opcode << 10 | rs << 5 | rt, and low holds
+// either rd << 11 | shamt << 6 | funct or the immediate. Interleaving the halves yields the 32-bit words.
+
+__attribute__((target("sse2")))
+static inline void store_halves_sse2(__m128i low, __m128i high, uint32_t *out) {
+    _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi16(low, high));
+    _mm_storeu_si128((__m128i *) (out + 4), _mm_unpackhi_epi16(low, high));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i high_half_sse2(__m128i opcode, __m128i rs, __m128i rt) {
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi16(opcode, 10), _mm_slli_epi16(rs, 5)), rt);
+}
+
+__attribute__((target("sse2")))
+static size_t encode_r_sse2(const RTypeBatch *batch, size_t count, uint32_t *out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i register_bits = _mm_set1_epi8((char) 0xE0);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i opcode = _mm_loadu_si128((const __m128i *) (batch->opcode + i));
+        __m128i rs = _mm_loadu_si128((const __m128i *) (batch->rs + i));
+        __m128i rt = _mm_loadu_si128((const __m128i *) (batch->rt + i));
+        __m128i rd = _mm_loadu_si128((const __m128i *) (batch->rd + i));
+        __m128i shamt = _mm_loadu_si128((const __m128i *) (batch->shamt + i));
+        __m128i funct = _mm_loadu_si128((const __m128i *) (batch->funct + i));
+
+        // Every R-type row has opcode 0.
+        __m128i invalid = _mm_and_si128(_mm_or_si128(_mm_or_si128(rs, rt), _mm_or_si128(rd, shamt)), register_bits);
+        invalid = _mm_or_si128(invalid, opcode);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, zero)) != 0xFFFF ||
+            _mm_movemask_epi8(match_any_sse2(funct, r_functs, sizeof(r_functs))) != 0xFFFF) {
+            return encode_r_scalar(batch, i, count, out);
+        }
+
+        __m128i high = high_half_sse2(_mm_unpacklo_epi8(opcode, zero), _mm_unpacklo_epi8(rs, zero),
+                                      _mm_unpacklo_epi8(rt, zero));
+        __m128i low = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_unpacklo_epi8(rd, zero), 11),
+                                                _mm_slli_epi16(_mm_unpacklo_epi8(shamt, zero), 6)),
+                                   _mm_unpacklo_epi8(funct, zero));
+        store_halves_sse2(low, high, out + i);
+
+        high = high_half_sse2(_mm_unpackhi_epi8(opcode, zero), _mm_unpackhi_epi8(rs, zero),
+                              _mm_unpackhi_epi8(rt, zero));
+        low = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(_mm_unpackhi_epi8(rd, zero), 11),
+                                        _mm_slli_epi16(_mm_unpackhi_epi8(shamt, zero), 6)),
+                           _mm_unpackhi_epi8(funct, zero));
+        store_halves_sse2(low, high, out + i + 8);
+    }
+    return encode_r_scalar(batch, i, count, out);
+}
+
+__attribute__((target("sse2")))
+static size_t encode_i_sse2(const ITypeBatch *batch, size_t count, uint32_t *out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i register_bits = _mm_set1_epi8((char) 0xE0);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i opcode = _mm_loadu_si128((const __m128i *) (batch->opcode + i));
+        __m128i rs = _mm_loadu_si128((const __m128i *) (batch->rs + i));
+        __m128i rt = _mm_loadu_si128((const __m128i *) (batch->rt + i));
+        __m128i opcode_low = _mm_unpacklo_epi8(opcode, zero);
+        __m128i opcode_high = _mm_unpackhi_epi8(opcode, zero);
+        __m128i immediate_low = _mm_loadu_si128((const __m128i *) (batch->immediate + i));
+        __m128i immediate_high = _mm_loadu_si128((const __m128i *) (batch->immediate + i + 8));
+
+        __m128i invalid = _mm_and_si128(_mm_or_si128(rs, rt), register_bits);
+        invalid = _mm_or_si128(invalid, _mm_or_si128(misaligned_sse2(opcode_low, immediate_low),
+                                                     misaligned_sse2(opcode_high, immediate_high)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, zero)) != 0xFFFF ||
+            _mm_movemask_epi8(match_any_sse2(opcode, i_opcodes, sizeof(i_opcodes))) != 0xFFFF) {
+            return encode_i_scalar(batch, i, count, out);
+        }
+
+        __m128i high = high_half_sse2(opcode_low, _mm_unpacklo_epi8(rs, zero), _mm_unpacklo_epi8(rt, zero));
+        store_halves_sse2(immediate_low, high, out + i);
+
+        high = high_half_sse2(opcode_high, _mm_unpackhi_epi8(rs, zero), _mm_unpackhi_epi8(rt, zero));
+        store_halves_sse2(immediate_high, high, out + i + 8);
+    }
+    return encode_i_scalar(batch, i, count, out);
+}
+
+__attribute__((target("sse2")))
+static size_t encode_j_sse2(const JTypeBatch *batch, size_t count, uint32_t *out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i address_bits = _mm_set1_epi32((int) 0xFC000000u);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i opcode = _mm_loadu_si128((const __m128i *) (batch->opcode + i));
+        __m128i address[4];
+        __m128i invalid_address = zero;
+        for (int k = 0; k < 4; k++) {
+            address[k] = _mm_loadu_si128((const __m128i *) (batch->address + i + 4 * k));
+            invalid_address = _mm_or_si128(invalid_address, _mm_and_si128(address[k], address_bits));
+        }
+
+        if (_mm_movemask_epi8(match_any_sse2(opcode, j_opcodes, sizeof(j_opcodes))) != 0xFFFF ||
+            _mm_movemask_epi8(_mm_cmpeq_epi8(invalid_address, zero)) != 0xFFFF) {
+            return encode_j_scalar(batch, i, count, out);
+        }
+
+        __m128i opcode_lo = _mm_unpacklo_epi8(opcode, zero);
+        __m128i opcode_hi = _mm_unpackhi_epi8(opcode, zero);
+        __m128i opcode32[4] = {
+            _mm_unpacklo_epi16(opcode_lo, zero), _mm_unpackhi_epi16(opcode_lo, zero),
+            _mm_unpacklo_epi16(opcode_hi, zero), _mm_unpackhi_epi16(opcode_hi, zero),
+        };
+        for (int k = 0; k < 4; k++) {
+            _mm_storeu_si128((__m128i *) (out + i + 4 * k),
+                             _mm_or_si128(_mm_slli_epi32(opcode32[k], 26), address[k]));
+        }
+    }
+    return encode_j_scalar(batch, i, count, out);
+}
+
+__attribute__((target("avx2")))
+static inline void store_halves_avx2(__m256i low, __m256i high, uint32_t *out) {
+    // unpack works within 128-bit lanes, so the lanes are put back in order before storing.
+    __m256i first = _mm256_unpacklo_epi16(low, high);
+    __m256i second = _mm256_unpackhi_epi16(low, high);
+    _mm256_storeu_si256((__m256i *) out, _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256((__m256i *) (out + 8), _mm256_permute2x128_si256(first, second, 0x31));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i widen_avx2(const uint8_t *bytes) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) bytes));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i high_half_avx2(const uint8_t *opcode, const uint8_t *rs, const uint8_t *rt) {
+    return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(widen_avx2(opcode), 10),
+                                           _mm256_slli_epi16(widen_avx2(rs), 5)),
+                           widen_avx2(rt));
+}
+
+__attribute__((target("avx2")))
+static size_t encode_r_avx2(const RTypeBatch *batch, size_t count, uint32_t *out) {
+    const __m256i register_bits = _mm256_set1_epi8((char) 0xE0);
+
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i opcode = _mm256_loadu_si256((const __m256i *) (batch->opcode + i));
+        __m256i rs = _mm256_loadu_si256((const __m256i *) (batch->rs + i));
+        __m256i rt = _mm256_loadu_si256((const __m256i *) (batch->rt + i));
+        __m256i rd = _mm256_loadu_si256((const __m256i *) (batch->rd + i));
+        __m256i shamt = _mm256_loadu_si256((const __m256i *) (batch->shamt + i));
+        __m256i funct = _mm256_loadu_si256((const __m256i *) (batch->funct + i));
+
+        __m256i invalid = _mm256_and_si256(_mm256_or_si256(_mm256_or_si256(rs, rt), _mm256_or_si256(rd, shamt)),
+                                           register_bits);
+        invalid = _mm256_or_si256(invalid, opcode);
+        if (!_mm256_testz_si256(invalid, invalid) ||
+            _mm256_movemask_epi8(match_any_avx2(funct, r_functs, sizeof(r_functs))) != -1) {
+            return encode_r_scalar(batch, i, count, out);
+        }
+
+        for (size_t half = 0; half < 32; half += 16) {
+            size_t k = i + half;
+            __m256i high = high_half_avx2(batch->opcode + k, batch->rs + k, batch->rt + k);
+            __m256i low = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(widen_avx2(batch->rd + k), 11),
+                                                          _mm256_slli_epi16(widen_avx2(batch->shamt + k), 6)),
+                                          widen_avx2(batch->funct + k));
+            store_halves_avx2(low, high, out + k);
+        }
+    }
+    return encode_r_scalar(batch, i, count, out);
+}
+
+__attribute__((target("avx2")))
+static size_t encode_i_avx2(const ITypeBatch *batch, size_t count, uint32_t *out) {
+    const __m256i register_bits = _mm256_set1_epi8((char) 0xE0);
+
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i opcode = _mm256_loadu_si256((const __m256i *) (batch->opcode + i));
+        __m256i rs = _mm256_loadu_si256((const __m256i *) (batch->rs + i));
+        __m256i rt = _mm256_loadu_si256((const __m256i *) (batch->rt + i));
+
+        __m256i invalid = _mm256_and_si256(_mm256_or_si256(rs, rt), register_bits);
+        for (size_t half = 0; half < 32; half += 16) {
+            __m256i immediate = _mm256_loadu_si256((const __m256i *) (batch->immediate + i + half));
+            invalid = _mm256_or_si256(invalid, misaligned_avx2(widen_avx2(batch->opcode + i + half), immediate));
+        }
+        if (!_mm256_testz_si256(invalid, invalid) ||
+            _mm256_movemask_epi8(match_any_avx2(opcode, i_opcodes, sizeof(i_opcodes))) != -1) {
+            return encode_i_scalar(batch, i, count, out);
+        }
+
+        for (size_t half = 0; half < 32; half += 16) {
+            size_t k = i + half;
+            __m256i high = high_half_avx2(batch->opcode + k, batch->rs + k, batch->rt + k);
+            store_halves_avx2(_mm256_loadu_si256((const __m256i *) (batch->immediate + k)), high, out + k);
+        }
+    }
+    return encode_i_scalar(batch, i, count, out);
+}
+
+__attribute__((target("avx2")))
+static size_t encode_j_avx2(const JTypeBatch *batch, size_t count, uint32_t *out) {
+    const __m256i address_bits = _mm256_set1_epi32((int) 0xFC000000u);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i opcode_bytes = _mm_loadl_epi64((const __m128i *) (batch->opcode + i));
+        __m256i opcode = _mm256_cvtepu8_epi32(opcode_bytes);
+        __m256i address = _mm256_loadu_si256((const __m256i *) (batch->address + i));
+
+        __m256i invalid = _mm256_and_si256(address, address_bits);
+        if (!_mm256_testz_si256(invalid, invalid) ||
+            (_mm_movemask_epi8(match_any_sse2(opcode_bytes, j_opcodes, sizeof(j_opcodes))) & 0xFF) != 0xFF) {
+            return encode_j_scalar(batch, i, count, out);
+        }
+
+        _mm256_storeu_si256((__m256i *) (out + i), _mm256_or_si256(_mm256_slli_epi32(opcode, 26), address));
+    }
+    return encode_j_scalar(batch, i, count, out);
+}
+
+#endif
+
+static EncoderKernel supported_kernel = ENCODER_KERNEL_SCALAR;
+static EncoderKernel active_kernel = ENCODER_KERNEL_SCALAR;
+
+#ifdef ENCODER_X86
+// Runs once at load time, possibly before the constructor that sets up __builtin_cpu_supports.
+__attribute__((constructor)) static void choose_kernel(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        supported_kernel = ENCODER_KERNEL_AVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        supported_kernel = ENCODER_KERNEL_SSE2;
+    }
+    active_kernel = supported_kernel;
+}
+#endif
+
+EncoderKernel encoder_active_kernel(void) {
+    return active_kernel;
+}
+
+EncoderKernel encoder_use_kernel(EncoderKernel kernel) {
+    active_kernel = kernel < supported_kernel ? kernel : supported_kernel;
+    return active_kernel;
+}
+
+const char *encoder_kernel_name(EncoderKernel kernel) {
+    switch (kernel) {
+        case ENCODER_KERNEL_AVX2:
+            return "avx2";
+        case ENCODER_KERNEL_SSE2:
+            return "sse2";
+        default:
+            return "scalar";
+    }
+}
+
+size_t encode_r_type_batch(const RTypeBatch *batch, size_t count, uint32_t *out) {
+    switch (encoder_active_kernel()) {
+#ifdef ENCODER_X86
+        case ENCODER_KERNEL_AVX2:
+            return encode_r_avx2(batch, count, out);
+        case ENCODER_KERNEL_SSE2:
+            return encode_r_sse2(batch, count, out);
+#endif
+        default:
+            return encode_r_scalar(batch, 0, count, out);
+    }
+}
+
+size_t encode_i_type_batch(const ITypeBatch *batch, size_t count, uint32_t *out) {
+    switch (encoder_active_kernel()) {
+#ifdef ENCODER_X86
+        case ENCODER_KERNEL_AVX2:
+            return encode_i_avx2(batch, count, out);
+        case ENCODER_KERNEL_SSE2:
+            return encode_i_sse2(batch, count, out);
+#endif
+        default:
+            return encode_i_scalar(batch, 0, count, out);
+    }
+}
+
+size_t encode_j_type_batch(const JTypeBatch *batch, size_t count, uint32_t *out) {
+    switch (encoder_active_kernel()) {
+#ifdef ENCODER_X86
+        case ENCODER_KERNEL_AVX2:
+            return encode_j_avx2(batch, count, out);
+        case ENCODER_KERNEL_SSE2:
+            return encode_j_sse2(batch, count, out);
+#endif
+        default:
+            return encode_j_scalar(batch, 0, count, out);
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Decoded fields for a run of instructions of one type, one array per field.
+typedef struct {
+    const uint8_t *opcode;
+    const uint8_t *rs;
+    const uint8_t *rt;
+    const uint8_t *rd;
+    const uint8_t *shamt;
+    const uint8_t *funct;
+} RTypeBatch;
+
+typedef struct {
+    const uint8_t *opcode;
+    const uint8_t *rs;
+    const uint8_t *rt;
+    const int16_t *immediate;
+} ITypeBatch;
+
+typedef struct {
+    const uint8_t *opcode;
+    const uint32_t *address;
+} JTypeBatch;
+
+typedef enum {
+    ENCODER_KERNEL_SCALAR,
+    ENCODER_KERNEL_SSE2,
+    ENCODER_KERNEL_AVX2,
+} EncoderKernel;
+
+// Each function validates the fields with the same rules as assembler_validate_*_type and packs them
+// into out. The return value is the index of the first invalid instruction, or count when every one is
+// valid; words at and after an invalid instruction are left unspecified.
+size_t encode_r_type_batch(const RTypeBatch *batch, size_t count, uint32_t *out);
+
+size_t encode_i_type_batch(const ITypeBatch *batch, size_t count, uint32_t *out);
+
+size_t encode_j_type_batch(const JTypeBatch *batch, size_t count, uint32_t *out);
+
+// The kernel the batch functions use: the widest this CPU supports, chosen once when the library is loaded
+// so one binary runs everywhere.
+EncoderKernel encoder_active_kernel(void);
+
+// Makes the batch functions use kernel, or the widest supported one below it, and returns the kernel now in
+// use. For benchmarks and tests comparing kernels; it must not race with batch calls.
+EncoderKernel encoder_use_kernel(EncoderKernel kernel);
+
+const char *encoder_kernel_name(EncoderKernel kernel);
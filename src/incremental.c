@@ -0,0 +1,487 @@
+#include "incremental.h"
+#include "lexer.h"
+#include "pseudo.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SYMBOL_TOUCHED 0x01 // defined or undefined by this edit
+#define SYMBOL_SHIFTED 0x02 // defined after the edited lines, so it moved with them
+
+// Farther than this, a branch offset no longer fits in 16 bits.
+#define BRANCH_REACH 32769u
+
+// A parsed line of the replacement text.
+typedef struct {
+    const char *label;
+    uint32_t label_length;
+    bool has_instruction;
+    bool invalid;
+    PseudoExpansion expansion; // the line's instructions: a pseudo-instruction's expansion, or the one written
+} PendingLine;
+
+static bool grow_array(void **array, uint32_t *capacity, uint32_t needed, size_t element_size) {
+    if (needed <= *capacity) return true;
+    uint64_t new_capacity = *capacity ? *capacity : 1024;
+    while (new_capacity < needed) new_capacity *= 2;
+    if (new_capacity > UINT32_MAX) new_capacity = UINT32_MAX;
+    void *new_array = realloc(*array, element_size * new_capacity);
+    if (!new_array) return false;
+    *array = new_array;
+    *capacity = (uint32_t) new_capacity;
+    return true;
+}
+
+static bool reserve_lines(IncrementalAssembler *incremental, uint32_t count) {
+    if (count <= incremental->line_capacity) return true;
+    uint32_t capacity = incremental->line_capacity;
+    uint32_t label_capacity = capacity;
+    uint32_t flag_capacity = capacity;
+    bool ok = grow_array((void **) &incremental->line_instruction, &capacity, count, sizeof(uint32_t)) &&
+              grow_array((void **) &incremental->line_label, &label_capacity, count, sizeof(uint32_t)) &&
+              grow_array((void **) &incremental->line_flags, &flag_capacity, count, sizeof(uint8_t));
+    if (ok) incremental->line_capacity = capacity;
+    return ok;
+}
+
+// Keeps the per-symbol arrays as long as the symbol table; new symbols start undefined and unreferenced.
+static bool reserve_symbols(IncrementalAssembler *incremental) {
+    uint32_t count = incremental->assembler->labels.label_count;
+    uint32_t old_capacity = incremental->symbol_capacity;
+    if (count <= old_capacity) return true;
+
+    uint32_t capacity = old_capacity;
+    uint32_t count_capacity = old_capacity;
+    uint32_t mark_capacity = old_capacity;
+    if (!grow_array((void **) &incremental->label_lines, &capacity, count, sizeof(uint32_t)) ||
+        !grow_array((void **) &incremental->reference_counts, &count_capacity, count, sizeof(uint32_t)) ||
+        !grow_array((void **) &incremental->symbol_marks, &mark_capacity, count, sizeof(uint8_t))) {
+        return false;
+    }
+    memset(incremental->label_lines + old_capacity, 0, sizeof(uint32_t) * (capacity - old_capacity));
+    memset(incremental->reference_counts + old_capacity, 0, sizeof(uint32_t) * (capacity - old_capacity));
+    memset(incremental->symbol_marks + old_capacity, 0, capacity - old_capacity);
+    incremental->symbol_capacity = capacity;
+    return true;
+}
+
+static bool reserve_instructions(IncrementalAssembler *incremental, uint32_t count) {
+    return assembler_reserve(incremental->assembler, count) &&
+           grow_array((void **) &incremental->range_errors, &incremental->range_error_capacity, count,
+                      sizeof(uint8_t));
+}
+
+// Instructions held by the line at index line: they run up to the first instruction of the next line.
+static uint32_t line_instructions(const IncrementalAssembler *incremental, uint32_t line) {
+    uint32_t end = line + 1 < incremental->line_count ? incremental->line_instruction[line + 1]
+                                                      : incremental->assembler->instruction_count;
+    return end - incremental->line_instruction[line];
+}
+
+static bool label_defined(const IncrementalAssembler *incremental, uint32_t symbol) {
+    return incremental->label_lines[symbol] != 0;
+}
+
+static void define_label(IncrementalAssembler *incremental, uint32_t symbol, uint32_t line, uint32_t instruction) {
+    incremental->assembler->labels.labels[symbol].instruction_line = instruction;
+    incremental->label_lines[symbol] = line;
+    incremental->unresolved_references -= incremental->reference_counts[symbol];
+    incremental->symbol_marks[symbol] |= SYMBOL_TOUCHED;
+}
+
+static void undefine_label(IncrementalAssembler *incremental, uint32_t symbol) {
+    incremental->assembler->labels.labels[symbol].instruction_line = SYMBOL_UNDEFINED;
+    incremental->label_lines[symbol] = 0;
+    incremental->unresolved_references += incremental->reference_counts[symbol];
+    incremental->symbol_marks[symbol] |= SYMBOL_TOUCHED;
+}
+
+static uint32_t encode_instruction(const Instruction *instruction) {
+    switch (instruction->type) {
+        case R_TYPE:
+            return r_type_to_machine_code(&instruction->data.r);
+        case I_TYPE:
+            return i_type_to_machine_code(&instruction->data.i);
+        default:
+            return j_type_to_machine_code(&instruction->data.j);
+    }
+}
+
+// Re-resolves one reference and widens the dirty range if the word changed.
+static void repatch(IncrementalAssembler *incremental, uint32_t index, IncrementalChange *change) {
+    Assembler *assembler = incremental->assembler;
+    uint32_t symbol = assembler->instruction_symbols[index];
+    uint32_t word = assembler->machine_code[index];
+
+    if (incremental->range_errors[index]) {
+        incremental->range_errors[index] = 0;
+        incremental->out_of_range--;
+    }
+    if (label_defined(incremental, symbol) &&
+        assembler_patch_word(&word, assembler->instruction_types[index], index,
+                             assembler_reference_target(assembler, assembler->instruction_types[index],
+                                                        assembler->labels.labels[symbol].instruction_line)) !=
+            ASSEMBLER_SUCCESS) {
+        incremental->range_errors[index] = 1;
+        incremental->out_of_range++;
+    }
+
+    if (word != assembler->machine_code[index]) {
+        assembler->machine_code[index] = word;
+        if (change->dirty_begin == change->dirty_end) {
+            change->dirty_begin = index;
+            change->dirty_end = index + 1;
+        } else {
+            if (index < change->dirty_begin) change->dirty_begin = index;
+            if (index >= change->dirty_end) change->dirty_end = index + 1;
+        }
+    }
+}
+
+// Re-resolves the references in [begin, end) that the edit may have changed. new_tail is the first
+// instruction after the edited lines.
+static void check_references(IncrementalAssembler *incremental, uint32_t begin, uint32_t end, int64_t delta,
+                             uint32_t new_tail, IncrementalChange *change) {
+    const uint8_t *types = incremental->assembler->instruction_types;
+    const uint32_t *symbols = incremental->assembler->instruction_symbols;
+    const uint8_t *marks = incremental->symbol_marks;
+    for (uint32_t i = begin; i < end; i++) {
+        uint32_t symbol = symbols[i];
+        if (symbol == ASSEMBLER_NO_SYMBOL) continue;
+
+        uint8_t mark = marks[symbol];
+        bool stale = mark & SYMBOL_TOUCHED;
+        if (delta != 0) {
+            bool label_moved = mark & SYMBOL_SHIFTED;
+            bool absolute = types[i] == J_TYPE || types[i] == ASSEMBLER_TYPE_ADDRESS;
+            stale = stale || (absolute ? label_moved : label_moved != (i >= new_tail));
+        }
+        if (stale) repatch(incremental, i, change);
+    }
+}
+
+// Re-resolves the jumps and label addresses in [begin, end) whose label moved.
+static void check_absolute(IncrementalAssembler *incremental, uint32_t begin, uint32_t end,
+                           IncrementalChange *change) {
+    static const uint8_t absolute_types[] = {J_TYPE, ASSEMBLER_TYPE_ADDRESS};
+    const uint8_t *types = incremental->assembler->instruction_types;
+    const uint32_t *symbols = incremental->assembler->instruction_symbols;
+    const uint8_t *stop = types + end;
+    for (size_t t = 0; t < sizeof(absolute_types); t++) {
+        const uint8_t *cursor = types + begin;
+        while (cursor < stop && (cursor = memchr(cursor, absolute_types[t], (size_t) (stop - cursor)))) {
+            uint32_t i = (uint32_t) (cursor - types);
+            uint32_t symbol = symbols[i];
+            if (symbol != ASSEMBLER_NO_SYMBOL && (incremental->symbol_marks[symbol] & SYMBOL_SHIFTED)) {
+                repatch(incremental, i, change);
+            }
+            cursor++;
+        }
+    }
+}
+
+static bool is_linkage_directive(const Token *token) {
+    static const char *const names[] = {".globl", ".global", ".extern"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (token->length == strlen(names[i]) && memcmp(token->start, names[i], token->length) == 0) return true;
+    }
+    return false;
+}
+
+// Fills expansion with the instructions a line stands for. Returns false when it holds none that validate.
+static bool expand_line(const SourceLine *line, PseudoExpansion *expansion) {
+    if (lexer_is_directive(line)) return false;
+    if (pseudo_is_mnemonic(&line->tokens[0])) {
+        const char *message;
+        if (pseudo_expand(line, expansion, &message) != ASSEMBLER_SUCCESS) return false;
+    } else {
+        expansion->instructions[0] = parse_source_line(line, NULL);
+        expansion->types[0] = assembler_instruction_type(&expansion->instructions[0]);
+        expansion->count = 1;
+    }
+    for (uint32_t i = 0; i < expansion->count; i++) {
+        if (!assembler_validate_instruction(&expansion->instructions[i])) return false;
+    }
+    return true;
+}
+
+static PendingLine *parse_lines(const char *text, size_t size, uint32_t *count) {
+    uint32_t capacity = 0;
+    PendingLine *lines = NULL;
+    Lexer lexer;
+    SourceLine line;
+
+    *count = 0;
+    lexer_init(&lexer, text, size);
+    while (lexer_next_line(&lexer, &line)) {
+        if (!grow_array((void **) &lines, &capacity, *count + 1, sizeof(PendingLine))) {
+            free(lines);
+            return NULL;
+        }
+        PendingLine *pending = &lines[(*count)++];
+        pending->label = line.label;
+        pending->label_length = line.label_length;
+        // Linkage directives do not change a single image, so they count as blank lines here. Raw data and the
+        // .data section are not tracked and leave the line invalid.
+        bool linkage = lexer_is_directive(&line) && is_linkage_directive(&line.tokens[0]);
+        pending->has_instruction = line.token_count > 0 && !linkage;
+        pending->invalid = pending->has_instruction && !expand_line(&line, &pending->expansion);
+    }
+    if (!lines) lines = malloc(sizeof(PendingLine));
+    return lines;
+}
+
+// Removes the bookkeeping of lines [first, first + count) before they are overwritten. Returns whether a
+// label lost its definition.
+static bool forget_lines(IncrementalAssembler *incremental, uint32_t first, uint32_t count) {
+    Assembler *assembler = incremental->assembler;
+    bool undefined = false;
+    for (uint32_t line = first; line < first + count; line++) {
+        uint8_t flags = incremental->line_flags[line];
+        uint32_t label = incremental->line_label[line];
+
+        if (flags & INCREMENTAL_LINE_INSTRUCTION) {
+            uint32_t begin = incremental->line_instruction[line];
+            uint32_t end = begin + line_instructions(incremental, line);
+            for (uint32_t index = begin; index < end; index++) {
+                uint32_t symbol = assembler->instruction_symbols[index];
+                if (symbol != ASSEMBLER_NO_SYMBOL) {
+                    incremental->reference_counts[symbol]--;
+                    if (!label_defined(incremental, symbol)) incremental->unresolved_references--;
+                }
+                if (incremental->range_errors[index]) incremental->out_of_range--;
+            }
+        }
+        if (flags & INCREMENTAL_LINE_INVALID) incremental->invalid_lines--;
+        if (flags & INCREMENTAL_LINE_DUPLICATE) {
+            incremental->duplicate_labels--;
+        } else if (label != ASSEMBLER_NO_SYMBOL) {
+            undefine_label(incremental, label);
+            undefined = true;
+        }
+    }
+    return undefined;
+}
+
+// A label whose definition was removed falls back to the first line that redefined it.
+static void promote_duplicates(IncrementalAssembler *incremental) {
+    for (uint32_t line = 0; line < incremental->line_count && incremental->duplicate_labels > 0; line++) {
+        uint32_t label = incremental->line_label[line];
+        if ((incremental->line_flags[line] & INCREMENTAL_LINE_DUPLICATE) && !label_defined(incremental, label)) {
+            incremental->line_flags[line] &= (uint8_t) ~INCREMENTAL_LINE_DUPLICATE;
+            incremental->duplicate_labels--;
+            define_label(incremental, label, line + 1, incremental->line_instruction[line]);
+        }
+    }
+}
+
+IncrementalAssembler *incremental_create(const char *source, size_t size) {
+    IncrementalAssembler *incremental = calloc(1, sizeof(IncrementalAssembler));
+    if (!incremental) return NULL;
+
+    incremental->assembler = assembler_create();
+    if (!incremental->assembler ||
+        incremental_edit(incremental, 1, 0, source, size, NULL) != ASSEMBLER_SUCCESS) {
+        incremental_destroy(incremental);
+        return NULL;
+    }
+    return incremental;
+}
+
+void incremental_destroy(IncrementalAssembler *incremental) {
+    if (incremental) {
+        assembler_destroy(incremental->assembler);
+        free(incremental->line_instruction);
+        free(incremental->line_label);
+        free(incremental->line_flags);
+        free(incremental->label_lines);
+        free(incremental->reference_counts);
+        free(incremental->symbol_marks);
+        free(incremental->range_errors);
+        free(incremental);
+    }
+}
+
+InstructionValidateResult incremental_edit(IncrementalAssembler *incremental, uint32_t first_line,
+                                           uint32_t line_count, const char *text, size_t size,
+                                           IncrementalChange *change) {
+    if (!incremental || (!text && size > 0)) {
+        return ASSEMBLER_ERROR_NULL_POINTER;
+    }
+    if (first_line == 0 || first_line - 1 > incremental->line_count ||
+        line_count > incremental->line_count - (first_line - 1)) {
+        return ASSEMBLER_ERROR_INVALID_OFFSET;
+    }
+
+    Assembler *assembler = incremental->assembler;
+    IncrementalChange ignored;
+    if (!change) change = &ignored;
+
+    uint32_t new_line_count;
+    PendingLine *pending = parse_lines(text, size, &new_line_count);
+    if (!pending) return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+
+    uint32_t first = first_line - 1;
+    uint32_t old_end = first + line_count;
+    uint32_t position = first < incremental->line_count ? incremental->line_instruction[first]
+                                                        : assembler->instruction_count;
+    uint32_t old_instructions = (old_end < incremental->line_count ? incremental->line_instruction[old_end]
+                                                                   : assembler->instruction_count) -
+                                position;
+    uint32_t new_instructions = 0;
+    for (uint32_t i = 0; i < new_line_count; i++) {
+        if (pending[i].has_instruction && !pending[i].invalid) new_instructions += pending[i].expansion.count;
+    }
+
+    int64_t line_delta = (int64_t) new_line_count - line_count;
+    int64_t delta = (int64_t) new_instructions - old_instructions;
+    if (incremental->line_count + line_delta > UINT32_MAX || assembler->instruction_count + delta > UINT32_MAX ||
+        !reserve_lines(incremental, (uint32_t) (incremental->line_count + line_delta)) ||
+        !reserve_instructions(incremental, (uint32_t) (assembler->instruction_count + delta))) {
+        free(pending);
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
+
+    // touched: some label was defined or undefined, so all references need checking.
+    // marked: symbol_marks has to be cleared before returning.
+    bool touched = forget_lines(incremental, first, line_count);
+    bool marked = touched;
+
+    // Move the tail of the per-instruction and per-line arrays into place.
+    uint32_t old_tail = position + old_instructions;
+    uint32_t new_tail = position + new_instructions;
+    uint32_t tail_instructions = assembler->instruction_count - old_tail;
+    if (delta != 0) {
+        memmove(assembler->machine_code + new_tail, assembler->machine_code + old_tail,
+                sizeof(uint32_t) * tail_instructions);
+        memmove(assembler->instruction_types + new_tail, assembler->instruction_types + old_tail,
+                sizeof(uint8_t) * tail_instructions);
+        memmove(assembler->instruction_symbols + new_tail, assembler->instruction_symbols + old_tail,
+                sizeof(uint32_t) * tail_instructions);
+        memmove(incremental->range_errors + new_tail, incremental->range_errors + old_tail,
+                sizeof(uint8_t) * tail_instructions);
+    }
+    uint32_t tail_lines = incremental->line_count - old_end;
+    uint32_t new_end = first + new_line_count;
+    if (line_delta != 0) {
+        memmove(incremental->line_instruction + new_end, incremental->line_instruction + old_end,
+                sizeof(uint32_t) * tail_lines);
+        memmove(incremental->line_label + new_end, incremental->line_label + old_end, sizeof(uint32_t) * tail_lines);
+        memmove(incremental->line_flags + new_end, incremental->line_flags + old_end, sizeof(uint8_t) * tail_lines);
+    }
+    if (delta != 0) {
+        for (uint32_t line = new_end; line < new_end + tail_lines; line++) {
+            incremental->line_instruction[line] = (uint32_t) (incremental->line_instruction[line] + delta);
+        }
+    }
+    if (delta != 0 || line_delta != 0) {
+        Label *labels = assembler->labels.labels;
+        for (uint32_t symbol = 0; symbol < assembler->labels.label_count; symbol++) {
+            if (incremental->label_lines[symbol] > old_end) {
+                incremental->label_lines[symbol] = (uint32_t) (incremental->label_lines[symbol] + line_delta);
+                labels[symbol].instruction_line = (uint32_t) (labels[symbol].instruction_line + delta);
+                incremental->symbol_marks[symbol] |= SYMBOL_SHIFTED;
+                marked = true;
+            }
+        }
+    }
+    incremental->line_count = (uint32_t) (incremental->line_count + line_delta);
+    assembler->instruction_count = (uint32_t) (assembler->instruction_count + delta);
+
+    // Fill in the new lines.
+    InstructionValidateResult result = ASSEMBLER_SUCCESS;
+    uint32_t index = position;
+    for (uint32_t i = 0; i < new_line_count && result == ASSEMBLER_SUCCESS; i++) {
+        const PendingLine *line = &pending[i];
+        uint32_t line_index = first + i;
+        incremental->line_instruction[line_index] = index;
+        incremental->line_label[line_index] = ASSEMBLER_NO_SYMBOL;
+        incremental->line_flags[line_index] = 0;
+
+        if (line->label) {
+            uint32_t symbol = symbol_table_intern(&assembler->labels, line->label, line->label_length);
+            if (symbol == SYMBOL_TABLE_EMPTY || !reserve_symbols(incremental)) {
+                result = ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            incremental->line_label[line_index] = symbol;
+            if (label_defined(incremental, symbol)) {
+                incremental->line_flags[line_index] |= INCREMENTAL_LINE_DUPLICATE;
+                incremental->duplicate_labels++;
+            } else {
+                define_label(incremental, symbol, line_index + 1, index);
+                touched = true;
+                marked = true;
+            }
+        }
+
+        if (line->invalid) {
+            incremental->line_flags[line_index] |= INCREMENTAL_LINE_INVALID;
+            incremental->invalid_lines++;
+        } else if (line->has_instruction) {
+            for (uint32_t k = 0; k < line->expansion.count && result == ASSEMBLER_SUCCESS; k++) {
+                const Instruction *instruction = &line->expansion.instructions[k];
+                uint32_t symbol = ASSEMBLER_NO_SYMBOL;
+                if (instruction->label_ref) {
+                    symbol = symbol_table_intern(&assembler->labels, instruction->label_ref,
+                                                 instruction->label_length);
+                    if (symbol == SYMBOL_TABLE_EMPTY || !reserve_symbols(incremental)) {
+                        result = ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+                        break;
+                    }
+                    incremental->reference_counts[symbol]++;
+                    if (!label_defined(incremental, symbol)) incremental->unresolved_references++;
+                }
+                assembler->instruction_types[index] = line->expansion.types[k];
+                assembler->instruction_symbols[index] = symbol;
+                assembler->machine_code[index] = encode_instruction(instruction);
+                incremental->range_errors[index] = 0;
+                index++;
+            }
+            incremental->line_flags[line_index] |= INCREMENTAL_LINE_INSTRUCTION;
+        }
+    }
+    free(pending);
+    if (result != ASSEMBLER_SUCCESS) return result;
+
+    if (incremental->duplicate_labels > 0 && touched) {
+        promote_duplicates(incremental);
+    }
+
+    change->dirty_begin = position;
+    change->dirty_end = new_tail;
+    change->moved_begin = new_tail;
+    change->instruction_delta = (int32_t) delta;
+
+    for (uint32_t i = position; i < new_tail; i++) {
+        if (assembler->instruction_symbols[i] != ASSEMBLER_NO_SYMBOL) repatch(incremental, i, change);
+    }
+
+    // Words outside the edit only change when their label was (un)defined by it, or when the edit moved
+    // one end of the reference but not the other.
+    if (touched) {
+        check_references(incremental, 0, position, delta, new_tail, change);
+        check_references(incremental, new_tail, assembler->instruction_count, delta, new_tail, change);
+    } else if (delta != 0) {
+        // A branch that crosses the edit from further than BRANCH_REACH away was out of range before it and
+        // still is, so only jumps and label addresses need looking at outside that window.
+        uint32_t low = position > BRANCH_REACH ? position - BRANCH_REACH : 0;
+        uint32_t high = assembler->instruction_count - new_tail > BRANCH_REACH ? new_tail + BRANCH_REACH
+                                                                               : assembler->instruction_count;
+        check_references(incremental, low, position, delta, new_tail, change);
+        check_references(incremental, new_tail, high, delta, new_tail, change);
+        check_absolute(incremental, 0, low, change);
+        check_absolute(incremental, high, assembler->instruction_count, change);
+    }
+    if (marked) {
+        memset(incremental->symbol_marks, 0, assembler->labels.label_count);
+    }
+
+    return ASSEMBLER_SUCCESS;
+}
+
+uint32_t incremental_error_count(const IncrementalAssembler *incremental) {
+    if (!incremental) return 0;
+    return incremental->invalid_lines + incremental->duplicate_labels + incremental->unresolved_references +
+           incremental->out_of_range;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "assembler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define INCREMENTAL_LINE_INSTRUCTION 0x01 // the line holds instructions, several for a pseudo-instruction
+#define INCREMENTAL_LINE_INVALID 0x02     // the line's instructions do not parse or validate
+#define INCREMENTAL_LINE_DUPLICATE 0x04   // the line's label is already defined on another line
+
+// What an edit did to machine_code, in post-edit indices. Words in [moved_begin, instruction_count) are
+// the words that used to sit instruction_delta positions earlier; on top of that every word in
+// [dirty_begin, dirty_end) was re-encoded and may differ. The range is empty when nothing was re-encoded.
+typedef struct {
+    uint32_t dirty_begin;
+    uint32_t dirty_end;
+    uint32_t moved_begin;
+    int32_t instruction_delta;
+} IncrementalChange;
+
+// Keeps a program assembled across line edits. The wrapped assembler runs in two-pass mode so every
+// instruction's type and label stay known; after each edit assembler->machine_code holds the program,
+// complete whenever incremental_error_count() is zero.
+//
+// A pseudo-instruction line (pseudo.h) holds its whole expansion. Only the edited lines are parsed again.
+// Edits that keep the instruction count and define no labels re-encode just those lines. Otherwise the tail
+// of the arrays is moved, labels after the edit are shifted, and a scan over the references re-encodes the
+// branches that cross the edit, the jumps and label addresses (la, memory operands) of moved labels and
+// every reference to a label the edit defined or removed.
+typedef struct {
+    Assembler *assembler;
+
+    uint32_t line_count;
+    uint32_t line_capacity;
+    uint32_t *line_instruction; // index of the line's first instruction, or of the next one when it has none
+    uint32_t *line_label;       // symbol the line defines, or ASSEMBLER_NO_SYMBOL
+    uint8_t *line_flags;
+
+    uint32_t symbol_capacity;
+    uint32_t *label_lines;      // symbol -> defining line (1-based), 0 while undefined
+    uint32_t *reference_counts; // symbol -> instructions referencing it
+    uint8_t *symbol_marks;      // scratch for one edit
+
+    uint8_t *range_errors; // per instruction: its label is out of reach
+    uint32_t range_error_capacity;
+
+    uint32_t invalid_lines;
+    uint32_t duplicate_labels;
+    uint32_t unresolved_references;
+    uint32_t out_of_range;
+} IncrementalAssembler;
+
+IncrementalAssembler *incremental_create(const char *source, size_t size);
+
+void incremental_destroy(IncrementalAssembler *incremental);
+
+// Replaces line_count lines starting at first_line (1-based) with the lines of text; line_count 0
+// inserts before first_line, and first_line may be one past the last line to append. Assembly errors
+// are not failures: they are tracked by line and counted by incremental_error_count. Returns an error
+// only for bad arguments or allocation failure, in which case the state must be rebuilt.
+InstructionValidateResult incremental_edit(IncrementalAssembler *incremental, uint32_t first_line,
+                                           uint32_t line_count, const char *text, size_t size,
+                                           IncrementalChange *change);
+
+uint32_t incremental_error_count(const IncrementalAssembler *incremental);
@@ -1,130 +1,96 @@
 #include "instruction.h"
-#include <string.h>
-#include <stdlib.h>
 #include <ctype.h>
+#include <string.h>
 
-static const InstructionDef instruction_table[] = {
-    {"add", R_TYPE, 0x00, 0x01},
-    {"sub", R_TYPE, 0x00, 0x02},
-    {"and", R_TYPE, 0x00, 0x03},
-    {"or", R_TYPE, 0x00, 0x04},
-    {"xor", R_TYPE, 0x00, 0x05},
-    {"sll", R_TYPE, 0x00, 0x06},
-    {"srl", R_TYPE, 0x00, 0x07},
-    {"sra", R_TYPE, 0x00, 0x08},
-    {"jr", R_TYPE, 0x00, 0x09},
-    {"addi", I_TYPE, 0x01, 0x00},
-    {"beq", I_TYPE, 0x02, 0x00},
-    {"bneq", I_TYPE, 0x03, 0x00},
-    {"bltz", I_TYPE, 0x04, 0x00},
-    {"bgtz", I_TYPE, 0x05, 0x00},
-    {"blt", I_TYPE, 0x06, 0x00},
-    {"bgt", I_TYPE, 0x07, 0x00},
-    {"lw", I_TYPE, 0x08, 0x00},
-    {"sw", I_TYPE, 0x09, 0x00},
-    {"lh", I_TYPE, 0x0A, 0x00},
-    {"sh", I_TYPE, 0x0B, 0x00},
-    {"lb", I_TYPE, 0x0D, 0x00},
-    {"sb", I_TYPE, 0x0E, 0x00},
-    {"j", J_TYPE, 0xFF, 0x00},
-    {"jal", J_TYPE, 0xFE, 0x00},
-};
+#define ISA_DEF_R(NAME, name, funct) {name, R_TYPE, OPERANDS_REGISTER, 0x00, funct, 1},
+#define ISA_DEF_I(NAME, name, format, opcode, width) {name, I_TYPE, OPERANDS_##format, opcode, 0x00, width},
+#define ISA_DEF_J(NAME, name, opcode) {name, J_TYPE, OPERANDS_JUMP, opcode, 0x00, 1},
 
-static const InstructionDef *find_instruction(const char *name) {
-    for (int i = 0; instruction_table[i].name != NULL; i++) {
-        if (strcmp(instruction_table[i].name, name) == 0) {
-            return &instruction_table[i];
-        }
-    }
-    return NULL;
-}
+static const InstructionDef instruction_table[ISA_ROW_COUNT] = {ISA_INSTRUCTIONS(ISA_DEF_R, ISA_DEF_I, ISA_DEF_J)};
 
-int is_valid_register(const char *reg) {
-    if (reg[0] != '$') return 0;
+// Perfect hash over the mnemonics: the name's bytes are packed little-endian into a 64-bit key and its slot
+// is (key * MNEMONIC_HASH_MULTIPLIER) >> 58. The table is a designated initializer generated from
+// ISA_INSTRUCTIONS, so -Werror=override-init fails the build when a new row, or a repeated mnemonic, lands
+// on a taken slot; pick another multiplier then. Entries hold the row index plus one.
+#define MNEMONIC_HASH_MULTIPLIER 0x622eecab78ccb201ull
+#define MNEMONIC_HASH_SHIFT 58
+#define MNEMONIC_SLOT_COUNT (1u << (64 - MNEMONIC_HASH_SHIFT))
+#define MNEMONIC_MAX_LENGTH 8
 
-    if (reg[1] == 'v') {
-        char *endptr;
-        int num = strtol(reg + 2, &endptr, 10);
-        return *endptr == '\0' && num >= 0 && num <= 1;
-    }
-    if (reg[1] == 'a') {
-        char *endptr;
-        int num = strtol(reg + 2, &endptr, 10);
-        return *endptr == '\0' && num >= 0 && num <= 4;
-    }
-    if (reg[1] == 'r') {
-        char *endptr;
-        int num = strtol(reg + 2, &endptr, 10);
-        return *endptr == '\0' && num >= 0 && num <= 15;
-    }
-    if (reg[1] == 's') {
-        char *endptr;
-        int num = strtol(reg + 2, &endptr, 10);
-        return *endptr == '\0' && num >= 0 && num <= 4;
-    }
+#define MNEMONIC_BYTE(name, i) (i < sizeof(name) - 1 ? (uint64_t) (uint8_t) name[i] << (8 * i) : 0)
+#define MNEMONIC_KEY(name) \
+    (MNEMONIC_BYTE(name, 0) | MNEMONIC_BYTE(name, 1) | MNEMONIC_BYTE(name, 2) | MNEMONIC_BYTE(name, 3) | \
+     MNEMONIC_BYTE(name, 4) | MNEMONIC_BYTE(name, 5) | MNEMONIC_BYTE(name, 6) | MNEMONIC_BYTE(name, 7))
+#define MNEMONIC_SLOT(name) ((MNEMONIC_KEY(name) * MNEMONIC_HASH_MULTIPLIER) >> MNEMONIC_HASH_SHIFT)
 
-    if (strcmp(reg, "$zero") == 0) return 1;
-    if (strcmp(reg, "$sp") == 0) return 1;
-    if (strcmp(reg, "$ra") == 0) return 1;
+#define ISA_LENGTH_R(NAME, name, funct) _Static_assert(sizeof(name) - 1 <= MNEMONIC_MAX_LENGTH, name " is too long");
+#define ISA_LENGTH_I(NAME, name, format, opcode, width) ISA_LENGTH_R(NAME, name, 0)
+#define ISA_LENGTH_J(NAME, name, opcode) ISA_LENGTH_R(NAME, name, 0)
 
-    return 0;
-}
+ISA_INSTRUCTIONS(ISA_LENGTH_R, ISA_LENGTH_I, ISA_LENGTH_J)
 
-int parse_register(const char *reg) {
-    if (!is_valid_register(reg)) return -1;
+#define ISA_SLOT_R(NAME, name, funct) [MNEMONIC_SLOT(name)] = ISA_ROW_##NAME + 1,
+#define ISA_SLOT_I(NAME, name, format, opcode, width) ISA_SLOT_R(NAME, name, 0)
+#define ISA_SLOT_J(NAME, name, opcode) ISA_SLOT_R(NAME, name, 0)
 
-    if (reg[1] == 'v') {
-        const int v_offset = 1;
-        return strtol(reg + 2, NULL, 10) + v_offset;
-    }
+static const uint8_t mnemonic_slots[MNEMONIC_SLOT_COUNT] = {ISA_INSTRUCTIONS(ISA_SLOT_R, ISA_SLOT_I, ISA_SLOT_J)};
 
-    if (reg[1] == 'a') {
-        const int a_offset = 3;
-        return strtol(reg + 2, NULL, 10) + a_offset;
-    }
-    if (reg[1] == 'r') {
-        const int r_offset = 9;
-        return strtol(reg + 2, NULL, 10) + r_offset;
-    }
-    if (reg[1] == 's') {
-        const int s_offset = 23;
-        return strtol(reg + 2, NULL, 10) + s_offset;
+const InstructionDef *find_instruction(const char *name, size_t length) {
+    if (length == 0 || length > MNEMONIC_MAX_LENGTH) return NULL;
+
+    uint64_t key = 0;
+    for (size_t i = 0; i < length; i++) {
+        key |= (uint64_t) (uint8_t) name[i] << (8 * i);
     }
+    uint8_t entry = mnemonic_slots[(key * MNEMONIC_HASH_MULTIPLIER) >> MNEMONIC_HASH_SHIFT];
+    if (entry == 0) return NULL;
+    const InstructionDef *def = &instruction_table[entry - 1];
+    return memcmp(def->name, name, length) == 0 && def->name[length] == '\0' ? def : NULL;
+}
+
+const InstructionDef *instruction_def(IsaRow row) {
+    return &instruction_table[row];
+}
+
+// Inverse of instruction_table for decoding, indexed directly by opcode and, for opcode 0, by funct.
+// Entries hold the row index plus one, as in mnemonic_slots.
+#define ISA_FUNCT_ROW(NAME, name, funct) [funct] = ISA_ROW_##NAME + 1,
+#define ISA_OPCODE_ROW_I(NAME, name, format, opcode, width) [opcode] = ISA_ROW_##NAME + 1,
+#define ISA_OPCODE_ROW_J(NAME, name, opcode) [opcode] = ISA_ROW_##NAME + 1,
+
+static const uint8_t opcode_rows[64] = {ISA_INSTRUCTIONS(ISA_IGNORE_R, ISA_OPCODE_ROW_I, ISA_OPCODE_ROW_J)};
 
-    if (strcmp(reg, "$zero") == 0) return 0;
-    if (strcmp(reg, "$sp") == 0) return 29;
-    if (strcmp(reg, "$ra") == 0) return 31;
+static const uint8_t funct_rows[64] = {ISA_INSTRUCTIONS(ISA_FUNCT_ROW, ISA_IGNORE_I, ISA_IGNORE_J)};
 
-    return -1;
+const InstructionDef *decode_instruction(uint32_t word) {
+    uint32_t opcode = word >> 26;
+    uint8_t entry = opcode == 0 ? funct_rows[word & 0x3F] : opcode_rows[opcode];
+    return entry ? &instruction_table[entry - 1] : NULL;
 }
 
-int16_t parse_immediate(const char *imm) {
-    char *endptr;
-    long value;
+const InstructionDef *instruction_row(InstructionType type, uint32_t opcode, uint32_t funct) {
+    if (opcode > 63 || funct > 63) return NULL;
+    const InstructionDef *def = decode_instruction(opcode << 26 | funct);
+    return def && def->type == type ? def : NULL;
+}
 
-    if (strncmp(imm, "0x", 2) == 0) {
-        value = strtol(imm, &endptr, 16);
-    } else if (strncmp(imm, "0b", 2) == 0) {
-        value = strtol(imm, &endptr, 2);
-    } else {
-        value = strtol(imm, &endptr, 10);
-    }
+int is_valid_register(const char *reg) {
+    return parse_register(reg) >= 0;
+}
 
-    if (*endptr != '\0') return 0;
+int parse_register(const char *reg) {
+    return lexer_parse_register(reg, strlen(reg));
+}
+
+int16_t parse_immediate(const char *imm) {
+    int64_t value;
+    if (!lexer_parse_number(imm, strlen(imm), &value)) return 0;
     return (int16_t) value;
 }
 
 uint32_t parse_address(const char *addr) {
-    char *endptr;
-    unsigned long value;
-
-    if (strncmp(addr, "0x", 2) == 0) {
-        value = strtoul(addr, &endptr, 16);
-    } else {
-        value = strtoul(addr, &endptr, 10);
-    }
-
-    if (*endptr != '\0') return 0;
+    int64_t value;
+    if (!lexer_parse_number(addr, strlen(addr), &value)) return 0;
     return (uint32_t) value;
 }
 
@@ -145,133 +111,171 @@ bool is_label_reference(const char *token) {
     return true;
 }
 
-static Instruction parse_r_type(const InstructionDef *def, char *tokens[], int token_count) {
-    Instruction inst = {0};
-    inst.type = R_TYPE;
-    inst.data.r.opcode = def->opcode;
-    inst.data.r.funct = def->funct;
+// Unknown registers decode to -1, which lands as 0xFF in the field and is rejected by validation.
+static uint8_t register_operand(const Token *token) {
+    return token->kind == TOKEN_REGISTER ? (uint8_t) token->value : 0xFF;
+}
+
+static void set_label_ref(Instruction *inst, const Token *token) {
+    inst->label_ref = token->start;
+    inst->label_length = token->length;
+}
+
+static bool fits_immediate(int64_t value) {
+    return value >= INT16_MIN && value <= INT16_MAX;
+}
+
+// One parser per operand format; each returns an instruction with type -1 when the operands do not fit,
+// setting *result only when the reason is more specific than PARSE_ERROR_MALFORMED.
+typedef Instruction (*OperandParser)(const InstructionDef *def, const Token tokens[], uint32_t token_count,
+                                     ParseResult *result);
+
+static Instruction parse_register_operands(const InstructionDef *def, const Token tokens[], uint32_t token_count,
+                                           ParseResult *result) {
+    (void) result;
+    Instruction inst = {.type = -1};
 
     if (token_count != 4) {
-        inst.type = R_TYPE;
         return inst;
     }
 
-    inst.data.r.rd = parse_register(tokens[1]);
-    inst.data.r.rs = parse_register(tokens[2]);
-    inst.data.r.rt = parse_register(tokens[3]);
+    inst.type = R_TYPE;
+    inst.data.r.opcode = def->opcode;
+    inst.data.r.funct = def->funct;
+    inst.data.r.rd = register_operand(&tokens[1]);
+    inst.data.r.rs = register_operand(&tokens[2]);
+    inst.data.r.rt = register_operand(&tokens[3]);
     inst.data.r.shamt = 0;
 
     return inst;
 }
 
-static Instruction parse_i_type(const InstructionDef *def, char *tokens[], int token_count) {
-    Instruction inst = {0};
+static Instruction parse_immediate_operands(const InstructionDef *def, const Token tokens[], uint32_t token_count,
+                                            ParseResult *result) {
+    Instruction inst = {.type = -1};
+
+    if (token_count != 4 || tokens[3].kind != TOKEN_NUMBER) {
+        return inst;
+    }
+    if (!fits_immediate(tokens[3].value)) {
+        *result = PARSE_ERROR_IMMEDIATE;
+        return inst;
+    }
+
     inst.type = I_TYPE;
     inst.data.i.opcode = def->opcode;
+    inst.data.i.rt = register_operand(&tokens[1]);
+    inst.data.i.rs = register_operand(&tokens[2]);
+    inst.data.i.immediate = (int16_t) tokens[3].value;
 
-    if (strcmp(def->name, "lw") == 0 || strcmp(def->name, "sw") == 0 || strcmp(def->name, "lh") == 0 ||
-        strcmp(def->name, "sh") == 0 || strcmp(def->name, "lb") == 0 || strcmp(def->name, "sb") == 0) {
-        if (token_count != 3) {
-            return inst;
-        }
-
-        inst.data.i.rt = parse_register(tokens[1]);
+    return inst;
+}
 
-        char *paren = strchr(tokens[2], '(');
-        if (paren) {
-            *paren = '\0';
-            int16_t imm = parse_immediate(tokens[2]);
-            if (imm % 4 != 0) return inst;
-            inst.data.i.immediate = imm;
+static Instruction parse_memory_operands(const InstructionDef *def, const Token tokens[], uint32_t token_count,
+                                         ParseResult *result) {
+    Instruction inst = {.type = -1};
 
+    // rt, label or rt, label(rs): the label's address is the offset.
+    if (token_count == 3 && (tokens[2].kind == TOKEN_IDENTIFIER || tokens[2].kind == TOKEN_LABEL_MEMORY)) {
+        inst.type = I_TYPE;
+        inst.data.i.opcode = def->opcode;
+        inst.data.i.rt = register_operand(&tokens[1]);
+        inst.data.i.rs = tokens[2].kind == TOKEN_LABEL_MEMORY ? (uint8_t) tokens[2].base : 0;
+        inst.label_ref = tokens[2].start;
+        inst.label_length = tokens[2].kind == TOKEN_LABEL_MEMORY ? (uint32_t) tokens[2].value : tokens[2].length;
+        return inst;
+    }
+    if (token_count != 3 || tokens[2].kind != TOKEN_MEMORY) {
+        return inst;
+    }
+    if (!fits_immediate(tokens[2].value)) {
+        *result = PARSE_ERROR_IMMEDIATE;
+        return inst;
+    }
+    // The offset has to keep an aligned base aligned for the access width.
+    int16_t imm = (int16_t) tokens[2].value;
+    if (imm % def->width != 0) {
+        return inst;
+    }
 
-            char *reg_start = paren + 1;
-            char *close_paren = strchr(reg_start, ')');
-            if (close_paren) *close_paren = '\0';
-            inst.data.i.rs = parse_register(reg_start);
-        }
-    } else if (strcmp(def->name, "beq") == 0 || strcmp(def->name, "bneq") == 0 ||
-               strcmp(def->name, "bltz") == 0 || strcmp(def->name, "bgtz") == 0 ||
-               strcmp(def->name, "blt") == 0 || strcmp(def->name, "bgt") == 0) {
-        if (token_count != 4) {
-            inst.type = I_TYPE;
-            return inst;
-        }
+    inst.type = I_TYPE;
+    inst.data.i.opcode = def->opcode;
+    inst.data.i.rt = register_operand(&tokens[1]);
+    inst.data.i.rs = (uint8_t) tokens[2].base;
+    inst.data.i.immediate = imm;
 
-        inst.data.i.rs = parse_register(tokens[1]);
-        inst.data.i.rt = parse_register(tokens[2]);
+    return inst;
+}
 
-        if (is_label_reference(tokens[3])) {
-            strncpy(inst.label_ref, tokens[3], sizeof(inst.label_ref) - 1);
-            inst.label_ref[sizeof(inst.label_ref) - 1] = '\0';
-            inst.data.i.immediate = 0;
-        } else {
-            inst.type = -1;
-            return inst;
-        }
-    } else {
-        if (token_count != 4) {
-            inst.type = I_TYPE;
-            return inst;
-        }
+static Instruction parse_branch_operands(const InstructionDef *def, const Token tokens[], uint32_t token_count,
+                                         ParseResult *result) {
+    (void) result;
+    Instruction inst = {.type = -1};
 
-        inst.data.i.rt = parse_register(tokens[1]);
-        inst.data.i.rs = parse_register(tokens[2]);
-        inst.data.i.immediate = parse_immediate(tokens[3]);
+    if (token_count != 4 || tokens[3].kind != TOKEN_IDENTIFIER) {
+        return inst;
     }
 
+    inst.type = I_TYPE;
+    inst.data.i.opcode = def->opcode;
+    inst.data.i.rs = register_operand(&tokens[1]);
+    inst.data.i.rt = register_operand(&tokens[2]);
+    set_label_ref(&inst, &tokens[3]);
+    inst.data.i.immediate = 0;
+
     return inst;
 }
 
-static Instruction parse_j_type(const InstructionDef *def, char *tokens[], int token_count) {
-    Instruction inst = {0};
-    inst.type = J_TYPE;
-    inst.data.j.opcode = def->opcode;
+static Instruction parse_jump_operands(const InstructionDef *def, const Token tokens[], uint32_t token_count,
+                                       ParseResult *result) {
+    (void) result;
+    Instruction inst = {.type = -1};
 
     if (token_count != 2) {
-        inst.type = J_TYPE;
         return inst;
     }
 
-    if (is_label_reference(tokens[1])) {
-        strncpy(inst.label_ref, tokens[1], sizeof(inst.label_ref) - 1);
-        inst.label_ref[sizeof(inst.label_ref) - 1] = '\0';
+    inst.type = J_TYPE;
+    inst.data.j.opcode = def->opcode;
+
+    if (tokens[1].kind == TOKEN_IDENTIFIER) {
+        set_label_ref(&inst, &tokens[1]);
         inst.data.j.address = 0;
+    } else if (tokens[1].kind == TOKEN_NUMBER) {
+        inst.data.j.address = (uint32_t) tokens[1].value;
     } else {
-        inst.data.j.address = parse_address(tokens[1]);
+        inst.type = -1;
     }
 
     return inst;
 }
 
-Instruction parse_instruction(const char *line) {
-    Instruction inst = {.type = -1};
-    char buffer[256];
-    strncpy(buffer, line, sizeof(buffer) - 1);
-    buffer[sizeof(buffer) - 1] = '\0';
+static const OperandParser operand_parsers[] = {
+    [OPERANDS_REGISTER] = parse_register_operands, [OPERANDS_IMMEDIATE] = parse_immediate_operands,
+    [OPERANDS_MEMORY] = parse_memory_operands,     [OPERANDS_BRANCH] = parse_branch_operands,
+    [OPERANDS_JUMP] = parse_jump_operands,
+};
 
-    char *tokens[10];
-    int token_count = 0;
+Instruction parse_source_line(const SourceLine *line, ParseResult *result) {
+    Instruction inst = {.type = -1};
+    ParseResult reason = PARSE_ERROR_MALFORMED;
 
-    char *token = strtok(buffer, " \t\n\r,");
-    while (token && token_count < 10) {
-        tokens[token_count++] = token;
-        token = strtok(NULL, " \t\n\r,");
+    const InstructionDef *def = NULL;
+    if (line->token_count > 0 && line->tokens[0].kind == TOKEN_IDENTIFIER) {
+        def = find_instruction(line->tokens[0].start, line->tokens[0].length);
     }
+    if (def) inst = operand_parsers[def->format](def, line->tokens, line->token_count, &reason);
+    if ((int) inst.type != -1) reason = PARSE_OK;
+    if (result) *result = reason;
+    return inst;
+}
 
-    if (token_count == 0) return inst;
-
-    const InstructionDef *def = find_instruction(tokens[0]);
-    if (!def) return inst;
+Instruction parse_instruction(const char *line) {
+    Instruction inst = {.type = -1};
+    Lexer lexer;
+    SourceLine source_line;
 
-    switch (def->type) {
-        case R_TYPE:
-            return parse_r_type(def, tokens, token_count);
-        case I_TYPE:
-            return parse_i_type(def, tokens, token_count);
-        case J_TYPE:
-            return parse_j_type(def, tokens, token_count);
-        default:
-            return inst;
-    }
+    lexer_init(&lexer, line, strlen(line));
+    if (!lexer_next_line(&lexer, &source_line)) return inst;
+    return parse_source_line(&source_line, NULL);
 }
@@ -1,4 +1,7 @@
 #pragma once
+#include "isa.h"
+#include "lexer.h"
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -8,6 +11,14 @@ typedef enum {
     J_TYPE
 } InstructionType;
 
+typedef enum {
+    OPERANDS_REGISTER,  // rd, rs, rt
+    OPERANDS_IMMEDIATE, // rt, rs, immediate
+    OPERANDS_MEMORY,    // rt, offset(rs)
+    OPERANDS_BRANCH,    // rs, rt, label
+    OPERANDS_JUMP       // label or address
+} OperandFormat;
+
 typedef struct {
     uint8_t opcode;
     uint8_t rs;
@@ -31,7 +42,8 @@ typedef struct {
 
 typedef struct {
     InstructionType type;
-    char label_ref[256];
+    const char *label_ref; // span into the source text, NULL when no label is referenced
+    uint32_t label_length;
 
     union {
         RTypeInstruction r;
@@ -43,12 +55,35 @@ typedef struct {
 typedef struct {
     const char *name;
     InstructionType type;
+    OperandFormat format;
     uint8_t opcode;
     uint8_t funct;
+    uint8_t width; // bytes moved by a memory access, whose offset must be a multiple of it; 1 otherwise
 } InstructionDef;
 
+// Why parse_source_line gave an instruction of type -1.
+typedef enum {
+    PARSE_OK,
+    PARSE_ERROR_MALFORMED, // unknown mnemonic, or operands that do not fit its format
+    PARSE_ERROR_IMMEDIATE, // an immediate or memory offset outside the signed 16-bit field
+} ParseResult;
+
 Instruction parse_instruction(const char *line);
 
+// Parses an instruction line; the result has type -1 when it is not one, and *result, unless NULL, says why.
+Instruction parse_source_line(const SourceLine *line, ParseResult *result);
+
+const InstructionDef *find_instruction(const char *name, size_t length);
+
+const InstructionDef *instruction_def(IsaRow row);
+
+// The definition an encoded word was assembled from, or NULL when its opcode and funct match none.
+const InstructionDef *decode_instruction(uint32_t word);
+
+// The row of the given type that opcode and, for R-type, funct select, or NULL; what the validators check
+// fields against.
+const InstructionDef *instruction_row(InstructionType type, uint32_t opcode, uint32_t funct);
+
 int is_valid_register(const char *reg);
 
 int parse_register(const char *reg);
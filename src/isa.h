@@ -0,0 +1,55 @@
+#pragma once
+
+// The instruction set, one row per mnemonic. Every table that depends on it is generated from this list:
+// instruction_table with its mnemonic and decode tables in instruction.c, the validators' opcode, funct and
+// offset rules, the OPCODE_ and FUNCT_ constants below and the simulator's micro-op kinds, so adding an
+// instruction is one new row here plus whatever the simulator and passes need to know about what it does.
+//
+//   R_ROW(NAME, "name", funct)                  register operands, opcode 0
+//   I_ROW(NAME, "name", format, opcode, width)  OPERANDS_<format>; width is the bytes a memory access moves,
+//                                               which its offset must be a multiple of, else 1
+//   J_ROW(NAME, "name", opcode)                 a label or an address
+//
+// The decode tables are indexed by opcode and funct, so two rows sharing one would silently shadow each
+// other; the library builds with -Werror=override-init, which turns that into a compile error.
+#define ISA_INSTRUCTIONS(R_ROW, I_ROW, J_ROW) \
+    R_ROW(ADD, "add", 0x01)                   \
+    R_ROW(SUB, "sub", 0x02)                   \
+    R_ROW(AND, "and", 0x03)                   \
+    R_ROW(OR, "or", 0x04)                     \
+    R_ROW(XOR, "xor", 0x05)                   \
+    R_ROW(SLL, "sll", 0x06)                   \
+    R_ROW(SRL, "srl", 0x07)                   \
+    R_ROW(SRA, "sra", 0x08)                   \
+    R_ROW(JR, "jr", 0x09)                     \
+    I_ROW(ADDI, "addi", IMMEDIATE, 0x01, 1)   \
+    I_ROW(BEQ, "beq", BRANCH, 0x02, 1)        \
+    I_ROW(BNEQ, "bneq", BRANCH, 0x03, 1)      \
+    I_ROW(BLTZ, "bltz", BRANCH, 0x04, 1)      \
+    I_ROW(BGTZ, "bgtz", BRANCH, 0x05, 1)      \
+    I_ROW(BLT, "blt", BRANCH, 0x06, 1)        \
+    I_ROW(BGT, "bgt", BRANCH, 0x07, 1)        \
+    I_ROW(LW, "lw", MEMORY, 0x08, 4)          \
+    I_ROW(SW, "sw", MEMORY, 0x09, 4)          \
+    I_ROW(LH, "lh", MEMORY, 0x0A, 2)          \
+    I_ROW(SH, "sh", MEMORY, 0x0B, 2)          \
+    I_ROW(LB, "lb", MEMORY, 0x0D, 1)          \
+    I_ROW(SB, "sb", MEMORY, 0x0E, 1)          \
+    J_ROW(J, "j", 0x3F)                       \
+    J_ROW(JAL, "jal", 0x3E)
+
+#define ISA_IGNORE_R(NAME, name, funct)
+#define ISA_IGNORE_I(NAME, name, format, opcode, width)
+#define ISA_IGNORE_J(NAME, name, opcode)
+
+// Rows of instruction_table, in the order above.
+#define ISA_ENUM_R(NAME, name, funct) ISA_ROW_##NAME,
+#define ISA_ENUM_I(NAME, name, format, opcode, width) ISA_ROW_##NAME,
+#define ISA_ENUM_J(NAME, name, opcode) ISA_ROW_##NAME,
+typedef enum { ISA_INSTRUCTIONS(ISA_ENUM_R, ISA_ENUM_I, ISA_ENUM_J) ISA_ROW_COUNT } IsaRow;
+
+#define ISA_FUNCT(NAME, name, funct) FUNCT_##NAME = funct,
+#define ISA_OPCODE_I(NAME, name, format, opcode, width) OPCODE_##NAME = opcode,
+#define ISA_OPCODE_J(NAME, name, opcode) OPCODE_##NAME = opcode,
+enum { ISA_INSTRUCTIONS(ISA_FUNCT, ISA_IGNORE_I, ISA_IGNORE_J) };
+enum { ISA_INSTRUCTIONS(ISA_IGNORE_R, ISA_OPCODE_I, ISA_OPCODE_J) };
@@ -0,0 +1,305 @@
+#include "lexer.h"
+
+#include <string.h>
+
+// Every byte is classified once through this table; the scanners below are the DFA states and each
+// one both finds the end of its token and decodes its value, so no byte is visited twice.
+typedef enum {
+    CHAR_OTHER = 0,
+    CHAR_SPACE,   // blanks and commas separate operands
+    CHAR_NEWLINE,
+    CHAR_COMMENT, // '#' and ';' run to the end of the line
+    CHAR_DIGIT,
+    CHAR_ALPHA,   // letters, '_' and '.'
+    CHAR_DOLLAR,
+    CHAR_SIGN,
+    CHAR_LPAREN,
+    CHAR_RPAREN,
+    CHAR_COLON,
+} CharClass;
+
+#define O CHAR_OTHER
+#define S CHAR_SPACE
+#define N CHAR_NEWLINE
+#define C CHAR_COMMENT
+#define D CHAR_DIGIT
+#define A CHAR_ALPHA
+#define R CHAR_DOLLAR
+#define P CHAR_SIGN
+#define L CHAR_LPAREN
+#define E CHAR_RPAREN
+#define K CHAR_COLON
+
+static const uint8_t char_class[256] = {
+    O, O, O, O, O, O, O, O, O, S, N, S, S, S, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    S, O, O, C, R, O, O, O, L, E, O, P, S, P, A, O,
+    D, D, D, D, D, D, D, D, D, D, K, C, O, O, O, O,
+    O, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A, A, A, A, O, O, O, O, A,
+    O, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+    A, A, A, A, A, A, A, A, A, A, A, O, O, O, O, O,
+};
+
+#undef O
+#undef S
+#undef N
+#undef C
+#undef D
+#undef A
+#undef R
+#undef P
+#undef L
+#undef E
+#undef K
+
+#define CLASS_OF(c) ((CharClass) char_class[(uint8_t) (c)])
+
+static bool ends_token(const char *p, const char *end) {
+    if (p >= end) return true;
+    CharClass class = CLASS_OF(*p);
+    return class == CHAR_SPACE || class == CHAR_NEWLINE || class == CHAR_COMMENT;
+}
+
+#define PACK2(a, b) ((uint32_t) (a) | (uint32_t) (b) << 8)
+#define PACK4(a, b, c, d) (PACK2(a, b) | PACK2(c, d) << 16)
+
+static int register_number(uint32_t prefix, uint32_t prefix_length, uint32_t index, uint32_t digit_count) {
+    if (digit_count == 0) {
+        if (prefix_length == 4 && prefix == PACK4('z', 'e', 'r', 'o')) return 0;
+        if (prefix_length == 2 && prefix == PACK2('a', 't')) return 8;
+        if (prefix_length == 2 && prefix == PACK2('s', 'p')) return 29;
+        if (prefix_length == 2 && prefix == PACK2('r', 'a')) return 31;
+        return -1;
+    }
+    if (prefix_length != 1) return -1;
+
+    switch (prefix) {
+        case 'v':
+            return index <= 1 ? (int) index + 1 : -1;
+        case 'a':
+            return index <= 4 ? (int) index + 3 : -1;
+        case 'r':
+            return index <= 15 ? (int) index + 9 : -1;
+        case 's':
+            return index <= 4 ? (int) index + 23 : -1;
+        default:
+            return -1;
+    }
+}
+
+// p points just past the '$'.
+static const char *scan_register(const char *p, const char *end, int64_t *number) {
+    uint32_t prefix = 0;
+    uint32_t prefix_length = 0;
+    while (p < end && CLASS_OF(*p) == CHAR_ALPHA) {
+        if (prefix_length < 4) prefix |= (uint32_t) (uint8_t) *p << (8 * prefix_length);
+        prefix_length++;
+        p++;
+    }
+
+    uint32_t index = 0;
+    uint32_t digit_count = 0;
+    while (p < end && CLASS_OF(*p) == CHAR_DIGIT) {
+        if (index < 1000) index = index * 10 + (uint32_t) (*p - '0');
+        digit_count++;
+        p++;
+    }
+
+    *number = register_number(prefix, prefix_length, index, digit_count);
+    return p;
+}
+
+static uint32_t digit_value(char c) {
+    if (c >= '0' && c <= '9') return (uint32_t) (c - '0');
+    c = (char) (c | 0x20);
+    if (c >= 'a' && c <= 'f') return (uint32_t) (c - 'a' + 10);
+    return 16;
+}
+
+// Returns NULL when the literal has no digits or does not fit in 63 bits.
+static const char *scan_number(const char *p, const char *end, int64_t *value) {
+    bool negative = false;
+    if (p < end && CLASS_OF(*p) == CHAR_SIGN) {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint32_t base = 10;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    } else if (end - p > 2 && p[0] == '0' && (p[1] == 'b' || p[1] == 'B')) {
+        base = 2;
+        p += 2;
+    }
+
+    const char *digits = p;
+    uint64_t magnitude = 0;
+    for (; p < end; p++) {
+        uint32_t digit = digit_value(*p);
+        if (digit >= base) break;
+        if (magnitude > ((uint64_t) INT64_MAX - digit) / base) return NULL;
+        magnitude = magnitude * base + digit;
+    }
+    if (p == digits) return NULL;
+
+    *value = negative ? -(int64_t) magnitude : (int64_t) magnitude;
+    return p;
+}
+
+// p points at the '('; on success the token becomes a TOKEN_MEMORY operand.
+static const char *scan_base_register(const char *p, const char *end, Token *token) {
+    p++;
+    if (p >= end || CLASS_OF(*p) != CHAR_DOLLAR) return NULL;
+
+    int64_t base;
+    p = scan_register(p + 1, end, &base);
+    if (p >= end || CLASS_OF(*p) != CHAR_RPAREN) return NULL;
+
+    token->kind = TOKEN_MEMORY;
+    token->base = (int32_t) base;
+    return p + 1;
+}
+
+static const char *scan_token(const char *p, const char *end, Token *token) {
+    token->start = p;
+    token->base = -1;
+    token->value = 0;
+
+    switch (CLASS_OF(*p)) {
+        case CHAR_DOLLAR:
+            token->kind = TOKEN_REGISTER;
+            return scan_register(p + 1, end, &token->value);
+        case CHAR_ALPHA: {
+            token->kind = TOKEN_IDENTIFIER;
+            while (p < end && (CLASS_OF(*p) == CHAR_ALPHA || CLASS_OF(*p) == CHAR_DIGIT)) p++;
+            if (p >= end || CLASS_OF(*p) != CHAR_LPAREN) return p;
+
+            token->value = p - token->start;
+            const char *next = scan_base_register(p, end, token);
+            if (!next) break;
+            token->kind = TOKEN_LABEL_MEMORY;
+            return next;
+        }
+        case CHAR_DIGIT:
+        case CHAR_SIGN: {
+            const char *next = scan_number(p, end, &token->value);
+            if (!next) break;
+            token->kind = TOKEN_NUMBER;
+            if (next < end && CLASS_OF(*next) == CHAR_LPAREN) {
+                next = scan_base_register(next, end, token);
+                if (!next) break;
+            }
+            return next;
+        }
+        case CHAR_LPAREN: {
+            const char *next = scan_base_register(p, end, token);
+            if (!next) break;
+            return next;
+        }
+        default:
+            break;
+    }
+
+    token->kind = TOKEN_INVALID;
+    return p;
+}
+
+void lexer_init(Lexer *lexer, const char *data, size_t size) {
+    lexer->cursor = data;
+    lexer->end = data + size;
+    lexer->line_number = 0;
+}
+
+bool lexer_next_line(Lexer *lexer, SourceLine *line) {
+    const char *p = lexer->cursor;
+    const char *end = lexer->end;
+    if (p >= end) return false;
+
+    line->text = p;
+    line->line_number = ++lexer->line_number;
+    line->label = NULL;
+    line->label_length = 0;
+    line->token_count = 0;
+
+    while (p < end) {
+        CharClass class = CLASS_OF(*p);
+        if (class == CHAR_SPACE) {
+            p++;
+            continue;
+        }
+        if (class == CHAR_NEWLINE) break;
+        if (class == CHAR_COMMENT) {
+            const char *newline = memchr(p, '\n', (size_t) (end - p));
+            p = newline ? newline : end;
+            break;
+        }
+
+        Token token;
+        const char *next = scan_token(p, end, &token);
+
+        if (token.kind == TOKEN_IDENTIFIER && line->token_count == 0 && !line->label &&
+            next < end && CLASS_OF(*next) == CHAR_COLON) {
+            line->label = p;
+            line->label_length = (uint32_t) (next - p);
+            p = next + 1;
+            continue;
+        }
+
+        if (!ends_token(next, end)) {
+            token.kind = TOKEN_INVALID;
+            while (!ends_token(next, end)) next++;
+        }
+        token.length = (uint32_t) (next - p);
+
+        if (line->token_count < LEXER_MAX_TOKENS) {
+            line->tokens[line->token_count] = token;
+        }
+        line->token_count++;
+        p = next;
+    }
+
+    const char *line_end = p;
+    while (line_end > line->text && line_end[-1] == '\r') line_end--;
+    line->length = (uint32_t) (line_end - line->text);
+    lexer->cursor = p < end ? p + 1 : end;
+    return true;
+}
+
+bool lexer_is_directive(const SourceLine *line) {
+    return line->token_count > 0 && line->tokens[0].kind == TOKEN_IDENTIFIER && line->tokens[0].start[0] == '.';
+}
+
+bool lexer_scan_token(const SourceLine *line, const char **cursor, Token *token) {
+    const char *p = *cursor;
+    const char *end = line->text + line->length;
+    while (p < end && CLASS_OF(*p) == CHAR_SPACE) p++;
+    if (p >= end || CLASS_OF(*p) == CHAR_COMMENT) {
+        *cursor = end;
+        return false;
+    }
+
+    const char *next = scan_token(p, end, token);
+    if (!ends_token(next, end)) {
+        token->kind = TOKEN_INVALID;
+        while (!ends_token(next, end)) next++;
+    }
+    token->length = (uint32_t) (next - p);
+    *cursor = next;
+    return true;
+}
+
+int lexer_parse_register(const char *text, size_t length) {
+    const char *end = text + length;
+    if (length == 0 || CLASS_OF(*text) != CHAR_DOLLAR) return -1;
+
+    int64_t number;
+    if (scan_register(text + 1, end, &number) != end) return -1;
+    return (int) number;
+}
+
+bool lexer_parse_number(const char *text, size_t length, int64_t *value) {
+    const char *end = text + length;
+    return length > 0 && scan_number(text, end, value) == end;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    TOKEN_IDENTIFIER,   // mnemonic or label reference
+    TOKEN_REGISTER,     // value holds the register number, -1 if the name is unknown
+    TOKEN_NUMBER,       // value holds the decoded decimal, 0x hex or 0b binary literal
+    TOKEN_MEMORY,       // offset(base): value holds the offset, base the register number
+    TOKEN_LABEL_MEMORY, // label(base): value holds the label's length, base the register number
+    TOKEN_INVALID
+} TokenKind;
+
+typedef struct {
+    const char *start;
+    uint32_t length;
+    TokenKind kind;
+    int32_t base;
+    int64_t value;
+} Token;
+
+#define LEXER_MAX_TOKENS 8
+
+typedef struct {
+    const char *text;  // the whole line, without its line terminator
+    uint32_t length;
+    uint32_t line_number;
+    const char *label; // label defined at the start of the line, or NULL
+    uint32_t label_length;
+    Token tokens[LEXER_MAX_TOKENS];
+    uint32_t token_count; // counts every token, even those past LEXER_MAX_TOKENS that were not stored
+} SourceLine;
+
+typedef struct {
+    const char *cursor;
+    const char *end;
+    uint32_t line_number;
+} Lexer;
+
+void lexer_init(Lexer *lexer, const char *data, size_t size);
+
+bool lexer_next_line(Lexer *lexer, SourceLine *line);
+
+// Whether the line is an assembler directive such as .globl rather than an instruction.
+bool lexer_is_directive(const SourceLine *line);
+
+// Scans the line's next token at or after *cursor, a position in line->text, and moves *cursor past it.
+// For directives whose operands can outnumber LEXER_MAX_TOKENS; returns false at the end of the line.
+bool lexer_scan_token(const SourceLine *line, const char **cursor, Token *token);
+
+int lexer_parse_register(const char *text, size_t length);
+
+bool lexer_parse_number(const char *text, size_t length, int64_t *value);
@@ -1,121 +1,547 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "instruction.h"
 #include "assembler.h"
+#include "batch.h"
+#include "diagnostics.h"
+#include "disassembler.h"
+#include "lexer.h"
+#include "object.h"
+#include "optimizer.h"
+#include "output.h"
+#include "parallel.h"
+#include "profile.h"
+#include "schedule.h"
+#include "source.h"
+#include "thread_pool.h"
 
-#define MAX_LINE_LENGTH 256
+#define STREAM_READ_SIZE 65536
+#define STREAM_FLUSH_WORDS 65536
 
-char *instruction_to_str(uint32_t instruction) {
-    char *line = malloc(33);
-    for (int i = 0; i < 32; i++) {
-        line[i] = instruction & (1 << (31 - i)) ? '1' : '0';
+static void assemble_lines(Assembler *assembler, Lexer *lexer) {
+    SourceLine line;
+    while (lexer_next_line(lexer, &line)) {
+        if (line.label) {
+            diag_trace("line %u: label %.*s at instruction %u", line.line_number, (int) line.label_length,
+                       line.label, assembler->instruction_count);
+            assembler_set_location(assembler, line.line_number, (uint32_t) (line.label - line.text) + 1);
+            assembler_add_label_span(assembler, line.label, line.label_length, assembler_location(assembler));
+        }
+        if (line.token_count == 0) {
+            continue;
+        }
+
+        diag_trace("line %u: %.*s", line.line_number, (int) line.length, line.text);
+        assembler_set_location(assembler, line.line_number, (uint32_t) (line.tokens[0].start - line.text) + 1);
+        assembler_add_statement(assembler, &line);
+    }
+}
+
+static bool assemble_serial(Assembler *assembler, const SourceFile *source, bool one_pass) {
+    Lexer lexer;
+    assembler_set_one_pass(assembler, one_pass);
+    lexer_init(&lexer, source->data, source->size);
+    assemble_lines(assembler, &lexer);
+    assembler_set_location(assembler, 0, 0);
+    return true;
+}
+
+static bool assemble_parallel(Assembler *assembler, const SourceFile *source, uint32_t thread_count) {
+    ThreadPool *pool = thread_pool_create(thread_count);
+    if (!pool) {
+        diag_error("failed to create thread pool");
+        return false;
+    }
+
+    assembler_assemble_parallel(assembler, pool, source->data, source->size);
+    thread_pool_destroy(pool);
+    return true;
+}
+
+// Lays the program out by the -P profile at profile_path, read against the program as assembled.
+static bool apply_profile(Assembler *assembler, const char *profile_path) {
+    SourceFile profile_source;
+    if (!source_open(profile_path, &profile_source)) {
+        diag_error("failed to open profile: %s", profile_path);
+        return false;
+    }
+    Profile profile;
+    uint32_t line;
+    const char *message;
+    bool parsed = profile_parse(&profile, assembler, profile_source.data, profile_source.size, &line, &message);
+    source_close(&profile_source);
+    if (!parsed) {
+        diag_error("%s:%u: %s", profile_path, line, message);
+        return false;
+    }
+
+    ProfileLayoutStats layout;
+    if (optimizer_profile_layout(assembler, profile.counts, &layout) == ASSEMBLER_SUCCESS) {
+        diag_info("profile layout moved %u blocks, inverted %u branches, added %u jumps and removed %u",
+                  layout.moved, layout.inverted, layout.inserted_jumps, layout.removed_jumps);
+    }
+    profile_free(&profile);
+    return true;
+}
+
+// Runs the -O passes over a two-pass assembler's program before its labels are resolved, starting with the
+// profile-guided layout when profile_path is given.
+static bool optimize_program(Assembler *assembler, const PipelineModel *model, const char *profile_path) {
+    if (profile_path && !apply_profile(assembler, profile_path)) return false;
+    ControlFlowStats control_flow;
+    if (optimizer_control_flow(assembler, !profile_path, &control_flow) == ASSEMBLER_SUCCESS) {
+        diag_info("control-flow pass threaded %u references, removed %u unreachable instructions and %u jumps",
+                  control_flow.threaded, control_flow.unreachable, control_flow.removed_jumps);
+    }
+    PeepholeStats peephole;
+    if (optimizer_peephole(assembler, &peephole) == ASSEMBLER_SUCCESS) {
+        diag_info("peephole pass removed %u instructions, folding %u addi pairs", peephole.removed, peephole.folded);
+    }
+    ScheduleStats schedule;
+    if (schedule_program(assembler, model, &schedule) == ASSEMBLER_SUCCESS) {
+        diag_info("scheduler moved %u instructions, estimated cycles %llu -> %llu", schedule.moved,
+                  (unsigned long long) schedule.cycles_before, (unsigned long long) schedule.cycles_after);
+    }
+    return true;
+}
+
+// Reads -p alu,load,branch,taken into model; missing trailing fields keep their defaults.
+static bool parse_pipeline_model(const char *text, PipelineModel *model) {
+    uint32_t *fields[] = {&model->alu_latency, &model->load_latency, &model->branch_read_early,
+                          &model->taken_penalty};
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        char *end;
+        unsigned long value = strtoul(text, &end, 10);
+        if (end == text || value > 64 || (i < 2 && value == 0)) return false;
+        *fields[i] = (uint32_t) value;
+        if (*end == '\0') return true;
+        if (*end != ',') return false;
+        text = end + 1;
+    }
+    return false;
+}
+
+static void report_errors(const Assembler *assembler, const char *source_path) {
+    for (uint32_t i = 0; i < assembler->error_count; i++) {
+        const AssemblerError *error = &assembler->errors[i];
+        if (error->line) {
+            diag_error("%s:%u:%u: %s", source_path, error->line, error->column, error->message);
+        } else {
+            diag_error("%s: %s", source_path, error->message);
+        }
+    }
+}
+
+// Writes the words at the start of machine_code that wait on no label and drops them from memory.
+static bool stream_settled(Assembler *assembler) {
+    uint32_t settled = assembler_settled_count(assembler);
+    bool written = output_write_binary(stdout, assembler->machine_code, settled);
+    assembler_discard(assembler, settled);
+    return written;
+}
+
+// Assembles stdin in one pass and writes the binary image to stdout while reading. Whole lines are lexed
+// out of a read buffer that only grows for a line longer than it, and whenever the held words pass the
+// flush threshold the settled ones are written out (see assembler_settled_count for what stays behind).
+// The threshold grows with the words left held, so rescanning for the oldest reference stays linear.
+//
+// Peak memory: let W be the longest distance, in words, from a reference to the label it waits on, where
+// a reference to a .data label waits until the end of the program. After a flush fewer than W words stay
+// held, so the next threshold is at most 2 * max(W, STREAM_FLUSH_WORDS), and one read adds at most
+// STREAM_READ_SIZE words, or the longest line's length if greater, since no statement yields more words
+// than it has bytes. Held words therefore stay below 2 * max(W, STREAM_FLUSH_WORDS) + STREAM_READ_SIZE
+// whatever the program's length; the label table, the pending fixups and .data come on top. The peak is
+// reported at the end, and bench/stream_memory.cmake checks it.
+static int assemble_stream(void) {
+    Assembler *assembler = assembler_create();
+    size_t capacity = STREAM_READ_SIZE;
+    char *buffer = malloc(capacity);
+    if (!assembler || !buffer) {
+        diag_error("failed to create assembler");
+        assembler_destroy(assembler);
+        free(buffer);
+        return 1;
     }
-    line[32] = '\0';
-    return line;
+    assembler_set_one_pass(assembler, true);
+
+    bool io_ok = true;
+    size_t used = 0;
+    uint32_t line_number = 0;
+    uint32_t flush_at = STREAM_FLUSH_WORDS;
+    uint32_t peak_held = 0;
+    for (;;) {
+        size_t read = fread(buffer + used, 1, capacity - used, stdin);
+        used += read;
+        bool end_of_input = read == 0;
+        if (end_of_input && ferror(stdin)) {
+            diag_error("failed to read standard input");
+            io_ok = false;
+            break;
+        }
+
+        size_t lines_end = used;
+        while (!end_of_input && lines_end > 0 && buffer[lines_end - 1] != '\n') lines_end--;
+        if (lines_end == 0 && !end_of_input) {
+            if (used < capacity) continue;
+            char *grown = realloc(buffer, capacity * 2);
+            if (!grown) {
+                diag_error("failed to expand read buffer");
+                io_ok = false;
+                break;
+            }
+            buffer = grown;
+            capacity *= 2;
+            continue;
+        }
+
+        Lexer lexer;
+        lexer_init(&lexer, buffer, lines_end);
+        lexer.line_number = line_number;
+        assemble_lines(assembler, &lexer);
+        line_number = lexer.line_number;
+        memmove(buffer, buffer + lines_end, used - lines_end);
+        used -= lines_end;
+
+        uint32_t held = assembler->instruction_count - assembler->window_start;
+        if (held > peak_held) peak_held = held;
+        if (assembler->error_count == 0 && held >= flush_at) {
+            if (!stream_settled(assembler)) {
+                diag_error("failed to write standard output");
+                io_ok = false;
+                break;
+            }
+            held = assembler->instruction_count - assembler->window_start;
+            flush_at = held + (held > STREAM_FLUSH_WORDS ? held : STREAM_FLUSH_WORDS);
+        }
+        if (end_of_input) break;
+    }
+    free(buffer);
+    assembler_set_location(assembler, 0, 0);
+
+    uint32_t *machine_code = io_ok && assembler->error_count == 0 ? assembler_generate_machine_code(assembler)
+                                                                   : NULL;
+    bool ok = machine_code != NULL;
+    if (io_ok && !machine_code) {
+        report_errors(assembler, "<stdin>");
+    } else if (machine_code) {
+        uint32_t held = assembler->instruction_count - assembler->window_start;
+        ok = output_write_binary(stdout, machine_code, held) && fflush(stdout) == 0;
+        if (!ok) diag_error("failed to write standard output");
+    }
+    if (ok) diag_info("streamed %u words, at most %u held at once", assembler->instruction_count, peak_held);
+
+    assembler_destroy(assembler);
+    return ok ? 0 : 1;
 }
 
-char *instruction_to_binary(uint32_t instruction) {
-    //4 byte instruction
-    char *bytes = malloc(32);
-    for (int i = 0; i < 4; i++) {
-        bytes[i] = (instruction >> i * 8) & (0xFF);
+static int assemble_batch(int count, char *inputs[], uint32_t thread_count) {
+    Batch batch;
+    batch_init(&batch);
+    for (int i = 0; i < count; i++) {
+        bool added = inputs[i][0] == '@' ? batch_add_manifest(&batch, inputs[i] + 1)
+                                         : batch_add_input(&batch, inputs[i]);
+        if (!added) {
+            diag_error("failed to read batch input: %s", inputs[i]);
+            batch_free(&batch);
+            return 1;
+        }
     }
-    return bytes;
+
+    uint32_t failures = batch_run(&batch, thread_count);
+    uint64_t instructions = 0;
+    for (uint32_t i = 0; i < batch.count; i++) {
+        const BatchJob *job = &batch.jobs[i];
+        instructions += job->instruction_count;
+        if (job->failure) {
+            diag_error("%s: %s", job->source_path, job->failure);
+        } else if (job->result != ASSEMBLER_SUCCESS && job->first_error.line) {
+            diag_error("%s:%u:%u: %s (%u errors)", job->source_path, job->first_error.line, job->first_error.column,
+                       job->first_error.message, job->error_count);
+        } else if (job->result != ASSEMBLER_SUCCESS) {
+            diag_error("%s: %s (%u errors)", job->source_path, job->error_count ? job->first_error.message
+                                                                                 : "assembly failed",
+                       job->error_count);
+        }
+    }
+    diag_info("assembled %u files, %u failed, %llu instructions", batch.count - failures, failures,
+              (unsigned long long) instructions);
+
+    batch_free(&batch);
+    return failures > 0 ? 1 : 0;
+}
+
+// Objects keep every reference in the two-pass arrays so the unresolved ones can become relocations.
+static int assemble_object(const char *source_path, const char *object_path, bool optimize,
+                           const PipelineModel *model) {
+    SourceFile assembly_source;
+    if (!source_open(source_path, &assembly_source)) {
+        diag_error("failed to open assembly file: %s", source_path);
+        return 1;
+    }
+    Assembler *assembler = assembler_create();
+    if (!assembler) {
+        diag_error("failed to create assembler");
+        source_close(&assembly_source);
+        return 1;
+    }
+    assemble_serial(assembler, &assembly_source, false);
+    source_close(&assembly_source);
+    if (optimize && assembler->error_count == 0) optimize_program(assembler, model, NULL);
+
+    FILE *object_dest = assembler->error_count == 0 ? fopen(object_path, "wb") : NULL;
+    if (assembler->error_count == 0 && !object_dest) {
+        diag_error("failed to open output file: %s", object_path);
+        assembler_destroy(assembler);
+        return 1;
+    }
+    bool written = object_dest && object_write(assembler, object_dest);
+    if (object_dest) written = fclose(object_dest) == 0 && written;
+    if (!written) {
+        if (assembler->error_count > 0) {
+            report_errors(assembler, source_path);
+            diag_info("assembly failed with %u errors", assembler->error_count);
+        } else {
+            diag_error("failed to write output file: %s", object_path);
+        }
+        if (object_dest) remove(object_path);
+        assembler_destroy(assembler);
+        return 1;
+    }
+    diag_info("assembled %u instructions into %s", assembler->instruction_count, object_path);
+
+    assembler_destroy(assembler);
+    return 0;
+}
+
+// The binary is mapped and decoded in place; only big-endian hosts need a byte-swapped copy.
+static int disassemble_binary(const char *binary_path, const char *assembly_path) {
+    SourceFile binary_source;
+    if (!source_open(binary_path, &binary_source)) {
+        diag_error("failed to open binary file: %s", binary_path);
+        return 1;
+    }
+    if (binary_source.size % sizeof(uint32_t) != 0 || binary_source.size / sizeof(uint32_t) > UINT32_MAX) {
+        diag_error("not a binary image: %s", binary_path);
+        source_close(&binary_source);
+        return 1;
+    }
+    uint32_t count = (uint32_t) (binary_source.size / sizeof(uint32_t));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const uint32_t *machine_code = (const uint32_t *) binary_source.data;
+    uint32_t *copy = NULL;
+#else
+    uint32_t *copy = malloc(sizeof(uint32_t) * ((size_t) count + 1));
+    const uint32_t *machine_code = copy;
+    const uint8_t *bytes = (const uint8_t *) binary_source.data;
+    for (uint32_t i = 0; copy && i < count; i++) {
+        copy[i] = (uint32_t) bytes[4 * i] | (uint32_t) bytes[4 * i + 1] << 8 | (uint32_t) bytes[4 * i + 2] << 16 |
+                  (uint32_t) bytes[4 * i + 3] << 24;
+    }
+#endif
+
+    FILE *assembly_dest = fopen(assembly_path, "w");
+    if (!assembly_dest) {
+        diag_error("failed to open output file: %s", assembly_path);
+        free(copy);
+        source_close(&binary_source);
+        return 1;
+    }
+    bool written = machine_code && disassembler_write(assembly_dest, machine_code, count);
+    written = fclose(assembly_dest) == 0 && written;
+    free(copy);
+    source_close(&binary_source);
+    if (!written) {
+        diag_error("failed to write output file: %s", assembly_path);
+        return 1;
+    }
+    diag_info("disassembled %u instructions", count);
+    return 0;
+}
+
+// Closes the listing and binary outputs on a failure path; what was written to them is incomplete anyway.
+static void close_outputs(FILE *listing, FILE *binary) {
+    fclose(listing);
+    fclose(binary);
+}
+
+static void print_usage(const char *program) {
+    printf("Usage: %s [-q | -v] [-O [-p model] [-P profile]] [-j threads] <assembly_file> <output_file> "
+           "<binary_output_file>\n"
+           "       %s -c [-q | -v] [-O [-p model]] <assembly_file> <object_file>\n"
+           "       %s -d [-q | -v] <binary_file> <assembly_output_file>\n"
+           "       %s -b [-q | -v] [-j threads] <assembly_file | glob | @manifest>...\n"
+           "       %s -s [-q | -v] < assembly_file > binary_output_file\n"
+           "The -p model for the -O scheduler is alu,load,branch,taken: ALU and load latencies, cycles sooner\n"
+           "branches need their operands, and the penalty of a jump (default 1,2,1,1).\n"
+           "-P lays basic blocks out so the hot path falls through, from lines of '<label | index> <count>'\n"
+           "where an index is a line of the listing written without -O.\n"
+           "-s writes each word as soon as no label it needs is pending, so memory follows the longest forward\n"
+           "reference, the labels and the .data section rather than the program's length; the most words it\n"
+           "held at once is reported on stderr.\n",
+           program, program, program, program, program);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < 4) {
-        printf("Usage: %s <assembly_file> <output_file> <binary_output_file>\n", argv[0]);
+    uint32_t thread_count = 0;
+    bool batch_mode = false;
+    bool object_mode = false;
+    bool disassemble_mode = false;
+    bool stream_mode = false;
+    bool optimize = false;
+    PipelineModel model = PIPELINE_MODEL_DEFAULT;
+    const char *profile_path = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "bcdj:OP:p:qsv")) != -1) {
+        switch (option) {
+            case 'b':
+                batch_mode = true;
+                break;
+            case 'c':
+                object_mode = true;
+                break;
+            case 'd':
+                disassemble_mode = true;
+                break;
+            case 'j':
+                thread_count = (uint32_t) strtoul(optarg, NULL, 10);
+                if (thread_count == 0) {
+                    diag_warn("invalid thread count '%s', using 1", optarg);
+                    thread_count = 1;
+                }
+                break;
+            case 'O':
+                optimize = true;
+                break;
+            case 'P':
+                profile_path = optarg;
+                break;
+            case 'p':
+                if (!parse_pipeline_model(optarg, &model)) {
+                    diag_error("invalid pipeline model '%s'", optarg);
+                    return 1;
+                }
+                break;
+            case 'q':
+                diagnostics_set_level(DIAGNOSTIC_ERROR);
+                break;
+            case 's':
+                stream_mode = true;
+                break;
+            case 'v':
+                diagnostics_set_level(DIAGNOSTIC_TRACE);
+                break;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (profile_path && !optimize) diag_warn("-P has no effect without -O");
+    if (stream_mode) {
+        // stdout carries the image, so every message goes to stderr.
+        diagnostics_use_stderr();
+        if (optimize) diag_warn("streamed programs are not optimized");
+        if (thread_count > 1) diag_warn("streamed programs are assembled on one thread");
+        return assemble_stream();
+    }
+    if (batch_mode) {
+        if (optind >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        // Files are independent, so batches default to one thread per core.
+        if (thread_count == 0) thread_count = (uint32_t) sysconf(_SC_NPROCESSORS_ONLN);
+        return assemble_batch(argc - optind, argv + optind, thread_count ? thread_count : 1);
+    }
+    if (disassemble_mode) {
+        if (argc - optind < 2) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        return disassemble_binary(argv[optind], argv[optind + 1]);
+    }
+    if (object_mode) {
+        if (argc - optind < 2) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        if (thread_count > 1) diag_warn("objects are assembled on one thread");
+        if (profile_path) diag_warn("objects are not laid out by profile");
+        return assemble_object(argv[optind], argv[optind + 1], optimize, &model);
+    }
+    if (thread_count == 0) thread_count = 1;
+    if (optimize && thread_count > 1) {
+        diag_warn("optimized programs are assembled on one thread");
+        thread_count = 1;
+    }
+    if (argc - optind < 3) {
+        print_usage(argv[0]);
         return 1;
     }
-    FILE *assembly_source = fopen(argv[1], "r");
-    if (!assembly_source) {
-        printf("Failed to open assembly file: %s\n", argv[1]);
+    const char *source_path = argv[optind];
+    const char *listing_path = argv[optind + 1];
+    const char *binary_path = argv[optind + 2];
+
+    SourceFile assembly_source;
+    if (!source_open(source_path, &assembly_source)) {
+        diag_error("failed to open assembly file: %s", source_path);
         return 1;
     }
-    FILE *assembly_dest = fopen(argv[2], "w");
+    FILE *assembly_dest = fopen(listing_path, "w");
     if (!assembly_dest) {
-        printf("Failed to open output file: %s\n", argv[2]);
+        diag_error("failed to open output file: %s", listing_path);
+        source_close(&assembly_source);
         return 1;
     }
-    FILE *binary_dest = fopen(argv[3], "w");
+    FILE *binary_dest = fopen(binary_path, "wb");
     if (!binary_dest) {
-        printf("Failed to open output file: %s\n", argv[2]);
+        diag_error("failed to open output file: %s", binary_path);
+        fclose(assembly_dest);
+        source_close(&assembly_source);
         return 1;
     }
     Assembler *assembler = assembler_create();
     if (!assembler) {
-        printf("Failed to create assembler\n");
-        fclose(assembly_source);
-        return 1;
-    }
-    char line[MAX_LINE_LENGTH];
-    int line_number = 0;
-    int error_count = 0;
-    uint32_t instruction_count = 0;
-    while (fgets(line, sizeof(line), assembly_source)) {
-        line_number++;
-        char *trimmed = line;
-        while (*trimmed == ' ' || *trimmed == '\t') trimmed++;
-        if (*trimmed == '\n' || *trimmed == '\0' || *trimmed == '#' || *trimmed == ';') {
-            continue;
-        }
-        char *newline = strchr(line, '\n');
-        if (newline) *newline = '\0';
-        if (is_label_line(line)) {
-            printf("Found label on line %d referencing %d: %s\n", line_number, instruction_count, line);
-            char label_name[256];
-            char *colon = strchr(trimmed, ':');
-            if (colon) {
-                size_t len = colon - trimmed;
-                strncpy(label_name, trimmed, len);
-                label_name[len] = '\0';
-
-                if (!assembler_add_label(assembler, label_name, instruction_count)) {
-                    printf("Error adding label '%s' on line %d\n", label_name, line_number);
-                    error_count++;
-                }
-            }
-            continue;
-        }
-
-        printf("Parsing line %d: %s\n", line_number, line);
-        Instruction instruction = parse_instruction(line);
-        InstructionValidateResult result = assembler_add_and_validate_instruction(assembler, instruction);
-        if (result != ASSEMBLER_SUCCESS) {
-            printf("Error on line %d: %s\n", line_number, assembler_get_error_message(assembler));
-            error_count++;
-        } else {
-            printf("Successfully added instruction on line %d\n", line_number);
-            instruction_count++;
-        }
+        diag_error("failed to create assembler");
+        close_outputs(assembly_dest, binary_dest);
+        source_close(&assembly_source);
+        return 1;
     }
-    fclose(assembly_source);
-    if (error_count > 0) {
-        printf("\nAssembly failed with %d errors\n", error_count);
-        printf("%s", assembler_get_error_message(assembler));
+    // The optimizer rewrites the per-instruction arrays, which only two-pass mode keeps.
+    bool assembled = thread_count > 1 ? assemble_parallel(assembler, &assembly_source, thread_count)
+                                      : assemble_serial(assembler, &assembly_source, !optimize);
+    source_close(&assembly_source);
+    if (optimize && assembled && assembler->error_count == 0 && !optimize_program(assembler, &model, profile_path)) {
+        close_outputs(assembly_dest, binary_dest);
+        assembler_destroy(assembler);
+        return 1;
+    }
+    uint32_t *machine_code = assembled && assembler->error_count == 0 ? assembler_generate_machine_code(assembler)
+                                                                        : NULL;
+    if (!machine_code) {
+        report_errors(assembler, source_path);
+        if (assembled) diag_info("assembly failed with %u errors", assembler->error_count);
+        close_outputs(assembly_dest, binary_dest);
         assembler_destroy(assembler);
         return 1;
     }
-    printf("\nGenerating machine code...\n");
-    uint32_t *machine_code = assembler_generate_machine_code(assembler);
 
-    if (machine_code) {
-        printf("Machine code generated successfully:\n");
-        for (uint32_t i = 0; i < assembler->instruction_count; i++) {
-            char *instruction_str = instruction_to_str(machine_code[i]);
-            char *instruction_binary = instruction_to_binary(machine_code[i]);
-            printf("%s\n", instruction_str);
-            fprintf(assembly_dest, "%s\n", instruction_str);
-            fprintf(binary_dest, "%s", instruction_binary);
-            free(instruction_str);
-        }
-    } else {
-        printf("Failed to generate machine code\n");
+    // The listing is echoed to the console only in verbose mode.
+    if (diagnostics_level() >= DIAGNOSTIC_TRACE) {
+        output_write_listing(stdout, machine_code, assembler->instruction_count);
+    }
+    bool written = output_write_listing(assembly_dest, machine_code, assembler->instruction_count);
+    written = output_write_binary(binary_dest, machine_code, assembler->instruction_count) && written;
+    written = fclose(assembly_dest) == 0 && written;
+    written = fclose(binary_dest) == 0 && written;
+    if (!written) {
+        diag_error("failed to write output files");
         assembler_destroy(assembler);
         return 1;
     }
+    diag_info("assembled %u instructions", assembler->instruction_count);
 
     assembler_destroy(assembler);
     return 0;
@@ -0,0 +1,280 @@
+#include "object.h"
+#include "output.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(sizeof(ObjectHeader) == 6 * sizeof(uint32_t), "object header must be plain words");
+_Static_assert(sizeof(ObjectSymbol) == 3 * sizeof(uint32_t), "object symbols must be plain words");
+_Static_assert(sizeof(ObjectRelocation) == 3 * sizeof(uint32_t), "object relocations must be plain words");
+
+// Objects are little-endian on disk; on little-endian hosts the mapped words are used as they are.
+static uint32_t load_word(uint32_t word) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return word;
+#else
+    return (word >> 24) | ((word >> 8) & 0xFF00u) | ((word << 8) & 0xFF0000u) | (word << 24);
+#endif
+}
+
+typedef struct {
+    uint32_t *symbol_map; // assembler symbol ID -> object symbol index
+    ObjectSymbol *symbols;
+    uint32_t symbol_count;
+    ObjectRelocation *relocations;
+    uint32_t relocation_count;
+    uint32_t relocation_capacity;
+    char *strings;
+    uint32_t strings_size;
+} ObjectBuilder;
+
+static uint32_t export_symbol(ObjectBuilder *builder, const SymbolTable *table, uint32_t symbol) {
+    if (builder->symbol_map[symbol] != OBJECT_UNDEFINED) return builder->symbol_map[symbol];
+
+    const Label *label = &table->labels[symbol];
+    ObjectSymbol *exported = &builder->symbols[builder->symbol_count];
+    exported->name = builder->strings_size;
+    exported->value = label->instruction_line == SYMBOL_UNDEFINED ? OBJECT_UNDEFINED : label->instruction_line;
+    exported->flags = (label->instruction_line != SYMBOL_UNDEFINED ? OBJECT_SYMBOL_DEFINED : 0) |
+                      (label->flags & SYMBOL_GLOBAL ? OBJECT_SYMBOL_GLOBAL : 0);
+    memcpy(builder->strings + builder->strings_size, symbol_table_name(table, symbol), label->name_length + 1);
+    builder->strings_size += label->name_length + 1;
+    builder->symbol_map[symbol] = builder->symbol_count;
+    return builder->symbol_count++;
+}
+
+static bool add_relocation(ObjectBuilder *builder, uint32_t instruction, uint32_t symbol, uint8_t type) {
+    if (builder->relocation_count >= builder->relocation_capacity) {
+        uint32_t new_capacity = builder->relocation_capacity ? builder->relocation_capacity * 2 : 256;
+        ObjectRelocation *new_relocations = realloc(builder->relocations, sizeof(ObjectRelocation) * new_capacity);
+        if (!new_relocations) return false;
+        builder->relocations = new_relocations;
+        builder->relocation_capacity = new_capacity;
+    }
+    ObjectRelocation *relocation = &builder->relocations[builder->relocation_count++];
+    relocation->instruction = instruction;
+    relocation->symbol = symbol;
+    relocation->type = type;
+    return true;
+}
+
+static void resolve_references(Assembler *assembler, ObjectBuilder *builder) {
+    const SymbolTable *table = &assembler->labels;
+    for (uint32_t symbol = 0; symbol < table->label_count; symbol++) {
+        const Label *label = &table->labels[symbol];
+        bool defined = label->instruction_line != SYMBOL_UNDEFINED;
+        if ((label->flags & SYMBOL_GLOBAL) && !defined) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_LABEL, "Label declared .globl is not defined");
+        } else if ((label->flags & SYMBOL_EXTERN) && defined) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_DUPLICATE_LABEL, "Label declared .extern is also defined");
+        }
+        if (label->flags) export_symbol(builder, table, symbol);
+    }
+
+    for (uint32_t i = 0; i < assembler->instruction_count; i++) {
+        uint32_t symbol = assembler->instruction_symbols[i];
+        if (symbol == ASSEMBLER_NO_SYMBOL) continue;
+
+        const Label *label = &table->labels[symbol];
+        uint8_t type = assembler->instruction_types[i];
+        if (label->instruction_line == SYMBOL_UNDEFINED && !(label->flags & SYMBOL_EXTERN)) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_LABEL, "Reference to an undefined label");
+        } else if (label->instruction_line != SYMBOL_UNDEFINED && type == I_TYPE) {
+            // Branch offsets within one object do not change when it is placed.
+            if (assembler_patch_word(&assembler->machine_code[i], type, i, label->instruction_line) !=
+                ASSEMBLER_SUCCESS) {
+                assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_OFFSET, "Branch target is out of range");
+            }
+        } else if (!add_relocation(builder, i, export_symbol(builder, table, symbol), type)) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand relocation list");
+            return;
+        }
+    }
+}
+
+bool object_write(Assembler *assembler, FILE *stream) {
+    if (!assembler || !stream) return false;
+    if (assembler->one_pass) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Objects need a two-pass assembler");
+        return false;
+    }
+    if (assembler->data_size > 0) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Objects cannot hold a .data section");
+        return false;
+    }
+
+    const SymbolTable *table = &assembler->labels;
+    uint32_t first_error = assembler->error_count;
+    ObjectBuilder builder = {0};
+    builder.symbol_map = malloc(sizeof(uint32_t) * (table->label_count + 1));
+    builder.symbols = malloc(sizeof(ObjectSymbol) * (table->label_count + 1));
+    builder.strings = malloc(table->strings_size + 1);
+    if (!builder.symbol_map || !builder.symbols || !builder.strings) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to allocate object tables");
+    } else {
+        memset(builder.symbol_map, 0xFF, sizeof(uint32_t) * table->label_count);
+        resolve_references(assembler, &builder);
+    }
+
+    bool written = false;
+    if (assembler->error_count == first_error) {
+        ObjectHeader header = {
+            .magic = OBJECT_MAGIC,
+            .version = OBJECT_VERSION,
+            .instruction_count = assembler->instruction_count,
+            .symbol_count = builder.symbol_count,
+            .relocation_count = builder.relocation_count,
+            .strings_size = builder.strings_size,
+        };
+        written = output_write_binary(stream, (const uint32_t *) &header, 6);
+        written = output_write_binary(stream, assembler->machine_code, assembler->instruction_count) && written;
+        written = output_write_binary(stream, (const uint32_t *) builder.symbols, builder.symbol_count * 3) && written;
+        written = output_write_binary(stream, (const uint32_t *) builder.relocations, builder.relocation_count * 3) &&
+                  written;
+        written = fwrite(builder.strings, 1, builder.strings_size, stream) == builder.strings_size && written;
+    }
+
+    free(builder.symbol_map);
+    free(builder.symbols);
+    free(builder.relocations);
+    free(builder.strings);
+    return written;
+}
+
+bool object_load(ObjectFile *object, const void *data, size_t size) {
+    if (!object || !data || ((uintptr_t) data & 3) || size < sizeof(ObjectHeader)) return false;
+
+    const uint32_t *words = data;
+    if (load_word(words[0]) != OBJECT_MAGIC || load_word(words[1]) != OBJECT_VERSION) return false;
+    object->instruction_count = load_word(words[2]);
+    object->symbol_count = load_word(words[3]);
+    object->relocation_count = load_word(words[4]);
+    object->strings_size = load_word(words[5]);
+
+    uint64_t word_count = 6 + (uint64_t) object->instruction_count + 3 * (uint64_t) object->symbol_count +
+                          3 * (uint64_t) object->relocation_count;
+    if (word_count * sizeof(uint32_t) + object->strings_size > size) return false;
+
+    object->code = words + 6;
+    object->symbols = (const ObjectSymbol *) (object->code + object->instruction_count);
+    object->relocations = (const ObjectRelocation *) (object->symbols + object->symbol_count);
+    object->strings = (const char *) (object->relocations + object->relocation_count);
+    if (object->strings_size > 0 && object->strings[object->strings_size - 1] != '\0') return false;
+
+    for (uint32_t i = 0; i < object->symbol_count; i++) {
+        const ObjectSymbol *symbol = &object->symbols[i];
+        uint32_t flags = load_word(symbol->flags);
+        if (load_word(symbol->name) >= object->strings_size) return false;
+        if ((flags & OBJECT_SYMBOL_DEFINED) && load_word(symbol->value) > object->instruction_count) return false;
+    }
+    for (uint32_t i = 0; i < object->relocation_count; i++) {
+        const ObjectRelocation *relocation = &object->relocations[i];
+        uint32_t type = load_word(relocation->type);
+        if (load_word(relocation->instruction) >= object->instruction_count ||
+            load_word(relocation->symbol) >= object->symbol_count ||
+            (type != I_TYPE && type != J_TYPE && type != ASSEMBLER_TYPE_ADDRESS)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every object's .globl labels go into the assembler's table at their linked address.
+static void define_globals(Assembler *assembler, const ObjectFile *objects, uint32_t count, const uint32_t *bases) {
+    for (uint32_t o = 0; o < count; o++) {
+        const ObjectFile *object = &objects[o];
+        for (uint32_t i = 0; i < object->symbol_count; i++) {
+            const ObjectSymbol *symbol = &object->symbols[i];
+            uint32_t flags = load_word(symbol->flags);
+            if (!(flags & OBJECT_SYMBOL_GLOBAL) || !(flags & OBJECT_SYMBOL_DEFINED)) continue;
+
+            const char *name = object->strings + load_word(symbol->name);
+            switch (symbol_table_insert(&assembler->labels, name, strlen(name), bases[o] + load_word(symbol->value))) {
+                case SYMBOL_TABLE_OK:
+                    break;
+                case SYMBOL_TABLE_DUPLICATE:
+                    assembler_set_error(assembler, ASSEMBLER_ERROR_DUPLICATE_LABEL,
+                                        "Global label is defined in more than one object");
+                    break;
+                default:
+                    assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to expand label table");
+                    break;
+            }
+        }
+    }
+}
+
+// Each symbol is looked up once; the relocations then only index the resolved addresses. The first
+// relocation that does not fit is reported.
+static void relocate(Assembler *assembler, const ObjectFile *object, uint32_t base, uint32_t *targets) {
+    for (uint32_t i = 0; i < object->symbol_count; i++) {
+        const ObjectSymbol *symbol = &object->symbols[i];
+        if (load_word(symbol->flags) & OBJECT_SYMBOL_DEFINED) {
+            targets[i] = base + load_word(symbol->value);
+            continue;
+        }
+        const char *name = object->strings + load_word(symbol->name);
+        const Label *label = symbol_table_find(&assembler->labels, name, strlen(name));
+        targets[i] = label ? label->instruction_line : SYMBOL_UNDEFINED;
+        if (!label) {
+            assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_LABEL, "Reference to an undefined external label");
+        }
+    }
+
+    uint32_t *code = assembler->machine_code;
+    bool reported = false;
+    for (uint32_t i = 0; i < object->relocation_count; i++) {
+        const ObjectRelocation *relocation = &object->relocations[i];
+        uint32_t target = targets[load_word(relocation->symbol)];
+        uint32_t instruction = base + load_word(relocation->instruction);
+        uint8_t type = (uint8_t) load_word(relocation->type);
+        if (target == SYMBOL_UNDEFINED) continue;
+        InstructionValidateResult patched = assembler_patch_word(&code[instruction], type, instruction,
+                                                                 assembler_reference_target(assembler, type, target));
+        if (patched != ASSEMBLER_SUCCESS && !reported) {
+            assembler_set_error(assembler, patched, assembler_patch_message(type, patched));
+            reported = true;
+        }
+    }
+}
+
+InstructionValidateResult object_link(Assembler *assembler, const ObjectFile *objects, uint32_t count) {
+    if (!assembler || (!objects && count > 0)) {
+        return ASSEMBLER_ERROR_NULL_POINTER;
+    }
+    if (!assembler_set_one_pass(assembler, true) || assembler->labels.label_count > 0) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Linking needs an empty assembler");
+        return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+    }
+    assembler_set_location(assembler, 0, 0);
+
+    uint32_t first_error = assembler->error_count;
+    uint32_t *bases = malloc(sizeof(uint32_t) * (count + 1));
+    uint64_t total = 0;
+    uint32_t max_symbols = 0;
+    for (uint32_t o = 0; bases && o < count; o++) {
+        bases[o] = (uint32_t) total;
+        total += objects[o].instruction_count;
+        if (objects[o].symbol_count > max_symbols) max_symbols = objects[o].symbol_count;
+    }
+    uint32_t *targets = malloc(sizeof(uint32_t) * ((size_t) max_symbols + 1));
+
+    if (!bases || !targets) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to allocate link tables");
+    } else if (total > UINT32_MAX || !assembler_reserve(assembler, (uint32_t) total)) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_BUFFER_FULL, "Linked program is too large");
+    } else {
+        for (uint32_t o = 0; o < count; o++) {
+            uint32_t *out = assembler->machine_code + bases[o];
+            for (uint32_t i = 0; i < objects[o].instruction_count; i++) out[i] = load_word(objects[o].code[i]);
+        }
+        assembler->instruction_count = (uint32_t) total;
+
+        define_globals(assembler, objects, count, bases);
+        for (uint32_t o = 0; o < count; o++) relocate(assembler, &objects[o], bases[o], targets);
+    }
+
+    free(bases);
+    free(targets);
+    return assembler->error_count > first_error ? assembler->errors[first_error].code : ASSEMBLER_SUCCESS;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "assembler.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Relocatable object file. Every field is a little-endian 32-bit word and the sections follow the header
+// in this order: code words, symbols, relocations, then the NUL-terminated names. Branches to labels of
+// the same object are resolved when it is written; branches to .extern labels, every J-type address and
+// every la are left to the linker as relocations.
+#define OBJECT_MAGIC 0x4A424F41u // "AOBJ"
+#define OBJECT_VERSION 1u
+
+#define OBJECT_SYMBOL_DEFINED 1u
+#define OBJECT_SYMBOL_GLOBAL 2u
+
+#define OBJECT_UNDEFINED UINT32_MAX
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t instruction_count;
+    uint32_t symbol_count;
+    uint32_t relocation_count;
+    uint32_t strings_size;
+} ObjectHeader;
+
+typedef struct {
+    uint32_t name;  // offset into the names
+    uint32_t value; // instruction index within the object (at most its length), OBJECT_UNDEFINED for .extern
+    uint32_t flags;
+} ObjectSymbol;
+
+// The word at instruction gets the address of symbol: a branch offset for I_TYPE, the absolute
+// instruction index for J_TYPE and its byte address, four times that index, as the immediate for
+// ASSEMBLER_TYPE_ADDRESS.
+typedef struct {
+    uint32_t instruction;
+    uint32_t symbol;
+    uint32_t type;
+} ObjectRelocation;
+
+// A validated view of an object image; the pointers alias the caller's buffer, which must stay mapped and
+// 4-byte aligned while the view is used.
+typedef struct {
+    uint32_t instruction_count;
+    uint32_t symbol_count;
+    uint32_t relocation_count;
+    const uint32_t *code;
+    const ObjectSymbol *symbols;
+    const ObjectRelocation *relocations;
+    const char *strings;
+    uint32_t strings_size;
+} ObjectFile;
+
+// Writes a two-pass assembler's program as an object. Fails after recording an error when a label is
+// neither defined nor declared .extern, a .globl label is not defined, an .extern label is defined, or the
+// program has a .data section, which only a linked image can place.
+bool object_write(Assembler *assembler, FILE *stream);
+
+// Checks the header and that every offset and index stays inside the image.
+bool object_load(ObjectFile *object, const void *data, size_t size);
+
+// Lays the objects out in order into an empty assembler, resolves every relocation against the objects'
+// .globl labels and leaves the linked program in assembler->machine_code. Problems are recorded as
+// errors without a source location and the first one is returned.
+InstructionValidateResult object_link(Assembler *assembler, const ObjectFile *objects, uint32_t count);
@@ -0,0 +1,689 @@
+#include "optimizer.h"
+#include "cfg.h"
+#include "isa.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// What an instruction does to the registers. Pure instructions write dest and nothing else: the ALU
+// operations, addi and the loads. Loads count as pure because memory only changes through stores.
+typedef struct {
+    bool pure;
+    uint32_t dest;
+    uint32_t reads; // bit n set when register n is read
+} Effect;
+
+typedef struct {
+    const InstructionDef *def;
+    uint32_t rs;
+    uint32_t rt;
+    uint32_t rd;
+    int32_t immediate;
+} Fields;
+
+static Fields fields_of(uint32_t word) {
+    Fields fields = {
+        .def = decode_instruction(word),
+        .rs = (word >> 21) & 0x1F,
+        .rt = (word >> 16) & 0x1F,
+        .rd = (word >> 11) & 0x1F,
+        .immediate = (int16_t) (word & 0xFFFF),
+    };
+    return fields;
+}
+
+static Effect effect_of(uint32_t word, uint8_t type) {
+    Effect effect = {0};
+    if (type == ASSEMBLER_TYPE_DATA) return effect;
+
+    Fields f = fields_of(word);
+    if (!f.def) return effect;
+    switch (f.def->format) {
+        case OPERANDS_REGISTER:
+            effect.reads = 1u << f.rs | 1u << f.rt;
+            effect.pure = f.def->funct != FUNCT_JR;
+            effect.dest = f.rd;
+            break;
+        case OPERANDS_IMMEDIATE:
+            effect.reads = 1u << f.rs;
+            effect.pure = true;
+            effect.dest = f.rt;
+            break;
+        case OPERANDS_MEMORY:
+            effect.pure = f.def->opcode == OPCODE_LW || f.def->opcode == OPCODE_LH || f.def->opcode == OPCODE_LB;
+            effect.reads = 1u << f.rs | (effect.pure ? 0 : 1u << f.rt);
+            effect.dest = f.rt;
+            break;
+        default:
+            break;
+    }
+    return effect;
+}
+
+// The register a pure instruction copies unchanged into its destination, or -1 when it computes something.
+static int copy_source(uint32_t word) {
+    Fields f = fields_of(word);
+    if (f.def->format == OPERANDS_IMMEDIATE) return f.immediate == 0 ? (int) f.rs : -1;
+    if (f.def->format != OPERANDS_REGISTER) return -1;
+
+    switch (f.def->funct) {
+        case FUNCT_ADD:
+        case FUNCT_OR:
+        case FUNCT_XOR:
+            if (f.rs == 0) return (int) f.rt;
+            return f.rt == 0 ? (int) f.rs : -1;
+        case FUNCT_AND:
+            return f.rs == f.rt ? (int) f.rs : -1;
+        default:
+            // sub and the shifts only leave rs alone when rt is $zero.
+            return f.rt == 0 ? (int) f.rs : -1;
+    }
+}
+
+static bool has_no_effect(uint32_t word, const Effect *effect) {
+    return effect->pure && (effect->dest == 0 || copy_source(word) == (int) effect->dest);
+}
+
+// and x, x, y and or x, x, y give the same result when repeated.
+static bool is_idempotent(uint32_t word) {
+    Fields f = fields_of(word);
+    return f.def->format == OPERANDS_REGISTER && (f.def->funct == FUNCT_AND || f.def->funct == FUNCT_OR) &&
+           (f.rd == f.rs || f.rd == f.rt);
+}
+
+// la is an addi too, but its immediate is filled in from the label and cannot be folded.
+static bool is_addi(uint32_t word, uint8_t type) {
+    return type == I_TYPE && word >> 26 == OPCODE_ADDI;
+}
+
+// Labels and numeric branch targets; instructions on either side of one are never combined.
+static void mark_targets(const Assembler *assembler, uint32_t *targets) {
+    uint32_t count = assembler->instruction_count;
+    for (uint32_t symbol = 0; symbol < assembler->labels.label_count; symbol++) {
+        uint32_t line = assembler->labels.labels[symbol].instruction_line;
+        if (line <= count) targets[line] = 1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (assembler->instruction_symbols[i] != ASSEMBLER_NO_SYMBOL ||
+            assembler->instruction_types[i] == ASSEMBLER_TYPE_DATA) {
+            continue;
+        }
+        uint32_t target = cfg_target(assembler, i);
+        if (target != CFG_NONE) targets[target] = 1;
+    }
+
+    // Prefix sums, so targets[b + 1] - targets[a + 1] counts the targets in (a, b].
+    uint32_t total = 0;
+    for (uint32_t i = 0; i <= count + 1; i++) {
+        uint32_t marked = targets[i];
+        targets[i] = total;
+        total += marked;
+    }
+}
+
+static bool is_numeric_reference(const Assembler *assembler, uint32_t instruction, OperandFormat format) {
+    if (assembler->instruction_symbols[instruction] != ASSEMBLER_NO_SYMBOL ||
+        assembler->instruction_types[instruction] == ASSEMBLER_TYPE_DATA) {
+        return false;
+    }
+    const InstructionDef *def = decode_instruction(assembler->machine_code[instruction]);
+    return def && def->format == format;
+}
+
+// Rebuilds the program from order, which lists every instruction index once in the new program order (NULL
+// keeps the current order), dropping the instructions whose keep flag is clear. Entries from
+// instruction_count on insert jumps[entry - instruction_count], numeric jumps whose address is an index in
+// the current program. A label or numeric target on any instruction moves to the first instruction at or
+// after it in the new order that is kept or inserted; numeric targets past the end keep their distance from
+// the end. Leaves the program untouched and returns false when a branch would end up out of range or
+// memory runs out.
+static bool apply_layout(Assembler *assembler, const uint32_t *order, const bool *keep, const uint32_t *jumps,
+                         uint32_t jump_count) {
+    uint32_t count = assembler->instruction_count;
+    uint32_t length = count + jump_count;
+    uint32_t *map = malloc(sizeof(uint32_t) * ((size_t) count + 1));
+    if (!map) return false;
+
+    uint32_t kept = 0;
+    for (uint32_t k = 0; k < length; k++) {
+        uint32_t i = order ? order[k] : k;
+        if (i >= count || keep[i]) kept++;
+    }
+    map[count] = kept;
+    for (uint32_t k = length, n = kept, next = kept; k-- > 0;) {
+        uint32_t i = order ? order[k] : k;
+        if (i >= count || keep[i]) next = --n;
+        if (i < count) map[i] = next;
+    }
+
+    bool in_range = true;
+    for (uint32_t i = 0; i < count && in_range; i++) {
+        if (!keep[i] || assembler->instruction_types[i] != I_TYPE) continue;
+        uint32_t target = cfg_target(assembler, i);
+        const InstructionDef *def = decode_instruction(assembler->machine_code[i]);
+        if (target == CFG_NONE || !def || def->format != OPERANDS_BRANCH) continue;
+        int64_t offset = (int64_t) map[target] - map[i] - 1;
+        in_range = offset >= INT16_MIN && offset <= INT16_MAX;
+    }
+
+    uint32_t *code = in_range ? malloc(sizeof(uint32_t) * ((size_t) kept + 1)) : NULL;
+    uint8_t *types = code ? malloc((size_t) kept + 1) : NULL;
+    uint32_t *symbols = types ? malloc(sizeof(uint32_t) * ((size_t) kept + 1)) : NULL;
+    if (!symbols || !assembler_reserve(assembler, kept)) {
+        free(map);
+        free(code);
+        free(types);
+        free(symbols);
+        return false;
+    }
+
+    int64_t shift = (int64_t) kept - count;
+    uint32_t n = 0;
+    for (uint32_t k = 0; k < length; k++) {
+        uint32_t i = order ? order[k] : k;
+        if (i >= count) {
+            uint32_t word = jumps[i - count];
+            code[n] = (word & ~0x3FFFFFFu) | map[word & 0x3FFFFFF];
+            types[n] = J_TYPE;
+            symbols[n++] = ASSEMBLER_NO_SYMBOL;
+            continue;
+        }
+        if (!keep[i]) continue;
+        uint32_t word = assembler->machine_code[i];
+        if (is_numeric_reference(assembler, i, OPERANDS_BRANCH)) {
+            int64_t target = (int64_t) i + 1 + (int16_t) (word & 0xFFFF);
+            int64_t moved = target < 0 ? target : target <= count ? map[target] : target + shift;
+            word = (word & ~0xFFFFu) | ((uint32_t) (moved - n - 1) & 0xFFFF);
+        } else if (is_numeric_reference(assembler, i, OPERANDS_JUMP)) {
+            uint32_t target = word & 0x3FFFFFF;
+            word = (word & ~0x3FFFFFFu) | (uint32_t) (target <= count ? map[target] : target + shift);
+        }
+        code[n] = word;
+        types[n] = assembler->instruction_types[i];
+        symbols[n++] = assembler->instruction_symbols[i];
+    }
+    memcpy(assembler->machine_code, code, sizeof(uint32_t) * kept);
+    memcpy(assembler->instruction_types, types, kept);
+    memcpy(assembler->instruction_symbols, symbols, sizeof(uint32_t) * kept);
+    assembler->instruction_count = kept;
+
+    for (uint32_t symbol = 0; symbol < assembler->labels.label_count; symbol++) {
+        Label *label = &assembler->labels.labels[symbol];
+        if (label->instruction_line <= count) label->instruction_line = map[label->instruction_line];
+    }
+
+    free(map);
+    free(code);
+    free(types);
+    free(symbols);
+    return true;
+}
+
+InstructionValidateResult optimizer_peephole(Assembler *assembler, PeepholeStats *stats) {
+    if (!assembler) {
+        return ASSEMBLER_ERROR_NULL_POINTER;
+    }
+    if (assembler->one_pass) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Optimization needs a two-pass assembler");
+        return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+    }
+
+    uint32_t count = assembler->instruction_count;
+    uint32_t *targets = calloc((size_t) count + 2, sizeof(uint32_t));
+    uint32_t *stack = malloc(sizeof(uint32_t) * ((size_t) count + 1));
+    bool *keep = calloc((size_t) count + 1, sizeof(bool));
+    if (!targets || !stack || !keep) {
+        free(targets);
+        free(stack);
+        free(keep);
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to allocate optimizer tables");
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
+    mark_targets(assembler, targets);
+
+    // The kept instructions form a stack; each new one is checked against the last one kept, and deleting
+    // that one exposes the one before it to the same checks.
+    uint32_t *code = assembler->machine_code;
+    const uint8_t *types = assembler->instruction_types;
+    uint32_t kept = 0;
+    uint32_t folded = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t word = code[i];
+        Effect effect = effect_of(word, types[i]);
+        if (has_no_effect(word, &effect)) continue;
+
+        bool keep_this = true;
+        while (kept > 0 && effect.pure) {
+            uint32_t previous = stack[kept - 1];
+            Effect previous_effect = effect_of(code[previous], types[previous]);
+            if (!previous_effect.pure) break;
+
+            // Overwritten before anything reads it, whichever way control reaches this instruction.
+            if (previous_effect.dest == effect.dest && !(effect.reads >> effect.dest & 1)) {
+                kept--;
+                continue;
+            }
+            if (targets[i + 1] != targets[previous + 1]) break;
+
+            int copied = copy_source(word);
+            if (is_addi(code[previous], types[previous]) && is_addi(word, types[i]) &&
+                previous_effect.dest == effect.dest && (word >> 21 & 0x1F) == effect.dest) {
+                int32_t sum = (int16_t) (code[previous] & 0xFFFF) + (int16_t) (word & 0xFFFF);
+                if (sum >= INT16_MIN && sum <= INT16_MAX) {
+                    code[previous] = (code[previous] & ~0xFFFFu) | ((uint32_t) sum & 0xFFFF);
+                    if (has_no_effect(code[previous], &previous_effect)) kept--;
+                    folded++;
+                    keep_this = false;
+                }
+            } else if (word == code[previous] && is_idempotent(word)) {
+                keep_this = false;
+            } else if (copied >= 0 && copy_source(code[previous]) == (int) effect.dest &&
+                       previous_effect.dest == (uint32_t) copied) {
+                // A move straight back to where the value came from.
+                keep_this = false;
+            }
+            break;
+        }
+        if (keep_this) stack[kept++] = i;
+    }
+    for (uint32_t k = 0; k < kept; k++) keep[stack[k]] = true;
+
+    // Deleting instructions only brings branches closer to their targets.
+    bool applied = apply_layout(assembler, NULL, keep, NULL, 0);
+    if (stats) {
+        stats->removed = count - assembler->instruction_count;
+        stats->folded = folded;
+    }
+
+    free(targets);
+    free(stack);
+    free(keep);
+    if (!applied) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to allocate optimizer tables");
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
+    return ASSEMBLER_SUCCESS;
+}
+
+#define THREAD_MAX_HOPS 64
+
+// Points each reference to a label whose instruction is an unconditional jump at that jump's own label,
+// following chains; the hop limit stops jump cycles.
+static uint32_t thread_jumps(Assembler *assembler) {
+    const Label *labels = assembler->labels.labels;
+    uint32_t *symbols = assembler->instruction_symbols;
+    uint32_t count = assembler->instruction_count;
+    uint32_t threaded = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t symbol = symbols[i];
+        ControlKind control = symbol == ASSEMBLER_NO_SYMBOL ? CONTROL_NONE : cfg_control(assembler, i);
+        if (control != CONTROL_BRANCH && control != CONTROL_JUMP && control != CONTROL_CALL) continue;
+
+        uint32_t final = symbol;
+        for (uint32_t hops = 0; hops < THREAD_MAX_HOPS; hops++) {
+            uint32_t line = labels[final].instruction_line;
+            if (line >= count || symbols[line] == ASSEMBLER_NO_SYMBOL || cfg_control(assembler, line) != CONTROL_JUMP) {
+                break;
+            }
+            final = symbols[line];
+        }
+        if (final == symbol) continue;
+
+        uint32_t target = labels[final].instruction_line;
+        int64_t offset = (int64_t) target - i - 1;
+        if (assembler->instruction_types[i] == I_TYPE && target != SYMBOL_UNDEFINED &&
+            (offset < INT16_MIN || offset > INT16_MAX)) {
+            continue;
+        }
+        symbols[i] = final;
+        threaded++;
+    }
+    return threaded;
+}
+
+typedef struct {
+    const ControlFlowGraph *cfg;
+    const bool *reachable;
+    bool *placed;
+    uint32_t *blocks;    // blocks in their new order
+    uint32_t *effective; // block -> first block at or after it in the new order that keeps an instruction
+} Layout;
+
+// Chooses the new block order and the instructions to keep. With move_blocks, a block entered only by the
+// jump ending the block just placed, and not falling through itself, is placed right after it so the jump
+// can go.
+static uint32_t build_layout(const Assembler *assembler, Layout *layout, bool move_blocks, uint32_t *order,
+                             bool *keep) {
+    const ControlFlowGraph *cfg = layout->cfg;
+    uint32_t block_count = cfg->block_count;
+    uint32_t removed = 0;
+    for (uint32_t i = 0; i < assembler->instruction_count; i++) {
+        keep[i] = layout->reachable[cfg->block_of[i]];
+        if (keep[i] && cfg_control(assembler, i) == CONTROL_NEVER_TAKEN) {
+            keep[i] = false;
+            removed++;
+        }
+    }
+
+    memset(layout->placed, 0, sizeof(bool) * block_count);
+    uint32_t placed = 0;
+    for (uint32_t b = 0; b < block_count; b++) {
+        if (layout->placed[b]) continue;
+        layout->placed[b] = true;
+        layout->blocks[placed++] = b;
+        for (uint32_t current = b; move_blocks && layout->reachable[b];) {
+            const BasicBlock *from = &cfg->blocks[current];
+            uint32_t next = from->taken;
+            if (from->control != CONTROL_JUMP || next >= block_count || layout->placed[next]) break;
+            const BasicBlock *to = &cfg->blocks[next];
+            if (!layout->reachable[next] || to->root || to->predecessors != 1 || to->fallthrough != CFG_NONE) break;
+            layout->placed[next] = true;
+            layout->blocks[placed++] = next;
+            current = next;
+        }
+    }
+
+    // Walking the new order backwards, a branch or jump whose target is the next block that keeps anything
+    // is dropped. Targets earlier in the order have no effective block yet and are never the next one.
+    for (uint32_t b = 0; b < block_count; b++) layout->effective[b] = CFG_NONE;
+    layout->effective[block_count] = block_count;
+    uint32_t next = block_count;
+    for (uint32_t k = block_count; k-- > 0;) {
+        uint32_t b = layout->blocks[k];
+        const BasicBlock *block = &cfg->blocks[b];
+        uint32_t last = block->end - 1;
+        if (keep[last] && (block->control == CONTROL_JUMP || block->control == CONTROL_BRANCH) &&
+            block->taken != CFG_NONE && layout->effective[block->taken] == next) {
+            keep[last] = false;
+            removed++;
+        }
+        bool kept = false;
+        for (uint32_t i = block->start; i < block->end && !kept; i++) kept = keep[i];
+        layout->effective[b] = kept ? b : next;
+        next = layout->effective[b];
+    }
+
+    uint32_t k = 0;
+    for (uint32_t p = 0; p < block_count; p++) {
+        const BasicBlock *block = &cfg->blocks[layout->blocks[p]];
+        for (uint32_t i = block->start; i < block->end; i++) order[k++] = i;
+    }
+    return removed;
+}
+
+InstructionValidateResult optimizer_control_flow(Assembler *assembler, bool move_blocks, ControlFlowStats *stats) {
+    if (!assembler) {
+        return ASSEMBLER_ERROR_NULL_POINTER;
+    }
+    if (assembler->one_pass) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Optimization needs a two-pass assembler");
+        return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+    }
+
+    uint32_t threaded = thread_jumps(assembler);
+    ControlFlowGraph cfg;
+    if (!cfg_build(&cfg, assembler)) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to allocate optimizer tables");
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
+
+    uint32_t count = assembler->instruction_count;
+    size_t block_count = cfg.block_count;
+    bool *reachable = malloc(sizeof(bool) * (block_count + 1));
+    bool *placed = malloc(sizeof(bool) * (block_count + 1));
+    uint32_t *blocks = malloc(sizeof(uint32_t) * (block_count + 1));
+    uint32_t *effective = malloc(sizeof(uint32_t) * (block_count + 1));
+    uint32_t *order = malloc(sizeof(uint32_t) * ((size_t) count + 1));
+    bool *keep = malloc(sizeof(bool) * ((size_t) count + 1));
+    bool applied = false;
+    uint32_t unreachable = 0;
+    uint32_t removed_jumps = 0;
+    if (reachable && placed && blocks && effective && order && keep && cfg_mark_reachable(&cfg, reachable)) {
+        for (uint32_t b = 0; b < cfg.block_count; b++) {
+            if (!reachable[b]) unreachable += cfg.blocks[b].end - cfg.blocks[b].start;
+        }
+        Layout layout = {&cfg, reachable, placed, blocks, effective};
+        removed_jumps = build_layout(assembler, &layout, move_blocks, order, keep);
+        applied = apply_layout(assembler, order, keep, NULL, 0);
+        if (!applied && move_blocks) {
+            // Moving a block can stretch a branch past its range; deleting alone never does.
+            removed_jumps = build_layout(assembler, &layout, false, order, keep);
+            applied = apply_layout(assembler, order, keep, NULL, 0);
+        }
+    }
+    if (stats) {
+        stats->threaded = threaded;
+        stats->unreachable = unreachable;
+        stats->removed_jumps = removed_jumps;
+    }
+
+    cfg_free(&cfg);
+    free(reachable);
+    free(placed);
+    free(blocks);
+    free(effective);
+    free(order);
+    free(keep);
+    if (!applied) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to allocate optimizer tables");
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
+    return ASSEMBLER_SUCCESS;
+}
+
+typedef struct {
+    uint64_t weight;
+    uint32_t block;
+} BlockWeight;
+
+// Hottest first; equal weights keep program order.
+static int compare_weights(const void *a, const void *b) {
+    const BlockWeight *left = a;
+    const BlockWeight *right = b;
+    if (left->weight != right->weight) return left->weight < right->weight ? 1 : -1;
+    return left->block < right->block ? -1 : left->block > right->block;
+}
+
+// The block to place right after current: the hotter of its fall-through block and, for a jump or a branch
+// that can be inverted, its target. Calls keep their return block next to them whenever it is still free,
+// and a block that ran is never followed by one that did not.
+static uint32_t profile_follower(const Assembler *assembler, const ControlFlowGraph *cfg, const uint64_t *weights,
+                                 const bool *placed, uint32_t current) {
+    const BasicBlock *block = &cfg->blocks[current];
+    uint32_t block_count = cfg->block_count;
+    uint32_t fallthrough = block->fallthrough;
+    if (fallthrough >= block_count || placed[fallthrough]) fallthrough = CFG_NONE;
+    if (block->control == CONTROL_CALL) return fallthrough;
+
+    uint32_t taken = CFG_NONE;
+    uint32_t opcode = assembler->machine_code[block->end - 1] >> 26;
+    if (block->taken < block_count && !placed[block->taken] &&
+        (block->control == CONTROL_JUMP ||
+         (block->control == CONTROL_BRANCH && (opcode == OPCODE_BEQ || opcode == OPCODE_BNEQ)))) {
+        taken = block->taken;
+    }
+
+    uint32_t next = fallthrough;
+    if (taken != CFG_NONE && (next == CFG_NONE || weights[taken] > weights[next])) next = taken;
+    if (next != CFG_NONE && weights[current] > 0 && weights[next] == 0) return CFG_NONE;
+    return next;
+}
+
+// Makes the blocks in order run as before: a jump to the block after it is deleted, a beq/bneq whose target
+// is the block after it is inverted to branch to its old fall-through block, and any other block that
+// falls through to a block placed elsewhere gets a jump there.
+static void profile_rewrite(Assembler *assembler, const ControlFlowGraph *cfg, const uint32_t *blocks,
+                            uint32_t *order, bool *keep, uint32_t *jumps, uint32_t *inverted,
+                            ProfileLayoutStats *stats) {
+    uint32_t count = assembler->instruction_count;
+    uint32_t block_count = cfg->block_count;
+    uint32_t k = 0;
+    for (uint32_t p = 0; p < block_count; p++) {
+        const BasicBlock *block = &cfg->blocks[blocks[p]];
+        uint32_t next = p + 1 < block_count ? blocks[p + 1] : block_count;
+        for (uint32_t i = block->start; i < block->end; i++) order[k++] = i;
+
+        uint32_t last = block->end - 1;
+        if (block->control == CONTROL_JUMP) {
+            if (block->taken == next) {
+                keep[last] = false;
+                stats->removed_jumps++;
+            }
+            continue;
+        }
+        if (block->fallthrough == CFG_NONE || block->fallthrough == next) continue;
+
+        uint32_t target = cfg->blocks[block->fallthrough].start;
+        uint32_t word = assembler->machine_code[last];
+        int64_t offset = (int64_t) target - last - 1;
+        if (block->control == CONTROL_BRANCH && block->taken == next && (word >> 26 == OPCODE_BEQ ||
+            word >> 26 == OPCODE_BNEQ) && offset >= INT16_MIN && offset <= INT16_MAX) {
+            // beq and bneq swap, wherever isa.h puts their opcodes.
+            uint32_t opcode = (uint32_t) (OPCODE_BEQ + OPCODE_BNEQ) - (word >> 26);
+            inverted[stats->inverted++] = last;
+            assembler->machine_code[last] = opcode << 26 | (word & 0x03FF0000u) | ((uint32_t) offset & 0xFFFF);
+            assembler->instruction_symbols[last] = ASSEMBLER_NO_SYMBOL;
+        } else {
+            jumps[stats->inserted_jumps] = (uint32_t) OPCODE_J << 26 | target;
+            order[k++] = count + stats->inserted_jumps++;
+        }
+    }
+}
+
+// Each block weighs the highest count in it. A block without any count, such as the unlabeled fall-through
+// side of a branch that a label-only profile cannot name, inherits what the block before it passes on: all
+// of its weight after a call or a plain fall-through, and after a branch what the branch's target did not
+// take.
+static void profile_weights(const ControlFlowGraph *cfg, const uint64_t *counts, uint64_t *weights) {
+    uint32_t block_count = cfg->block_count;
+    for (uint32_t b = 0; b < block_count; b++) {
+        for (uint32_t i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+            if (counts[i] > weights[b]) weights[b] = counts[i];
+        }
+    }
+    for (uint32_t b = 1; b < block_count; b++) {
+        const BasicBlock *previous = &cfg->blocks[b - 1];
+        if (weights[b] > 0 || previous->fallthrough != b) continue;
+
+        uint64_t weight = weights[b - 1];
+        if (previous->control == CONTROL_BRANCH && previous->taken < block_count) {
+            uint64_t taken = weights[previous->taken];
+            weight = weight > taken ? weight - taken : 0;
+        }
+        weights[b] = weight;
+    }
+}
+
+// Fills blocks with every block in its new order. Returns false when out of memory.
+static bool profile_order(const Assembler *assembler, const ControlFlowGraph *cfg, const uint64_t *counts,
+                          uint32_t *blocks) {
+    uint32_t block_count = cfg->block_count;
+    uint64_t *weights = calloc((size_t) block_count + 1, sizeof(uint64_t));
+    BlockWeight *hottest = calloc((size_t) block_count + 1, sizeof(BlockWeight));
+    bool *placed = calloc((size_t) block_count + 1, sizeof(bool));
+    bool ok = weights && hottest && placed;
+
+    if (ok && block_count > 0) {
+        profile_weights(cfg, counts, weights);
+        for (uint32_t b = 0; b < block_count; b++) hottest[b] = (BlockWeight) {weights[b], b};
+        qsort(hottest + 1, block_count - 1, sizeof(BlockWeight), compare_weights);
+
+        // Chains grow from the entry block, then from the hottest block not placed yet.
+        uint32_t placed_count = 0;
+        for (uint32_t h = 0; h < block_count; h++) {
+            for (uint32_t b = hottest[h].block; b != CFG_NONE && !placed[b];) {
+                placed[b] = true;
+                blocks[placed_count++] = b;
+                b = profile_follower(assembler, cfg, weights, placed, b);
+            }
+        }
+    }
+
+    free(weights);
+    free(hottest);
+    free(placed);
+    return ok;
+}
+
+// Rewrites the program into the block order. When apply_layout refuses it, the inverted branches are
+// restored and *stats is cleared. Returns false when out of memory, with the program untouched.
+static bool profile_apply(Assembler *assembler, const ControlFlowGraph *cfg, const uint32_t *blocks,
+                          ProfileLayoutStats *stats) {
+    uint32_t count = assembler->instruction_count;
+    uint32_t block_count = cfg->block_count;
+    uint32_t *order = calloc((size_t) count + block_count + 1, sizeof(uint32_t));
+    bool *keep = calloc((size_t) count + 1, sizeof(bool));
+    uint32_t *jumps = calloc((size_t) block_count + 1, sizeof(uint32_t));
+    uint32_t *inverted = calloc((size_t) block_count + 1, sizeof(uint32_t));
+    uint32_t *saved_words = calloc((size_t) block_count + 1, sizeof(uint32_t));
+    uint32_t *saved_symbols = calloc((size_t) block_count + 1, sizeof(uint32_t));
+    bool ok = order && keep && jumps && inverted && saved_words && saved_symbols;
+
+    if (ok) {
+        for (uint32_t b = 0; b < block_count; b++) {
+            saved_words[b] = assembler->machine_code[cfg->blocks[b].end - 1];
+            saved_symbols[b] = assembler->instruction_symbols[cfg->blocks[b].end - 1];
+        }
+        for (uint32_t i = 0; i < count; i++) keep[i] = true;
+        profile_rewrite(assembler, cfg, blocks, order, keep, jumps, inverted, stats);
+        if (!apply_layout(assembler, order, keep, jumps, stats->inserted_jumps)) {
+            for (uint32_t n = 0; n < stats->inverted; n++) {
+                uint32_t b = cfg->block_of[inverted[n]];
+                assembler->machine_code[inverted[n]] = saved_words[b];
+                assembler->instruction_symbols[inverted[n]] = saved_symbols[b];
+            }
+            *stats = (ProfileLayoutStats) {0};
+        }
+    }
+
+    free(order);
+    free(keep);
+    free(jumps);
+    free(inverted);
+    free(saved_words);
+    free(saved_symbols);
+    return ok;
+}
+
+InstructionValidateResult optimizer_profile_layout(Assembler *assembler, const uint64_t *counts,
+                                                   ProfileLayoutStats *stats) {
+    if (!assembler || !counts) {
+        return ASSEMBLER_ERROR_NULL_POINTER;
+    }
+    if (assembler->one_pass) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Optimization needs a two-pass assembler");
+        return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+    }
+    ProfileLayoutStats result = {0};
+    if (stats) *stats = result;
+
+    // .word values may be read as data at addresses the layout would change.
+    uint32_t count = assembler->instruction_count;
+    for (uint32_t i = 0; i < count; i++) {
+        if (assembler->instruction_types[i] == ASSEMBLER_TYPE_DATA) return ASSEMBLER_SUCCESS;
+    }
+    ControlFlowGraph cfg;
+    if (!cfg_build(&cfg, assembler)) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to allocate optimizer tables");
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
+
+    uint32_t *blocks = calloc((size_t) cfg.block_count + 1, sizeof(uint32_t));
+    bool ok = blocks && profile_order(assembler, &cfg, counts, blocks);
+    if (ok) {
+        for (uint32_t p = 1; p < cfg.block_count; p++) result.moved += blocks[p] != blocks[p - 1] + 1;
+    }
+    if (ok && result.moved > 0) {
+        ok = profile_apply(assembler, &cfg, blocks, &result);
+        if (!ok) result = (ProfileLayoutStats) {0};
+    }
+    if (stats) *stats = result;
+
+    cfg_free(&cfg);
+    free(blocks);
+    if (!ok) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to allocate optimizer tables");
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
+    return ASSEMBLER_SUCCESS;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "assembler.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Passes that rewrite a two-pass assembler's program in place before assembler_generate_machine_code. Each
+// one keeps instruction_types and instruction_symbols in step with machine_code, moves every label to the
+// instruction that now starts it and re-encodes numeric branch offsets and jump addresses, so the program
+// resolves as if the optimized source had been written by hand. Indirect jumps are assumed to go through
+// return addresses left by jal, which stay correct because they are computed at run time.
+
+typedef struct {
+    uint32_t removed; // instructions deleted, including the second half of every fold
+    uint32_t folded;  // addi pairs merged into one
+} PeepholeStats;
+
+typedef struct {
+    uint32_t threaded;      // references pointed past a chain of jumps
+    uint32_t unreachable;   // instructions deleted because no entry point reaches them
+    uint32_t removed_jumps; // branches and jumps deleted because they never branch or their target follows them
+} ControlFlowStats;
+
+typedef struct {
+    uint32_t moved;          // blocks no longer right after the block before them in the source
+    uint32_t inverted;       // beq/bneq turned into the other so the hot path falls through
+    uint32_t inserted_jumps; // jumps added where a block's fall-through block was moved away
+    uint32_t removed_jumps;  // jumps deleted because their target now follows them
+} ProfileLayoutStats;
+
+// Deletes instructions that have no effect (writes to $zero, addi x, x, 0, or x, x, $zero and the like),
+// results overwritten by the very next instruction before being read, repeats of idempotent and/or, and
+// moves straight back to where a value came from; folds addi x, y, a followed by addi x, x, b into one
+// addi. Instructions are only combined when no label lands between them, and .word values are never
+// touched. Fails in one-pass mode, as does optimizer_control_flow.
+InstructionValidateResult optimizer_peephole(Assembler *assembler, PeepholeStats *stats);
+
+// Works on the control-flow graph (cfg.h). References to a label that holds an unconditional jump are
+// pointed at that jump's target, following chains; blocks no entry point reaches are deleted; a block
+// entered only by one jump and not falling through is moved to sit after that jump; and branches and
+// jumps to the instruction that now follows them, or that can never branch, are deleted. Blocks are not
+// moved if that would put a branch out of range, or at all without move_blocks, which keeps a layout chosen
+// by optimizer_profile_layout. Does nothing to .word values, .globl entry points, labels taken by la or the
+// blocks jal returns to.
+InstructionValidateResult optimizer_control_flow(Assembler *assembler, bool move_blocks, ControlFlowStats *stats);
+
+// Reorders basic blocks by counts, one execution count per instruction (see profile.h), so the hottest
+// successor of each block follows it: chains are grown from the entry block and then from the hottest
+// block left, and blocks that never ran end up last. beq and bneq are inverted where their target now
+// follows them, and a jump is added wherever a block's fall-through block went elsewhere; blt, bgt, bltz
+// and bgtz have no single-instruction inverse, so only their fall-through side is ever laid out next.
+// Programs with .word values are left alone, as is the whole program when the new layout would put a
+// branch out of range. Meant to run before the other passes, while counts still match the program.
+InstructionValidateResult optimizer_profile_layout(Assembler *assembler, const uint64_t *counts,
+                                                   ProfileLayoutStats *stats);
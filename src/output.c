@@ -0,0 +1,79 @@
+#include "output.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LISTING_LINE_LENGTH 33
+#define WORDS_PER_FLUSH 32768
+
+// byte_bits[b] holds the eight '0'/'1' characters of b, so a word is formatted with four table loads.
+#define BYTE_BITS(b) {(char) ('0' + ((b) >> 7 & 1)), (char) ('0' + ((b) >> 6 & 1)), (char) ('0' + ((b) >> 5 & 1)), \
+                      (char) ('0' + ((b) >> 4 & 1)), (char) ('0' + ((b) >> 3 & 1)), (char) ('0' + ((b) >> 2 & 1)), \
+                      (char) ('0' + ((b) >> 1 & 1)), (char) ('0' + ((b) & 1))}
+#define BYTE_BITS4(b) BYTE_BITS(b), BYTE_BITS((b) + 1), BYTE_BITS((b) + 2), BYTE_BITS((b) + 3)
+#define BYTE_BITS16(b) BYTE_BITS4(b), BYTE_BITS4((b) + 4), BYTE_BITS4((b) + 8), BYTE_BITS4((b) + 12)
+#define BYTE_BITS64(b) BYTE_BITS16(b), BYTE_BITS16((b) + 16), BYTE_BITS16((b) + 32), BYTE_BITS16((b) + 48)
+
+static const char byte_bits[256][8] = {
+    BYTE_BITS64(0), BYTE_BITS64(64), BYTE_BITS64(128), BYTE_BITS64(192),
+};
+
+bool output_write_listing(FILE *stream, const uint32_t *machine_code, uint32_t count) {
+    char *buffer = malloc(WORDS_PER_FLUSH * LISTING_LINE_LENGTH);
+    if (!buffer) return false;
+
+    bool ok = true;
+    for (uint32_t start = 0; start < count; start += WORDS_PER_FLUSH) {
+        uint32_t end = count - start > WORDS_PER_FLUSH ? start + WORDS_PER_FLUSH : count;
+        char *p = buffer;
+        for (uint32_t i = start; i < end; i++) {
+            uint32_t word = machine_code[i];
+            memcpy(p, byte_bits[word >> 24], 8);
+            memcpy(p + 8, byte_bits[(word >> 16) & 0xFF], 8);
+            memcpy(p + 16, byte_bits[(word >> 8) & 0xFF], 8);
+            memcpy(p + 24, byte_bits[word & 0xFF], 8);
+            p[32] = '\n';
+            p += LISTING_LINE_LENGTH;
+        }
+        size_t size = (size_t) (p - buffer);
+        if (fwrite(buffer, 1, size, stream) != size) {
+            ok = false;
+            break;
+        }
+    }
+
+    free(buffer);
+    return ok;
+}
+
+bool output_write_binary(FILE *stream, const uint32_t *machine_code, uint32_t count) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // The in-memory words already are the image.
+    return fwrite(machine_code, sizeof(uint32_t), count, stream) == count;
+#else
+    uint8_t *buffer = malloc(WORDS_PER_FLUSH * sizeof(uint32_t));
+    if (!buffer) return false;
+
+    bool ok = true;
+    for (uint32_t start = 0; start < count; start += WORDS_PER_FLUSH) {
+        uint32_t end = count - start > WORDS_PER_FLUSH ? start + WORDS_PER_FLUSH : count;
+        uint8_t *p = buffer;
+        for (uint32_t i = start; i < end; i++) {
+            uint32_t word = machine_code[i];
+            p[0] = (uint8_t) word;
+            p[1] = (uint8_t) (word >> 8);
+            p[2] = (uint8_t) (word >> 16);
+            p[3] = (uint8_t) (word >> 24);
+            p += sizeof(uint32_t);
+        }
+        size_t size = (size_t) (p - buffer);
+        if (fwrite(buffer, 1, size, stream) != size) {
+            ok = false;
+            break;
+        }
+    }
+
+    free(buffer);
+    return ok;
+#endif
+}
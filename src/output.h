@@ -0,0 +1,10 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// One line of 32 '0'/'1' characters per word, most significant bit first.
+bool output_write_listing(FILE *stream, const uint32_t *machine_code, uint32_t count);
+
+// The words as a little-endian byte image.
+bool output_write_binary(FILE *stream, const uint32_t *machine_code, uint32_t count);
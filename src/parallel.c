@@ -0,0 +1,357 @@
+#include "parallel.h"
+#include "lexer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_CHUNK_SIZE (64 * 1024)
+#define CHUNKS_PER_THREAD 4
+
+typedef struct {
+    uint32_t symbol; // chunk-local symbol ID
+    uint32_t line;   // chunk-relative source line
+    uint32_t column;
+} ChunkLabel;
+
+typedef struct {
+    uint32_t instruction; // chunk-local index of an instruction with a label operand
+    uint32_t line;        // chunk-relative source line
+    uint32_t column;
+} ChunkReference;
+
+typedef struct {
+    const char *start;
+    size_t size;
+    Assembler *local;
+    ChunkLabel *definitions;
+    uint32_t definition_count;
+    uint32_t definition_capacity;
+    ChunkReference *references; // in instruction order
+    uint32_t reference_count;
+    uint32_t reference_capacity;
+    uint32_t *global_symbols; // chunk-local symbol ID -> symbol ID in the merged table
+    uint32_t line_count;
+    uint32_t first_line;
+    uint32_t instruction_offset;
+} Chunk;
+
+typedef struct {
+    Assembler *assembler;
+    Chunk *chunks;
+} ParallelJob;
+
+// Errors of a chunk are recorded on its local assembler, with chunk-relative lines, so workers never share
+// an error list.
+static void chunk_record_error(Chunk *chunk, InstructionValidateResult error, uint32_t line, uint32_t column,
+                               const char *message) {
+    assembler_set_location(chunk->local, line, column);
+    assembler_set_error(chunk->local, error, message);
+}
+
+static bool chunk_add_definition(Chunk *chunk, uint32_t symbol, uint32_t line, uint32_t column) {
+    if (chunk->definition_count >= chunk->definition_capacity) {
+        uint32_t new_capacity = chunk->definition_capacity ? chunk->definition_capacity * 2 : 64;
+        ChunkLabel *new_definitions = realloc(chunk->definitions, sizeof(ChunkLabel) * new_capacity);
+        if (!new_definitions) return false;
+        chunk->definitions = new_definitions;
+        chunk->definition_capacity = new_capacity;
+    }
+    chunk->definitions[chunk->definition_count].symbol = symbol;
+    chunk->definitions[chunk->definition_count].line = line;
+    chunk->definitions[chunk->definition_count].column = column;
+    chunk->definition_count++;
+    return true;
+}
+
+static bool chunk_add_reference(Chunk *chunk, uint32_t instruction, uint32_t line, uint32_t column) {
+    if (chunk->reference_count >= chunk->reference_capacity) {
+        uint32_t new_capacity = chunk->reference_capacity ? chunk->reference_capacity * 2 : 64;
+        ChunkReference *new_references = realloc(chunk->references, sizeof(ChunkReference) * new_capacity);
+        if (!new_references) return false;
+        chunk->references = new_references;
+        chunk->reference_capacity = new_capacity;
+    }
+    chunk->references[chunk->reference_count].instruction = instruction;
+    chunk->references[chunk->reference_count].line = line;
+    chunk->references[chunk->reference_count].column = column;
+    chunk->reference_count++;
+    return true;
+}
+
+static void parse_chunk(void *context, uint32_t worker, uint32_t index) {
+    (void) worker;
+    ParallelJob *job = context;
+    Chunk *chunk = &job->chunks[index];
+    Assembler *local = chunk->local;
+
+    Lexer lexer;
+    SourceLine line;
+    lexer_init(&lexer, chunk->start, chunk->size);
+    while (lexer_next_line(&lexer, &line)) {
+        if (line.label) {
+            uint32_t column = (uint32_t) (line.label - line.text) + 1;
+            assembler_set_location(local, line.line_number, column);
+            uint32_t symbol = symbol_table_intern(&local->labels, line.label, line.label_length);
+            if (assembler_add_label_span(local, line.label, line.label_length, assembler_location(local)) &&
+                !chunk_add_definition(chunk, symbol, line.line_number, column)) {
+                chunk_record_error(chunk, ASSEMBLER_ERROR_MEMORY_ALLOCATION, line.line_number, column,
+                                   "Failed to expand label table");
+            }
+        }
+        if (line.token_count == 0) {
+            continue;
+        }
+
+        uint32_t column = (uint32_t) (line.tokens[0].start - line.text) + 1;
+        uint32_t first = local->instruction_count;
+        assembler_set_location(local, line.line_number, column);
+        assembler_add_statement(local, &line);
+        // Label operands are only resolved in encode_chunk, which reports them against this line.
+        for (uint32_t i = first; i < local->instruction_count; i++) {
+            if (local->instruction_symbols[i] != ASSEMBLER_NO_SYMBOL &&
+                !chunk_add_reference(chunk, i, line.line_number, column)) {
+                chunk_record_error(chunk, ASSEMBLER_ERROR_MEMORY_ALLOCATION, line.line_number, column,
+                                   "Failed to expand reference table");
+                break;
+            }
+        }
+    }
+    chunk->line_count = lexer.line_number;
+}
+
+static void encode_chunk(void *context, uint32_t worker, uint32_t index) {
+    (void) worker;
+    ParallelJob *job = context;
+    Chunk *chunk = &job->chunks[index];
+    const Assembler *local = chunk->local;
+    const Label *labels = job->assembler->labels.labels;
+    uint32_t *out = job->assembler->machine_code + chunk->instruction_offset;
+    const ChunkReference *reference = chunk->references;
+
+    for (uint32_t i = 0; i < local->instruction_count; i++) {
+        uint32_t word = local->machine_code[i];
+        uint32_t symbol = local->instruction_symbols[i];
+
+        if (symbol != ASSEMBLER_NO_SYMBOL) {
+            // Every instruction with a label operand has its reference, in the same order.
+            uint32_t line = reference->line;
+            uint32_t column = reference->column;
+            reference++;
+            uint8_t type = local->instruction_types[i];
+            uint32_t label_line = labels[chunk->global_symbols[symbol]].instruction_line;
+            if (label_line == SYMBOL_UNDEFINED) {
+                chunk_record_error(chunk, ASSEMBLER_ERROR_INVALID_LABEL, line, column,
+                                   "Reference to an undefined label");
+            } else {
+                InstructionValidateResult patched = assembler_patch_word(
+                    &word, type, chunk->instruction_offset + i, assembler_reference_target(local, type, label_line));
+                if (patched != ASSEMBLER_SUCCESS) {
+                    chunk_record_error(chunk, patched, line, column, assembler_patch_message(type, patched));
+                }
+            }
+        }
+        out[i] = word;
+    }
+}
+
+// Whether a line of the source is a .data directive. Only lines that contain the text are lexed, so the
+// scan stays a memchr over everything else and comments or names like my.data do not count.
+static bool has_data_section(const char *source, size_t size) {
+    const char *end = source + size;
+    for (const char *p = source; end - p >= 5 && (p = memchr(p, '.', (size_t) (end - p - 4))); p++) {
+        if (memcmp(p, ".data", 5) != 0) continue;
+
+        const char *line_start = p;
+        while (line_start > source && line_start[-1] != '\n') line_start--;
+        const char *line_end = memchr(p, '\n', (size_t) (end - p));
+        if (!line_end) line_end = end;
+
+        Lexer lexer;
+        SourceLine line;
+        lexer_init(&lexer, line_start, (size_t) (line_end - line_start));
+        if (lexer_next_line(&lexer, &line) && lexer_is_directive(&line) && line.tokens[0].length == 5 &&
+            memcmp(line.tokens[0].start, ".data", 5) == 0) {
+            return true;
+        }
+        if (line_end == end) break;
+        p = line_end;
+    }
+    return false;
+}
+
+// Splits the source into chunks that end right after a newline so no line straddles two chunks.
+static uint32_t split_source(const char *source, size_t size, uint32_t chunk_count, Chunk *chunks) {
+    uint32_t count = 0;
+    const char *cursor = source;
+    const char *end = source + size;
+
+    for (uint32_t i = 0; i < chunk_count && cursor < end; i++) {
+        const char *chunk_end = end;
+        if (i + 1 < chunk_count) {
+            const char *target = source + size / chunk_count * (i + 1);
+            if (target < cursor) target = cursor;
+            const char *newline = memchr(target, '\n', (size_t) (end - target));
+            chunk_end = newline ? newline + 1 : end;
+        }
+        chunks[count].start = cursor;
+        chunks[count].size = (size_t) (chunk_end - cursor);
+        count++;
+        cursor = chunk_end;
+    }
+    return count;
+}
+
+static InstructionValidateResult merge_labels(Assembler *assembler, Chunk *chunks, uint32_t chunk_count) {
+    uint32_t instruction_offset = 0;
+    uint32_t first_line = 0;
+
+    for (uint32_t c = 0; c < chunk_count; c++) {
+        Chunk *chunk = &chunks[c];
+        const SymbolTable *local_labels = &chunk->local->labels;
+        chunk->instruction_offset = instruction_offset;
+        chunk->first_line = first_line;
+
+        if (chunk->local->instruction_count > UINT32_MAX - instruction_offset) {
+            return ASSEMBLER_ERROR_BUFFER_FULL;
+        }
+        instruction_offset += chunk->local->instruction_count;
+        first_line += chunk->line_count;
+
+        chunk->global_symbols = malloc(sizeof(uint32_t) * (local_labels->label_count ? local_labels->label_count : 1));
+        if (!chunk->global_symbols) return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+
+        for (uint32_t s = 0; s < local_labels->label_count; s++) {
+            const Label *label = &local_labels->labels[s];
+            uint32_t symbol = symbol_table_intern(&assembler->labels, local_labels->strings + label->name,
+                                                  label->name_length);
+            if (symbol == SYMBOL_TABLE_EMPTY) return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+            chunk->global_symbols[s] = symbol;
+        }
+
+        for (uint32_t d = 0; d < chunk->definition_count; d++) {
+            const ChunkLabel *definition = &chunk->definitions[d];
+            uint32_t local_line = local_labels->labels[definition->symbol].instruction_line;
+            if (symbol_table_define(&assembler->labels, chunk->global_symbols[definition->symbol],
+                                    chunk->instruction_offset + local_line) != SYMBOL_TABLE_OK) {
+                chunk_record_error(chunk, ASSEMBLER_ERROR_DUPLICATE_LABEL, definition->line, definition->column,
+                                   "Label is already defined");
+            }
+        }
+    }
+
+    assembler->instruction_count = instruction_offset;
+    return ASSEMBLER_SUCCESS;
+}
+
+static void free_chunks(Chunk *chunks, uint32_t chunk_count) {
+    for (uint32_t c = 0; c < chunk_count; c++) {
+        assembler_destroy(chunks[c].local);
+        free(chunks[c].definitions);
+        free(chunks[c].references);
+        free(chunks[c].global_symbols);
+    }
+    free(chunks);
+}
+
+static int compare_errors(const void *a, const void *b) {
+    const AssemblerError *x = a;
+    const AssemblerError *y = b;
+    // Errors without a line sort last.
+    uint32_t x_line = x->line ? x->line : UINT32_MAX;
+    uint32_t y_line = y->line ? y->line : UINT32_MAX;
+    if (x_line != y_line) return x_line < y_line ? -1 : 1;
+    if (x->column != y->column) return x->column < y->column ? -1 : 1;
+    return 0;
+}
+
+// Moves every chunk's errors into the assembler's list, translated to absolute lines and sorted into
+// source order, and makes the first of them the assembler's last_error.
+static InstructionValidateResult collect_errors(Assembler *assembler, Chunk *chunks, uint32_t chunk_count) {
+    uint32_t first_new = assembler->error_count;
+    for (uint32_t c = 0; c < chunk_count; c++) {
+        Assembler *local = chunks[c].local;
+        for (uint32_t e = 0; e < local->error_count; e++) {
+            const AssemblerError *error = &local->errors[e];
+            assembler_set_location(assembler, error->line ? chunks[c].first_line + error->line : 0, error->column);
+            assembler_set_error(assembler, error->code, error->message);
+        }
+        local->error_count = 0;
+    }
+    assembler_set_location(assembler, 0, 0);
+
+    if (assembler->error_count == first_new) return ASSEMBLER_SUCCESS;
+
+    qsort(assembler->errors + first_new, assembler->error_count - first_new, sizeof(AssemblerError),
+          compare_errors);
+    const AssemblerError *first = &assembler->errors[first_new];
+    assembler->last_error = first->code;
+    snprintf(assembler->error_message, sizeof(assembler->error_message), "%s", first->message);
+    return first->code;
+}
+
+InstructionValidateResult assembler_assemble_parallel(Assembler *assembler, ThreadPool *pool,
+                                                      const char *source, size_t size) {
+    if (!assembler || !pool || (!source && size > 0)) {
+        return ASSEMBLER_ERROR_NULL_POINTER;
+    }
+    if (assembler->instruction_count > 0 || assembler->labels.label_count > 0) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Parallel assembly needs an empty assembler");
+        return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+    }
+
+    // A chunk cannot tell which section it starts in, so sources with a .data section are assembled serially.
+    if (has_data_section(source, size)) return assembler_assemble_source(assembler, source, size);
+
+    uint32_t chunk_count = thread_pool_size(pool) * CHUNKS_PER_THREAD;
+    if (size / MIN_CHUNK_SIZE + 1 < chunk_count) {
+        chunk_count = (uint32_t) (size / MIN_CHUNK_SIZE + 1);
+    }
+
+    Chunk *chunks = calloc(chunk_count, sizeof(Chunk));
+    if (!chunks) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to allocate chunks");
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
+    chunk_count = split_source(source, size, chunk_count, chunks);
+
+    for (uint32_t c = 0; c < chunk_count; c++) {
+        chunks[c].local = assembler_create();
+        if (!chunks[c].local) {
+            free_chunks(chunks, chunk_count);
+            assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to create chunk assembler");
+            return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+
+    ParallelJob job = {assembler, chunks};
+    thread_pool_run(pool, chunk_count, parse_chunk, &job);
+
+    InstructionValidateResult result = merge_labels(assembler, chunks, chunk_count);
+    if (result == ASSEMBLER_SUCCESS) {
+        result = collect_errors(assembler, chunks, chunk_count);
+    } else {
+        assembler_set_error(assembler, result, "Failed to merge label tables");
+    }
+
+    // Everything gets resolved here; one-pass mode spares the reservation the per-instruction arrays and
+    // makes assembler_generate_machine_code hand the words back as is.
+    assembler->one_pass = true;
+    if (result == ASSEMBLER_SUCCESS && !assembler_reserve(assembler, assembler->instruction_count)) {
+        result = ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+        assembler_set_error(assembler, result, "Failed to expand instruction buffer");
+    }
+
+    if (result == ASSEMBLER_SUCCESS) {
+        thread_pool_run(pool, chunk_count, encode_chunk, &job);
+        result = collect_errors(assembler, chunks, chunk_count);
+    }
+
+    if (result != ASSEMBLER_SUCCESS) {
+        assembler->instruction_count = 0;
+        assembler->one_pass = false;
+    }
+
+    free_chunks(chunks, chunk_count);
+    return result;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "assembler.h"
+#include "thread_pool.h"
+
+#include <stddef.h>
+
+// Assembles a whole source buffer into an empty assembler using every thread of the pool. The source is
+// split at line boundaries; chunks are parsed and validated independently, their label tables merged in
+// source order, and the encoded words are then resolved in parallel over disjoint ranges of machine_code.
+// The result is identical to feeding the same lines through assembler_add_and_validate_instruction and
+// assembler_generate_machine_code, and the assembler is left fully resolved.
+//
+// On failure every error is in assembler->errors, in source order, and the first one is returned and
+// becomes the assembler's last_error.
+InstructionValidateResult assembler_assemble_parallel(Assembler *assembler, ThreadPool *pool,
+                                                      const char *source, size_t size);
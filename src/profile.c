@@ -0,0 +1,61 @@
+#include "profile.h"
+#include "lexer.h"
+
+#include <stdlib.h>
+
+static bool profile_fail(uint32_t *line, const char **message, uint32_t line_number, const char *text) {
+    *line = line_number;
+    *message = text;
+    return false;
+}
+
+bool profile_parse(Profile *profile, const Assembler *assembler, const char *text, size_t size, uint32_t *line,
+                   const char **message) {
+    uint32_t count = assembler->instruction_count;
+    profile->count = count;
+    profile->counts = calloc((size_t) count + 1, sizeof(uint64_t));
+    if (!profile->counts) return profile_fail(line, message, 0, "Failed to allocate profile");
+
+    Lexer lexer;
+    SourceLine source_line;
+    lexer_init(&lexer, text, size);
+    while (lexer_next_line(&lexer, &source_line)) {
+        if (source_line.token_count == 0 && !source_line.label) continue;
+
+        const Token *tokens = source_line.tokens;
+        if (source_line.label || source_line.token_count != 2 || tokens[1].kind != TOKEN_NUMBER ||
+            tokens[1].value < 0) {
+            profile_free(profile);
+            return profile_fail(line, message, source_line.line_number, "Expected a label or index and a count");
+        }
+
+        uint32_t instruction;
+        if (tokens[0].kind == TOKEN_IDENTIFIER) {
+            const Label *label = symbol_table_find(&assembler->labels, tokens[0].start, tokens[0].length);
+            instruction = label ? label->instruction_line : SYMBOL_UNDEFINED;
+        } else if (tokens[0].kind == TOKEN_NUMBER && tokens[0].value >= 0 && tokens[0].value < count) {
+            instruction = (uint32_t) tokens[0].value;
+        } else {
+            profile_free(profile);
+            return profile_fail(line, message, source_line.line_number, "Instruction index is out of range");
+        }
+        // A label at the very end marks the exit, which never runs anything; .data labels are a mistake.
+        if (instruction == count) continue;
+        if (instruction > count) {
+            profile_free(profile);
+            return profile_fail(line, message, source_line.line_number, "Label marks no instruction");
+        }
+
+        uint64_t total = profile->counts[instruction] + (uint64_t) tokens[1].value;
+        profile->counts[instruction] = total < profile->counts[instruction] ? UINT64_MAX : total;
+    }
+    return true;
+}
+
+void profile_free(Profile *profile) {
+    if (profile) {
+        free(profile->counts);
+        profile->counts = NULL;
+        profile->count = 0;
+    }
+}
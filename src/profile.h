@@ -0,0 +1,30 @@
+#pragma once
+#include "assembler.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Execution counts for the instructions of a two-pass assembler's program, read from a text profile with
+// one entry per line:
+//
+//   # comment         '#' and ';' start comments, as in assembly; blank lines are ignored
+//   loop 1000000      a label and the count of the instruction it marks
+//   12 250            an instruction index, as in the listing written without -O, and its count
+//
+// Counts are decimal, 0x hex or 0b binary. Entries for the same instruction add up, so profiles of several
+// runs can simply be concatenated, and instructions never mentioned count zero. optimizer_profile_layout
+// weighs each basic block by its highest count; a block with none, like the fall-through side of a branch
+// that has no label, is credited with its predecessor's count less the branch target's. That is exact when
+// nothing but the branch enters its target; otherwise give the block an index entry of its own.
+typedef struct {
+    uint64_t *counts; // one per instruction
+    uint32_t count;
+} Profile;
+
+// Parses text against the assembler's labels and instruction count. On failure *line is the 1-based
+// profile line at fault, or 0 when memory ran out, and *message says what is wrong.
+bool profile_parse(Profile *profile, const Assembler *assembler, const char *text, size_t size, uint32_t *line,
+                   const char **message);
+
+void profile_free(Profile *profile);
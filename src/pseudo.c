@@ -0,0 +1,183 @@
+#include "pseudo.h"
+
+#include <string.h>
+
+#define REGISTER_ZERO 0
+#define REGISTER_AT 8
+#define REGISTER_SP 29
+
+typedef enum {
+    PSEUDO_LI,
+    PSEUDO_LA,
+    PSEUDO_MOVE,
+    PSEUDO_NOP,
+    PSEUDO_BGE,
+    PSEUDO_BLE,
+    PSEUDO_PUSH,
+    PSEUDO_POP,
+    PSEUDO_NONE,
+} PseudoKind;
+
+#define PACK4(a, b, c, d) ((uint32_t) (a) | (uint32_t) (b) << 8 | (uint32_t) (c) << 16 | (uint32_t) (d) << 24)
+
+// Every pseudo mnemonic is at most four bytes, so each is compared as one packed little-endian key.
+static const struct {
+    uint32_t key;
+    uint32_t token_count; // the mnemonic and its operands
+} pseudo_table[] = {
+    [PSEUDO_LI] = {PACK4('l', 'i', 0, 0), 3},
+    [PSEUDO_LA] = {PACK4('l', 'a', 0, 0), 3},
+    [PSEUDO_MOVE] = {PACK4('m', 'o', 'v', 'e'), 3},
+    [PSEUDO_NOP] = {PACK4('n', 'o', 'p', 0), 1},
+    [PSEUDO_BGE] = {PACK4('b', 'g', 'e', 0), 4},
+    [PSEUDO_BLE] = {PACK4('b', 'l', 'e', 0), 4},
+    [PSEUDO_PUSH] = {PACK4('p', 'u', 's', 'h'), 2},
+    [PSEUDO_POP] = {PACK4('p', 'o', 'p', 0), 2},
+};
+
+static PseudoKind pseudo_kind(const Token *token) {
+    if (token->kind != TOKEN_IDENTIFIER || token->length < 2 || token->length > 4) return PSEUDO_NONE;
+
+    uint32_t key = 0;
+    for (uint32_t i = 0; i < token->length; i++) key |= (uint32_t) (uint8_t) token->start[i] << (8 * i);
+    for (PseudoKind kind = 0; kind < PSEUDO_NONE; kind++) {
+        if (pseudo_table[kind].key == key) return kind;
+    }
+    return PSEUDO_NONE;
+}
+
+bool pseudo_is_mnemonic(const Token *token) {
+    return pseudo_kind(token) != PSEUDO_NONE;
+}
+
+// Unknown registers become 0xFF, which validation rejects, as in parse_source_line.
+static uint8_t register_operand(const Token *token) {
+    return token->kind == TOKEN_REGISTER ? (uint8_t) token->value : 0xFF;
+}
+
+static Instruction *emit(PseudoExpansion *expansion, IsaRow row, uint8_t type) {
+    const InstructionDef *def = instruction_def(row);
+    Instruction *inst = &expansion->instructions[expansion->count];
+    expansion->types[expansion->count++] = type;
+    memset(inst, 0, sizeof(*inst));
+    inst->type = def->type;
+    if (def->type == R_TYPE) {
+        inst->data.r.opcode = def->opcode;
+        inst->data.r.funct = def->funct;
+    } else {
+        inst->data.i.opcode = def->opcode;
+    }
+    return inst;
+}
+
+static void emit_r(PseudoExpansion *expansion, IsaRow row, uint8_t rd, uint8_t rs, uint8_t rt) {
+    Instruction *inst = emit(expansion, row, R_TYPE);
+    inst->data.r.rd = rd;
+    inst->data.r.rs = rs;
+    inst->data.r.rt = rt;
+}
+
+// addi, and the memory instructions with rs as the base register.
+static void emit_i(PseudoExpansion *expansion, IsaRow row, uint8_t rt, uint8_t rs, int16_t immediate) {
+    Instruction *inst = emit(expansion, row, I_TYPE);
+    inst->data.i.rt = rt;
+    inst->data.i.rs = rs;
+    inst->data.i.immediate = immediate;
+}
+
+static void emit_branch(PseudoExpansion *expansion, IsaRow row, uint8_t rs, uint8_t rt, const Token *label) {
+    Instruction *inst = emit(expansion, row, I_TYPE);
+    inst->data.i.rs = rs;
+    inst->data.i.rt = rt;
+    inst->label_ref = label->start;
+    inst->label_length = label->length;
+}
+
+static InstructionValidateResult expand_li(const Token tokens[], PseudoExpansion *expansion, const char **message) {
+    const Token *constant = &tokens[2];
+    if (constant->kind != TOKEN_NUMBER || constant->base >= 0 || constant->value < INT32_MIN ||
+        constant->value > UINT32_MAX) {
+        *message = "Constant does not fit in 32 bits";
+        return ASSEMBLER_ERROR_INVALID_IMMEDIATE;
+    }
+
+    uint8_t rt = register_operand(&tokens[1]);
+    int32_t value = (int32_t) (uint32_t) constant->value;
+    if (value >= INT16_MIN && value <= INT16_MAX) {
+        emit_i(expansion, ISA_ROW_ADDI, rt, REGISTER_ZERO, (int16_t) value);
+        return ASSEMBLER_SUCCESS;
+    }
+    if (rt == REGISTER_AT) {
+        *message = "li into $at needs a 16-bit constant";
+        return ASSEMBLER_ERROR_INVALID_REGISTER;
+    }
+
+    uint32_t shift = (uint32_t) __builtin_ctz((uint32_t) value);
+    int32_t significant = value >> shift;
+    if (significant >= INT16_MIN && significant <= INT16_MAX) {
+        emit_i(expansion, ISA_ROW_ADDI, rt, REGISTER_ZERO, (int16_t) significant);
+        emit_i(expansion, ISA_ROW_ADDI, REGISTER_AT, REGISTER_ZERO, (int16_t) shift);
+        emit_r(expansion, ISA_ROW_SLL, rt, rt, REGISTER_AT);
+        return ASSEMBLER_SUCCESS;
+    }
+
+    // The lower half is added sign-extended, so the upper half absorbs its borrow.
+    int16_t low = (int16_t) (value & 0xFFFF);
+    uint16_t high = (uint16_t) (((uint32_t) value - (uint32_t) (int32_t) low) >> 16);
+    emit_i(expansion, ISA_ROW_ADDI, rt, REGISTER_ZERO, (int16_t) high);
+    emit_i(expansion, ISA_ROW_ADDI, REGISTER_AT, REGISTER_ZERO, 16);
+    emit_r(expansion, ISA_ROW_SLL, rt, rt, REGISTER_AT);
+    emit_i(expansion, ISA_ROW_ADDI, rt, rt, low);
+    return ASSEMBLER_SUCCESS;
+}
+
+InstructionValidateResult pseudo_expand(const SourceLine *line, PseudoExpansion *expansion, const char **message) {
+    expansion->count = 0;
+    PseudoKind kind = line->token_count > 0 ? pseudo_kind(&line->tokens[0]) : PSEUDO_NONE;
+    if (kind == PSEUDO_NONE || line->token_count != pseudo_table[kind].token_count) {
+        *message = "Invalid instruction provided";
+        return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+    }
+
+    const Token *tokens = line->tokens;
+    switch (kind) {
+        case PSEUDO_LI:
+            return expand_li(tokens, expansion, message);
+        case PSEUDO_LA: {
+            if (tokens[2].kind != TOKEN_IDENTIFIER) break;
+            Instruction *inst = emit(expansion, ISA_ROW_ADDI, ASSEMBLER_TYPE_ADDRESS);
+            inst->data.i.rt = register_operand(&tokens[1]);
+            inst->data.i.rs = REGISTER_ZERO;
+            inst->label_ref = tokens[2].start;
+            inst->label_length = tokens[2].length;
+            return ASSEMBLER_SUCCESS;
+        }
+        case PSEUDO_MOVE:
+            emit_r(expansion, ISA_ROW_ADD, register_operand(&tokens[1]), register_operand(&tokens[2]), REGISTER_ZERO);
+            return ASSEMBLER_SUCCESS;
+        case PSEUDO_NOP:
+            emit_r(expansion, ISA_ROW_ADD, REGISTER_ZERO, REGISTER_ZERO, REGISTER_ZERO);
+            return ASSEMBLER_SUCCESS;
+        case PSEUDO_BGE:
+        case PSEUDO_BLE: {
+            if (tokens[3].kind != TOKEN_IDENTIFIER) break;
+            uint8_t rs = register_operand(&tokens[1]);
+            uint8_t rt = register_operand(&tokens[2]);
+            emit_branch(expansion, kind == PSEUDO_BGE ? ISA_ROW_BGT : ISA_ROW_BLT, rs, rt, &tokens[3]);
+            emit_branch(expansion, ISA_ROW_BEQ, rs, rt, &tokens[3]);
+            return ASSEMBLER_SUCCESS;
+        }
+        case PSEUDO_PUSH:
+            emit_i(expansion, ISA_ROW_ADDI, REGISTER_SP, REGISTER_SP, -4);
+            emit_i(expansion, ISA_ROW_SW, register_operand(&tokens[1]), REGISTER_SP, 0);
+            return ASSEMBLER_SUCCESS;
+        case PSEUDO_POP:
+            emit_i(expansion, ISA_ROW_LW, register_operand(&tokens[1]), REGISTER_SP, 0);
+            emit_i(expansion, ISA_ROW_ADDI, REGISTER_SP, REGISTER_SP, 4);
+            return ASSEMBLER_SUCCESS;
+        default:
+            break;
+    }
+    *message = "Invalid instruction provided";
+    return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "assembler.h"
+#include "lexer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Pseudo-instructions and what they expand to while the line is parsed:
+//
+//   li rt, value        addi rt, $zero, value when value fits 16 bits; otherwise value = s << k with s in
+//                       16 bits takes addi rt, $zero, s / addi $at, $zero, k / sll rt, rt, $at, and anything
+//                       else the upper half shifted into place followed by addi rt, rt, lower half
+//   la rt, label        addi rt, $zero, label's byte address in the image, which must fit 16 bits: four
+//                       times the instruction index for a .text label, as jr expects
+//   move rd, rs         add rd, rs, $zero
+//   nop                 add $zero, $zero, $zero
+//   bge rs, rt, label   bgt rs, rt, label / beq rs, rt, label
+//   ble rs, rt, label   blt rs, rt, label / beq rs, rt, label
+//   push rt             addi $sp, $sp, -4 / sw rt, 0($sp)
+//   pop rt              lw rt, 0($sp) / addi $sp, $sp, 4
+//
+// Only li's longer forms use $at (register 8), so li cannot load such a constant into $at itself. Each
+// expansion is as long as its own operands need, and labels after it count the instructions actually added.
+#define PSEUDO_MAX_EXPANSION 4
+
+typedef struct {
+    Instruction instructions[PSEUDO_MAX_EXPANSION];
+    uint8_t types[PSEUDO_MAX_EXPANSION]; // instruction_types entry of each
+    uint32_t count;
+} PseudoExpansion;
+
+bool pseudo_is_mnemonic(const Token *token);
+
+// Expands a line whose mnemonic is a pseudo-instruction. The instructions still have to be validated; when
+// the operands are wrong an error is returned and *message is set to describe it.
+InstructionValidateResult pseudo_expand(const SourceLine *line, PseudoExpansion *expansion, const char **message);
@@ -0,0 +1,243 @@
+#include "schedule.h"
+#include "cfg.h"
+#include "isa.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REGISTER_RA 31
+#define BASE_UNKNOWN 32 // label operands, whose offset is only known once the program is generated
+#define NOT_ZERO(mask) ((mask) & ~1u) // $zero never carries a dependency
+
+typedef enum {
+    ACCESS_NONE,
+    ACCESS_LOAD,
+    ACCESS_STORE,
+} MemoryAccess;
+
+// What the scheduler needs to know about one instruction.
+typedef struct {
+    uint32_t reads;  // bit n set when register n is read
+    uint32_t writes; // bit n set when register n is written
+    uint32_t latency;
+    ControlKind control;
+    MemoryAccess access;
+    uint32_t width; // bytes accessed
+    uint32_t base;
+    int32_t offset;
+} Operation;
+
+static Operation operation_of(const Assembler *assembler, uint32_t instruction, const PipelineModel *model) {
+    Operation op = {.latency = model->alu_latency, .control = cfg_control(assembler, instruction)};
+    uint32_t word = assembler->machine_code[instruction];
+    const InstructionDef *def = assembler->instruction_types[instruction] == ASSEMBLER_TYPE_DATA
+                                    ? NULL
+                                    : decode_instruction(word);
+    if (!def) return op;
+
+    uint32_t rs = (word >> 21) & 0x1F;
+    uint32_t rt = (word >> 16) & 0x1F;
+    uint32_t rd = (word >> 11) & 0x1F;
+    switch (def->format) {
+        case OPERANDS_REGISTER:
+            op.reads = 1u << rs | (def->funct == FUNCT_JR ? 0 : 1u << rt);
+            op.writes = def->funct == FUNCT_JR ? 0 : 1u << rd;
+            break;
+        case OPERANDS_IMMEDIATE:
+            op.reads = 1u << rs;
+            op.writes = 1u << rt;
+            break;
+        case OPERANDS_MEMORY:
+            op.base = assembler->instruction_types[instruction] == ASSEMBLER_TYPE_ADDRESS ? BASE_UNKNOWN : rs;
+            op.offset = (int16_t) (word & 0xFFFF);
+            op.width = def->opcode == OPCODE_LW || def->opcode == OPCODE_SW   ? 4
+                       : def->opcode == OPCODE_LH || def->opcode == OPCODE_SH ? 2
+                                                                              : 1;
+            if (def->opcode == OPCODE_LW || def->opcode == OPCODE_LH || def->opcode == OPCODE_LB) {
+                op.access = ACCESS_LOAD;
+                op.reads = 1u << rs;
+                op.writes = 1u << rt;
+                op.latency = model->load_latency;
+            } else {
+                op.access = ACCESS_STORE;
+                op.reads = 1u << rs | 1u << rt;
+            }
+            break;
+        case OPERANDS_BRANCH:
+            op.reads = 1u << rs | (def->opcode == OPCODE_BLTZ || def->opcode == OPCODE_BGTZ ? 0 : 1u << rt);
+            break;
+        case OPERANDS_JUMP:
+            op.writes = op.control == CONTROL_CALL ? 1u << REGISTER_RA : 0;
+            break;
+    }
+    op.reads = NOT_ZERO(op.reads);
+    op.writes = NOT_ZERO(op.writes);
+    return op;
+}
+
+static bool reads_early(const Operation *op) {
+    return op->control != CONTROL_NONE;
+}
+
+// Issue cycle of the last instruction and, per register, the first cycle an ordinary instruction may
+// issue and read it.
+typedef struct {
+    uint64_t cycle;
+    uint64_t ready[32];
+} Timing;
+
+static uint64_t issue_cycle(const Timing *timing, const Operation *op, const PipelineModel *model) {
+    uint64_t cycle = timing->cycle + 1;
+    uint64_t early = reads_early(op) ? model->branch_read_early : 0;
+    for (uint32_t reads = op->reads; reads; reads &= reads - 1) {
+        uint64_t ready = timing->ready[__builtin_ctz(reads)] + early;
+        if (ready > cycle) cycle = ready;
+    }
+    return cycle;
+}
+
+static void issue(Timing *timing, const Operation *op, uint64_t cycle, const PipelineModel *model) {
+    timing->cycle = cycle;
+    for (uint32_t writes = op->writes; writes; writes &= writes - 1) {
+        timing->ready[__builtin_ctz(writes)] = cycle + op->latency;
+    }
+    if (op->control == CONTROL_JUMP || op->control == CONTROL_CALL || op->control == CONTROL_INDIRECT) {
+        timing->cycle += model->taken_penalty;
+    }
+}
+
+uint64_t schedule_estimate_cycles(const Assembler *assembler, const PipelineModel *model) {
+    if (!assembler || !model || assembler->one_pass) return 0;
+
+    Timing timing = {0};
+    for (uint32_t i = 0; i < assembler->instruction_count; i++) {
+        Operation op = operation_of(assembler, i, model);
+        issue(&timing, &op, issue_cycle(&timing, &op, model), model);
+    }
+    return timing.cycle;
+}
+
+// Whether two memory accesses, at least one a store, may touch the same bytes. base_written tells whether
+// anything between them writes the first one's base register.
+static bool may_alias(const Operation *first, const Operation *second, bool base_written) {
+    if (first->base != second->base || base_written) return true;
+    return first->offset < second->offset + (int32_t) second->width &&
+           second->offset < first->offset + (int32_t) first->width;
+}
+
+// List-schedules [start, end), which holds no branch or jump, continuing from timing. Each step issues the
+// ready instruction that can go soonest, preferring the one with the longest dependent path after it.
+// follower is the block's branch or jump, whose operands count towards those paths, or NULL.
+static uint32_t schedule_window(Assembler *assembler, uint32_t start, uint32_t end, const Operation *follower,
+                                Timing *timing, const PipelineModel *model) {
+    uint32_t n = end - start;
+    Operation ops[SCHEDULE_WINDOW];
+    uint64_t predecessors[SCHEDULE_WINDOW] = {0};
+    uint64_t heights[SCHEDULE_WINDOW];
+    for (uint32_t i = 0; i < n; i++) ops[i] = operation_of(assembler, start + i, model);
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t written = 0; // registers written strictly between j and i
+        for (uint32_t j = i; j-- > 0;) {
+            bool dependent = (ops[j].writes & (ops[i].reads | ops[i].writes)) || (ops[j].reads & ops[i].writes);
+            if (!dependent && ops[j].access != ACCESS_NONE && ops[i].access != ACCESS_NONE &&
+                (ops[j].access == ACCESS_STORE || ops[i].access == ACCESS_STORE)) {
+                dependent = may_alias(&ops[j], &ops[i], ((uint64_t) written >> ops[j].base) & 1);
+            }
+            if (dependent) predecessors[i] |= 1ull << j;
+            written |= ops[j].writes;
+        }
+    }
+
+    for (uint32_t i = n; i-- > 0;) {
+        uint64_t height = 0;
+        if (follower && (ops[i].writes & follower->reads)) height = ops[i].latency + model->branch_read_early;
+        for (uint32_t k = i + 1; k < n; k++) {
+            if (!(predecessors[k] >> i & 1)) continue;
+            uint64_t edge = (ops[i].writes & ops[k].reads) ? ops[i].latency : 1;
+            if (edge + heights[k] > height) height = edge + heights[k];
+        }
+        heights[i] = height;
+    }
+
+    uint8_t order[SCHEDULE_WINDOW];
+    uint64_t scheduled = 0;
+    for (uint32_t step = 0; step < n; step++) {
+        uint32_t best = n;
+        uint64_t best_cycle = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if ((scheduled >> i & 1) || (predecessors[i] & ~scheduled)) continue;
+            uint64_t cycle = issue_cycle(timing, &ops[i], model);
+            if (best == n || cycle < best_cycle || (cycle == best_cycle && heights[i] > heights[best])) {
+                best = i;
+                best_cycle = cycle;
+            }
+        }
+        issue(timing, &ops[best], best_cycle, model);
+        scheduled |= 1ull << best;
+        order[step] = (uint8_t) best;
+    }
+
+    uint32_t words[SCHEDULE_WINDOW];
+    uint32_t symbols[SCHEDULE_WINDOW];
+    uint8_t types[SCHEDULE_WINDOW];
+    uint32_t moved = 0;
+    for (uint32_t k = 0; k < n; k++) {
+        words[k] = assembler->machine_code[start + order[k]];
+        symbols[k] = assembler->instruction_symbols[start + order[k]];
+        types[k] = assembler->instruction_types[start + order[k]];
+        moved += order[k] != k;
+    }
+    memcpy(assembler->machine_code + start, words, sizeof(uint32_t) * n);
+    memcpy(assembler->instruction_symbols + start, symbols, sizeof(uint32_t) * n);
+    memcpy(assembler->instruction_types + start, types, n);
+    return moved;
+}
+
+InstructionValidateResult schedule_program(Assembler *assembler, const PipelineModel *model, ScheduleStats *stats) {
+    if (!assembler || !model) {
+        return ASSEMBLER_ERROR_NULL_POINTER;
+    }
+    if (assembler->one_pass) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_INVALID_INSTRUCTION, "Optimization needs a two-pass assembler");
+        return ASSEMBLER_ERROR_INVALID_INSTRUCTION;
+    }
+
+    ControlFlowGraph cfg;
+    if (!cfg_build(&cfg, assembler)) {
+        assembler_set_error(assembler, ASSEMBLER_ERROR_MEMORY_ALLOCATION, "Failed to allocate scheduler tables");
+        return ASSEMBLER_ERROR_MEMORY_ALLOCATION;
+    }
+    uint64_t cycles_before = schedule_estimate_cycles(assembler, model);
+
+    // Blocks are scheduled in program order, each one starting from the timing the previous one left.
+    Timing timing = {0};
+    uint32_t moved = 0;
+    for (uint32_t b = 0; b < cfg.block_count; b++) {
+        const BasicBlock *block = &cfg.blocks[b];
+        uint32_t body_end = block->control == CONTROL_NONE ? block->end : block->end - 1;
+        Operation last = operation_of(assembler, block->end - 1, model);
+        bool has_data = false;
+        for (uint32_t i = block->start; i < block->end; i++) {
+            has_data |= assembler->instruction_types[i] == ASSEMBLER_TYPE_DATA;
+        }
+
+        for (uint32_t start = block->start; start < body_end && !has_data; start += SCHEDULE_WINDOW) {
+            uint32_t end = body_end - start > SCHEDULE_WINDOW ? start + SCHEDULE_WINDOW : body_end;
+            const Operation *follower = end == body_end && body_end < block->end ? &last : NULL;
+            moved += schedule_window(assembler, start, end, follower, &timing, model);
+        }
+        for (uint32_t i = has_data ? block->start : body_end; i < block->end; i++) {
+            Operation op = operation_of(assembler, i, model);
+            issue(&timing, &op, issue_cycle(&timing, &op, model), model);
+        }
+    }
+    cfg_free(&cfg);
+
+    if (stats) {
+        stats->cycles_before = cycles_before;
+        stats->cycles_after = schedule_estimate_cycles(assembler, model);
+        stats->moved = moved;
+    }
+    return ASSEMBLER_SUCCESS;
+}
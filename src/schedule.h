@@ -0,0 +1,40 @@
+#pragma once
+#include "assembler.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Timing of a single-issue in-order pipeline. An instruction that reads a register waits until the
+// producer's latency has passed since the producer issued: with latency 1 the next instruction can use the
+// result at once, so on the classic 5-stage pipeline with forwarding ALU results have latency 1 and loads
+// latency 2 (one load-use stall). Branches compare in decode and need their operands branch_read_early
+// cycles sooner. Every jump, jal and jr costs taken_penalty cycles; conditional branches are counted as
+// not taken.
+typedef struct {
+    uint32_t alu_latency;
+    uint32_t load_latency;
+    uint32_t branch_read_early;
+    uint32_t taken_penalty;
+} PipelineModel;
+
+#define PIPELINE_MODEL_DEFAULT ((PipelineModel) {1, 2, 1, 1})
+
+typedef struct {
+    uint64_t cycles_before; // schedule_estimate_cycles before and after the pass
+    uint64_t cycles_after;
+    uint32_t moved;         // instructions that changed position
+} ScheduleStats;
+
+// Estimated cycles to run every instruction once in program order, as if each block fell through to the
+// next: one cycle per instruction plus data-hazard stalls plus the jump penalties.
+uint64_t schedule_estimate_cycles(const Assembler *assembler, const PipelineModel *model);
+
+// Reorders the instructions inside each basic block of a two-pass assembler's program to hide the model's
+// stalls, most often by moving independent work between a load and its first use. Only register and memory
+// dependencies are honoured: two accesses through the same base register, unchanged in between, are known
+// apart by their offsets, anything else keeps its order around stores. Block boundaries, labels and every
+// branch or jump stay where they are, blocks holding .word values are left alone, and blocks are handled in
+// windows of SCHEDULE_WINDOW instructions.
+InstructionValidateResult schedule_program(Assembler *assembler, const PipelineModel *model, ScheduleStats *stats);
+
+#define SCHEDULE_WINDOW 64
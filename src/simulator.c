@@ -0,0 +1,331 @@
+#include "simulator.h"
+#include "assembler.h"
+#include "isa.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// One kind per row of isa.h, in the same order, then the two entries past the program's end.
+#define ISA_KIND_R(NAME, name, funct) OP_##NAME,
+#define ISA_KIND_I(NAME, name, format, opcode, width) OP_##NAME,
+#define ISA_KIND_J(NAME, name, opcode) OP_##NAME,
+
+typedef enum {
+    OP_INVALID,
+    ISA_INSTRUCTIONS(ISA_KIND_R, ISA_KIND_I, ISA_KIND_J)
+    OP_HALT,
+    OP_BAD_JUMP,
+    OP_COUNT
+} MicroOpKind;
+
+// Writes to $zero go to this extra register instead, so $zero never needs resetting and reads stay plain loads.
+#define SINK_REGISTER 32
+
+// d is the destination, s and t the sources; operand is the sign-extended immediate, or the predecoded
+// instruction index for branches and jumps.
+struct MicroOp {
+    uint8_t kind;
+    uint8_t d;
+    uint8_t s;
+    uint8_t t;
+    uint32_t operand;
+};
+
+// Same layout as decode_instruction's tables: by opcode, and by funct for opcode 0.
+#define ISA_FUNCT_KIND(NAME, name, funct) [funct] = OP_##NAME,
+#define ISA_OPCODE_KIND_I(NAME, name, format, opcode, width) [opcode] = OP_##NAME,
+#define ISA_OPCODE_KIND_J(NAME, name, opcode) [opcode] = OP_##NAME,
+
+static const uint8_t opcode_kinds[64] = {ISA_INSTRUCTIONS(ISA_IGNORE_R, ISA_OPCODE_KIND_I, ISA_OPCODE_KIND_J)};
+
+static const uint8_t funct_kinds[64] = {ISA_INSTRUCTIONS(ISA_FUNCT_KIND, ISA_IGNORE_I, ISA_IGNORE_J)};
+
+static uint8_t destination(uint32_t reg) {
+    return reg == 0 ? SINK_REGISTER : (uint8_t) reg;
+}
+
+// Targets outside the program point at the bad-jump entry, so taken branches never range-check.
+static uint32_t predecode_target(int64_t target, uint32_t count) {
+    return target >= 0 && target <= count ? (uint32_t) target : count + 1;
+}
+
+static MicroOp predecode(uint32_t word, uint32_t index, uint32_t count) {
+    uint32_t opcode = word >> 26;
+    uint32_t rs = (word >> 21) & 0x1F;
+    uint32_t rt = (word >> 16) & 0x1F;
+    uint32_t rd = (word >> 11) & 0x1F;
+    int32_t immediate = (int16_t) (word & 0xFFFF);
+
+    MicroOp op = {.kind = opcode == 0 ? funct_kinds[word & 0x3F] : opcode_kinds[opcode], .s = (uint8_t) rs,
+                  .t = (uint8_t) rt};
+    switch (op.kind) {
+        case OP_ADD:
+        case OP_SUB:
+        case OP_AND:
+        case OP_OR:
+        case OP_XOR:
+        case OP_SLL:
+        case OP_SRL:
+        case OP_SRA:
+            op.d = destination(rd);
+            break;
+        case OP_ADDI:
+        case OP_LW:
+        case OP_LH:
+        case OP_LB:
+            op.d = destination(rt);
+            op.operand = (uint32_t) immediate;
+            break;
+        case OP_SW:
+        case OP_SH:
+        case OP_SB:
+            op.operand = (uint32_t) immediate;
+            break;
+        case OP_BEQ:
+        case OP_BNEQ:
+        case OP_BLTZ:
+        case OP_BGTZ:
+        case OP_BLT:
+        case OP_BGT:
+            op.operand = predecode_target((int64_t) index + 1 + immediate, count);
+            break;
+        case OP_J:
+        case OP_JAL:
+            op.operand = predecode_target(word & 0x3FFFFFF, count);
+            break;
+        default:
+            break;
+    }
+    return op;
+}
+
+static uint32_t load_memory(const uint8_t *memory, uint32_t address, uint32_t width) {
+    uint8_t bytes[4] = {0};
+    memcpy(bytes, memory + address, width);
+    return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+static void store_memory(uint8_t *memory, uint32_t address, uint32_t value, uint32_t width) {
+    uint8_t bytes[4] = {(uint8_t) value, (uint8_t) (value >> 8), (uint8_t) (value >> 16), (uint8_t) (value >> 24)};
+    memcpy(memory + address, bytes, width);
+}
+
+Simulator *simulator_create(const uint32_t *machine_code, uint32_t count, uint32_t memory_size) {
+    if (!machine_code && count > 0) return NULL;
+    if (count > UINT32_MAX - 2) return NULL;
+
+    // Only the instructions are code; the .data words after them are loaded but never predecoded.
+    uint32_t text_count = assembler_image_text_count(machine_code, &count);
+
+    Simulator *simulator = calloc(1, sizeof(Simulator));
+    if (!simulator) return NULL;
+    simulator->program = malloc(sizeof(MicroOp) * ((size_t) text_count + 2));
+    simulator->memory = calloc(memory_size ? memory_size : 1, 1);
+    if (!simulator->program || !simulator->memory) {
+        simulator_destroy(simulator);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < text_count; i++) simulator->program[i] = predecode(machine_code[i], i, text_count);
+    for (uint32_t i = 0; i < count && (uint64_t) 4 * i + 4 <= memory_size; i++) {
+        store_memory(simulator->memory, 4 * i, machine_code[i], 4);
+    }
+    simulator->program[text_count] = (MicroOp) {.kind = OP_HALT};
+    simulator->program[text_count + 1] = (MicroOp) {.kind = OP_BAD_JUMP};
+    simulator->instruction_count = text_count;
+    simulator->memory_size = memory_size;
+    simulator->registers[29] = memory_size;
+    simulator->status = SIMULATOR_RUNNING;
+    return simulator;
+}
+
+void simulator_destroy(Simulator *simulator) {
+    if (!simulator) return;
+    free(simulator->program);
+    free(simulator->memory);
+    free(simulator);
+}
+
+// Threaded dispatch: every handler ends in its own indirect jump through the handler table, so the host's
+// predictor sees one jump site per micro-op kind rather than a single shared switch.
+SimulatorStatus simulator_run(Simulator *simulator, uint64_t max_instructions) {
+    if (!simulator) return SIMULATOR_INVALID_INSTRUCTION;
+    if (simulator->status != SIMULATOR_RUNNING && simulator->status != SIMULATOR_STEP_LIMIT) {
+        return simulator->status;
+    }
+
+    static const void *const handlers[OP_COUNT] = {
+        [OP_INVALID] = &&op_invalid, [OP_ADD] = &&op_add,     [OP_SUB] = &&op_sub,
+        [OP_AND] = &&op_and,         [OP_OR] = &&op_or,       [OP_XOR] = &&op_xor,
+        [OP_SLL] = &&op_sll,         [OP_SRL] = &&op_srl,     [OP_SRA] = &&op_sra,
+        [OP_JR] = &&op_jr,           [OP_ADDI] = &&op_addi,   [OP_BEQ] = &&op_beq,
+        [OP_BNEQ] = &&op_bneq,       [OP_BLTZ] = &&op_bltz,   [OP_BGTZ] = &&op_bgtz,
+        [OP_BLT] = &&op_blt,         [OP_BGT] = &&op_bgt,     [OP_LW] = &&op_lw,
+        [OP_SW] = &&op_sw,           [OP_LH] = &&op_lh,       [OP_SH] = &&op_sh,
+        [OP_LB] = &&op_lb,           [OP_SB] = &&op_sb,       [OP_J] = &&op_j,
+        [OP_JAL] = &&op_jal,         [OP_HALT] = &&op_halt,   [OP_BAD_JUMP] = &&op_bad_jump,
+    };
+
+    uint32_t r[SINK_REGISTER + 1];
+    memcpy(r, simulator->registers, sizeof(simulator->registers));
+    const MicroOp *const program = simulator->program;
+    const uint32_t count = simulator->instruction_count;
+    uint8_t *const memory = simulator->memory;
+    const uint64_t memory_size = simulator->memory_size;
+    const MicroOp *op = program + simulator->pc;
+    const MicroOp *from = op; // the last taken branch or jump, for reporting bad targets
+    uint64_t retired = 0;
+    SimulatorStatus status;
+
+#define DISPATCH() goto *handlers[op->kind]
+#define NEXT() \
+    do { \
+        retired++; \
+        op++; \
+        DISPATCH(); \
+    } while (0)
+#define JUMP(target) \
+    do { \
+        retired++; \
+        from = op; \
+        op = program + (target); \
+        if (retired >= max_instructions) goto step_limit; \
+        DISPATCH(); \
+    } while (0)
+#define BRANCH(condition) \
+    do { \
+        if (condition) JUMP(op->operand); \
+        NEXT(); \
+    } while (0)
+#define MEMORY_ADDRESS(width) \
+    uint32_t address = r[op->s] + op->operand; \
+    if ((uint64_t) address + (width) > memory_size) goto bad_address
+
+    DISPATCH();
+
+op_add:
+    r[op->d] = r[op->s] + r[op->t];
+    NEXT();
+op_sub:
+    r[op->d] = r[op->s] - r[op->t];
+    NEXT();
+op_and:
+    r[op->d] = r[op->s] & r[op->t];
+    NEXT();
+op_or:
+    r[op->d] = r[op->s] | r[op->t];
+    NEXT();
+op_xor:
+    r[op->d] = r[op->s] ^ r[op->t];
+    NEXT();
+op_sll:
+    r[op->d] = r[op->s] << (r[op->t] & 31);
+    NEXT();
+op_srl:
+    r[op->d] = r[op->s] >> (r[op->t] & 31);
+    NEXT();
+op_sra:
+    r[op->d] = (uint32_t) ((int32_t) r[op->s] >> (r[op->t] & 31));
+    NEXT();
+op_jr:
+    JUMP(r[op->s] % 4 == 0 && r[op->s] / 4 <= count ? r[op->s] / 4 : count + 1);
+op_addi:
+    r[op->d] = r[op->s] + op->operand;
+    NEXT();
+op_beq:
+    BRANCH(r[op->s] == r[op->t]);
+op_bneq:
+    BRANCH(r[op->s] != r[op->t]);
+op_bltz:
+    BRANCH((int32_t) r[op->s] < 0);
+op_bgtz:
+    BRANCH((int32_t) r[op->s] > 0);
+op_blt:
+    BRANCH((int32_t) r[op->s] < (int32_t) r[op->t]);
+op_bgt:
+    BRANCH((int32_t) r[op->s] > (int32_t) r[op->t]);
+op_lw: {
+    MEMORY_ADDRESS(4);
+    r[op->d] = load_memory(memory, address, 4);
+    NEXT();
+}
+op_sw: {
+    MEMORY_ADDRESS(4);
+    store_memory(memory, address, r[op->t], 4);
+    NEXT();
+}
+op_lh: {
+    MEMORY_ADDRESS(2);
+    r[op->d] = (uint32_t) (int16_t) load_memory(memory, address, 2);
+    NEXT();
+}
+op_sh: {
+    MEMORY_ADDRESS(2);
+    store_memory(memory, address, r[op->t], 2);
+    NEXT();
+}
+op_lb: {
+    MEMORY_ADDRESS(1);
+    r[op->d] = (uint32_t) (int8_t) memory[address];
+    NEXT();
+}
+op_sb: {
+    MEMORY_ADDRESS(1);
+    memory[address] = (uint8_t) r[op->t];
+    NEXT();
+}
+op_j:
+    JUMP(op->operand);
+op_jal:
+    r[31] = ((uint32_t) (op - program) + 1) * 4;
+    JUMP(op->operand);
+
+op_halt:
+    status = SIMULATOR_HALTED;
+    goto done;
+op_bad_jump:
+    op = from;
+    retired--;
+    status = SIMULATOR_BAD_JUMP;
+    goto done;
+op_invalid:
+    status = SIMULATOR_INVALID_INSTRUCTION;
+    goto done;
+bad_address:
+    status = SIMULATOR_BAD_ADDRESS;
+    goto done;
+step_limit:
+    // A jump that used up the budget still reports reaching the end or leaving the program.
+    if (op->kind == OP_HALT || op->kind == OP_BAD_JUMP) DISPATCH();
+    status = SIMULATOR_STEP_LIMIT;
+
+done:
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef BRANCH
+#undef MEMORY_ADDRESS
+    memcpy(simulator->registers, r, sizeof(simulator->registers));
+    simulator->pc = (uint32_t) (op - program);
+    simulator->retired += retired;
+    simulator->status = status;
+    return status;
+}
+
+const char *simulator_status_name(SimulatorStatus status) {
+    switch (status) {
+        case SIMULATOR_RUNNING:
+            return "running";
+        case SIMULATOR_HALTED:
+            return "halted";
+        case SIMULATOR_STEP_LIMIT:
+            return "instruction limit reached";
+        case SIMULATOR_INVALID_INSTRUCTION:
+            return "invalid instruction";
+        case SIMULATOR_BAD_ADDRESS:
+            return "memory access out of range";
+        case SIMULATOR_BAD_JUMP:
+            return "jump target outside the program";
+    }
+    return "unknown";
+}
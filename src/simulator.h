@@ -0,0 +1,49 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Executes assembled programs. Targets of branches, j and jal are instruction indices, as the assembler
+// encodes them; the data memory is a separate little-endian byte array addressed by lw/sw/lh/sh/lb/sb. The
+// image is copied to the start of that memory, so labels, whose la and memory-operand addresses are byte
+// offsets in the image, can be read. Code addresses in registers are byte offsets too: jal leaves the
+// return instruction's in $ra, and jr jumps to the instruction at the byte offset in rs, which is its
+// second operand as written (jr $zero, $ra, $zero).
+// Arithmetic wraps, shifts use the low five bits of rt, lh and lb sign-extend, and $zero always reads 0.
+// Execution starts at instruction 0 with every register zero except $sp, which holds the memory size.
+
+typedef enum {
+    SIMULATOR_RUNNING,
+    SIMULATOR_HALTED,              // control reached the instruction just past the last one
+    SIMULATOR_STEP_LIMIT,          // max_instructions retired; running again continues where it stopped
+    SIMULATOR_INVALID_INSTRUCTION, // the word at pc decodes to no instruction
+    SIMULATOR_BAD_ADDRESS,         // the load or store at pc falls outside the memory
+    SIMULATOR_BAD_JUMP,            // the branch or jump at pc targets an address outside the program
+} SimulatorStatus;
+
+typedef struct MicroOp MicroOp;
+
+typedef struct {
+    uint32_t registers[32];
+    uint32_t pc;      // next instruction to execute; on a fault, the instruction that faulted
+    uint64_t retired; // instructions completed over every run
+    SimulatorStatus status;
+
+    uint8_t *memory;
+    uint32_t memory_size;
+
+    MicroOp *program; // one predecoded entry per instruction, then the halt and bad-jump entries
+    uint32_t instruction_count;
+} Simulator;
+
+// Predecodes the instructions once; the caller's buffer is not referenced afterwards. The image is split by
+// assembler_image_text_count, so the program halts where the instructions end instead of running into
+// .data, and the trailer itself is not loaded. Returns NULL when out of memory.
+Simulator *simulator_create(const uint32_t *machine_code, uint32_t count, uint32_t memory_size);
+
+void simulator_destroy(Simulator *simulator);
+
+// Runs until the program halts or faults, or until at least max_instructions more have retired. The limit
+// is only checked at taken branches and jumps, so a straight-line run may finish past it.
+SimulatorStatus simulator_run(Simulator *simulator, uint64_t max_instructions);
+
+const char *simulator_status_name(SimulatorStatus status);
@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 200809L
+#include "source.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Pipes and other non-seekable inputs cannot be mapped, so their contents are read into memory instead.
+static bool source_read_all(int fd, SourceFile *source) {
+    size_t capacity = 1 << 16;
+    size_t size = 0;
+    char *buffer = malloc(capacity);
+    if (!buffer) return false;
+
+    for (;;) {
+        if (size == capacity) {
+            char *new_buffer = realloc(buffer, capacity * 2);
+            if (!new_buffer) {
+                free(buffer);
+                return false;
+            }
+            buffer = new_buffer;
+            capacity *= 2;
+        }
+
+        ssize_t count = read(fd, buffer + size, capacity - size);
+        if (count < 0) {
+            free(buffer);
+            return false;
+        }
+        if (count == 0) break;
+        size += (size_t) count;
+    }
+
+    source->data = buffer;
+    source->size = size;
+    source->buffer = buffer;
+    return true;
+}
+
+bool source_open(const char *path, SourceFile *source) {
+    if (!path || !source) return false;
+
+    source->data = NULL;
+    source->size = 0;
+    source->mapping = NULL;
+    source->buffer = NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        if (info.st_size == 0) {
+            source->data = "";
+            close(fd);
+            return true;
+        }
+
+        void *mapping = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            posix_madvise(mapping, (size_t) info.st_size, POSIX_MADV_SEQUENTIAL);
+            source->data = mapping;
+            source->size = (size_t) info.st_size;
+            source->mapping = mapping;
+            close(fd);
+            return true;
+        }
+    }
+
+    bool ok = source_read_all(fd, source);
+    close(fd);
+    return ok;
+}
+
+void source_close(SourceFile *source) {
+    if (source) {
+        if (source->mapping) {
+            munmap(source->mapping, source->size);
+        }
+        free(source->buffer);
+        source->data = NULL;
+        source->size = 0;
+        source->mapping = NULL;
+        source->buffer = NULL;
+    }
+}
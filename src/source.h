@@ -0,0 +1,14 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct {
+    const char *data;
+    size_t size;
+    void *mapping; // mmap'd region, or NULL when the contents had to be read into a heap buffer
+    char *buffer;
+} SourceFile;
+
+bool source_open(const char *path, SourceFile *source);
+
+void source_close(SourceFile *source);
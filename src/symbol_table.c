@@ -0,0 +1,190 @@
+#include "symbol_table.h"
+
+#include <string.h>
+
+#define INITIAL_LABEL_CAPACITY 64
+#define INITIAL_STRINGS_CAPACITY 1024
+
+// FNV-1a; label names are short so this stays cheap and spreads well enough for linear probing.
+static uint32_t hash_name(const char *name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool label_matches(const SymbolTable *table, const Label *label, const char *name, size_t length) {
+    return label->name_length == length && memcmp(table->strings + label->name, name, length) == 0;
+}
+
+bool symbol_table_init(SymbolTable *table) {
+    return symbol_table_init_arena(table, NULL, INITIAL_LABEL_CAPACITY, INITIAL_STRINGS_CAPACITY);
+}
+
+bool symbol_table_init_arena(SymbolTable *table, Arena *arena, uint32_t label_capacity, uint32_t strings_capacity) {
+    if (!table) return false;
+
+    if (label_capacity < INITIAL_LABEL_CAPACITY) label_capacity = INITIAL_LABEL_CAPACITY;
+    if (strings_capacity < INITIAL_STRINGS_CAPACITY) strings_capacity = INITIAL_STRINGS_CAPACITY;
+    table->arena = arena;
+    table->strings = arena_alloc(arena, strings_capacity);
+    table->labels = arena_alloc(arena, sizeof(Label) * label_capacity);
+    table->slots = arena_alloc(arena, sizeof(SymbolSlot) * label_capacity * 2);
+    table->strings_size = 0;
+    table->strings_capacity = strings_capacity;
+    table->label_count = 0;
+    table->label_capacity = label_capacity;
+    table->slot_mask = label_capacity * 2 - 1;
+
+    if (!table->strings || !table->labels || !table->slots) {
+        symbol_table_free(table);
+        return false;
+    }
+
+    for (uint32_t i = 0; i <= table->slot_mask; i++) {
+        table->slots[i].label = SYMBOL_TABLE_EMPTY;
+    }
+    return true;
+}
+
+void symbol_table_clear(SymbolTable *table) {
+    if (!table) return;
+
+    table->strings_size = 0;
+    table->label_count = 0;
+    for (uint32_t i = 0; i <= table->slot_mask; i++) {
+        table->slots[i].label = SYMBOL_TABLE_EMPTY;
+    }
+}
+
+void symbol_table_free(SymbolTable *table) {
+    if (table) {
+        arena_release(table->arena, table->strings);
+        arena_release(table->arena, table->labels);
+        arena_release(table->arena, table->slots);
+        table->strings = NULL;
+        table->labels = NULL;
+        table->slots = NULL;
+        table->strings_size = 0;
+        table->strings_capacity = 0;
+        table->label_count = 0;
+        table->label_capacity = 0;
+        table->slot_mask = 0;
+    }
+}
+
+static bool symbol_table_grow(SymbolTable *table) {
+    uint32_t new_capacity = table->label_capacity * 2;
+    uint32_t new_mask = new_capacity * 2 - 1;
+
+    Label *new_labels = arena_grow(table->arena, table->labels, sizeof(Label) * table->label_capacity,
+                                   sizeof(Label) * new_capacity);
+    if (!new_labels) return false;
+    table->labels = new_labels;
+
+    SymbolSlot *new_slots = arena_alloc(table->arena, sizeof(SymbolSlot) * (new_mask + 1));
+    if (!new_slots) return false;
+
+    for (uint32_t i = 0; i <= new_mask; i++) {
+        new_slots[i].label = SYMBOL_TABLE_EMPTY;
+    }
+    for (uint32_t i = 0; i <= table->slot_mask; i++) {
+        if (table->slots[i].label == SYMBOL_TABLE_EMPTY) continue;
+        uint32_t slot = table->slots[i].hash & new_mask;
+        while (new_slots[slot].label != SYMBOL_TABLE_EMPTY) {
+            slot = (slot + 1) & new_mask;
+        }
+        new_slots[slot] = table->slots[i];
+    }
+
+    arena_release(table->arena, table->slots);
+    table->slots = new_slots;
+    table->slot_mask = new_mask;
+    table->label_capacity = new_capacity;
+    return true;
+}
+
+static bool symbol_table_store_name(SymbolTable *table, const char *name, size_t length, uint32_t *offset) {
+    if (length >= UINT32_MAX - table->strings_size) return false;
+
+    uint32_t needed = table->strings_size + (uint32_t) length + 1;
+    if (needed > table->strings_capacity) {
+        uint32_t new_capacity = table->strings_capacity;
+        while (new_capacity < needed) {
+            new_capacity = new_capacity > UINT32_MAX / 2 ? UINT32_MAX : new_capacity * 2;
+        }
+        char *new_strings = arena_grow(table->arena, table->strings, table->strings_capacity, new_capacity);
+        if (!new_strings) return false;
+        table->strings = new_strings;
+        table->strings_capacity = new_capacity;
+    }
+
+    *offset = table->strings_size;
+    memcpy(table->strings + table->strings_size, name, length);
+    table->strings[table->strings_size + length] = '\0';
+    table->strings_size = needed;
+    return true;
+}
+
+static uint32_t symbol_table_lookup(const SymbolTable *table, const char *name, size_t length, uint32_t hash,
+                                    uint32_t *free_slot) {
+    uint32_t slot = hash & table->slot_mask;
+    while (table->slots[slot].label != SYMBOL_TABLE_EMPTY) {
+        if (table->slots[slot].hash == hash &&
+            label_matches(table, &table->labels[table->slots[slot].label], name, length)) {
+            return table->slots[slot].label;
+        }
+        slot = (slot + 1) & table->slot_mask;
+    }
+    if (free_slot) *free_slot = slot;
+    return SYMBOL_TABLE_EMPTY;
+}
+
+uint32_t symbol_table_intern(SymbolTable *table, const char *name, size_t length) {
+    uint32_t hash = hash_name(name, length);
+    uint32_t slot;
+    uint32_t symbol = symbol_table_lookup(table, name, length, hash, &slot);
+    if (symbol != SYMBOL_TABLE_EMPTY) return symbol;
+
+    // Keep the load factor at or below one half so probe sequences stay short.
+    if (table->label_count >= table->label_capacity) {
+        if (!symbol_table_grow(table)) return SYMBOL_TABLE_EMPTY;
+        symbol_table_lookup(table, name, length, hash, &slot);
+    }
+
+    Label *label = &table->labels[table->label_count];
+    if (!symbol_table_store_name(table, name, length, &label->name)) return SYMBOL_TABLE_EMPTY;
+    label->name_length = (uint32_t) length;
+    label->instruction_line = SYMBOL_UNDEFINED;
+    label->first_fixup = SYMBOL_TABLE_EMPTY;
+    label->flags = 0;
+
+    table->slots[slot].hash = hash;
+    table->slots[slot].label = table->label_count;
+    return table->label_count++;
+}
+
+SymbolTableResult symbol_table_define(SymbolTable *table, uint32_t symbol, uint32_t instruction_line) {
+    Label *label = &table->labels[symbol];
+    if (label->instruction_line != SYMBOL_UNDEFINED) return SYMBOL_TABLE_DUPLICATE;
+    label->instruction_line = instruction_line;
+    return SYMBOL_TABLE_OK;
+}
+
+SymbolTableResult symbol_table_insert(SymbolTable *table, const char *name, size_t length, uint32_t instruction_line) {
+    uint32_t symbol = symbol_table_intern(table, name, length);
+    if (symbol == SYMBOL_TABLE_EMPTY) return SYMBOL_TABLE_NO_MEMORY;
+    return symbol_table_define(table, symbol, instruction_line);
+}
+
+const Label *symbol_table_find(const SymbolTable *table, const char *name, size_t length) {
+    uint32_t symbol = symbol_table_lookup(table, name, length, hash_name(name, length), NULL);
+    if (symbol == SYMBOL_TABLE_EMPTY || table->labels[symbol].instruction_line == SYMBOL_UNDEFINED) return NULL;
+    return &table->labels[symbol];
+}
+
+const char *symbol_table_name(const SymbolTable *table, uint32_t symbol) {
+    return table->strings + table->labels[symbol].name;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "arena.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// One interned name. Referencing a label interns it before it is defined, so instruction_line stays
+// SYMBOL_UNDEFINED until the definition is seen.
+typedef struct {
+    uint32_t name;        // offset of the NUL-terminated name in SymbolTable::strings
+    uint32_t name_length;
+    uint32_t instruction_line;
+    uint32_t first_fixup; // head of the assembler's chain of references waiting for this label
+    uint32_t flags;       // SYMBOL_GLOBAL and SYMBOL_EXTERN, set by .globl and .extern
+} Label;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t label; // index into labels, SYMBOL_TABLE_EMPTY when the slot is free
+} SymbolSlot;
+
+typedef struct {
+    Arena *arena; // where the arrays below live, NULL for the heap
+    char *strings;
+    uint32_t strings_size;
+    uint32_t strings_capacity;
+    Label *labels;
+    uint32_t label_count;
+    uint32_t label_capacity;
+    SymbolSlot *slots;
+    uint32_t slot_mask;
+} SymbolTable;
+
+typedef enum {
+    SYMBOL_TABLE_OK = 0,
+    SYMBOL_TABLE_DUPLICATE,
+    SYMBOL_TABLE_NO_MEMORY,
+} SymbolTableResult;
+
+#define SYMBOL_TABLE_EMPTY UINT32_MAX
+#define SYMBOL_UNDEFINED UINT32_MAX
+
+#define SYMBOL_GLOBAL 1u
+#define SYMBOL_EXTERN 2u
+
+// instruction_line of a label defined in the .data section: this bit plus the label's byte offset there.
+// Code labels stay below it, so checks against the instruction count never mistake one for the other.
+#define SYMBOL_DATA 0x80000000u
+
+bool symbol_table_init(SymbolTable *table);
+
+// Allocates from arena, with room for at least label_capacity labels, a power of two, and strings_capacity
+// bytes of names. Such a table goes away with its arena; after arena_reset it is initialized afresh.
+bool symbol_table_init_arena(SymbolTable *table, Arena *arena, uint32_t label_capacity, uint32_t strings_capacity);
+
+void symbol_table_free(SymbolTable *table);
+
+// Forgets every name but keeps the allocations for reuse.
+void symbol_table_clear(SymbolTable *table);
+
+uint32_t symbol_table_intern(SymbolTable *table, const char *name, size_t length);
+
+SymbolTableResult symbol_table_define(SymbolTable *table, uint32_t symbol, uint32_t instruction_line);
+
+SymbolTableResult symbol_table_insert(SymbolTable *table, const char *name, size_t length, uint32_t instruction_line);
+
+const Label *symbol_table_find(const SymbolTable *table, const char *name, size_t length);
+
+const char *symbol_table_name(const SymbolTable *table, uint32_t symbol);
@@ -0,0 +1,186 @@
+#include "thread_pool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Each participant owns a range of task indices packed as (end << 32 | next) so that taking from the
+// front and stealing from the back are both a single compare-and-swap on the same word.
+typedef struct {
+    _Alignas(64) _Atomic uint64_t range;
+    struct ThreadPool *pool;
+    uint32_t index;
+} Worker;
+
+struct ThreadPool {
+    pthread_t *threads;
+    Worker *workers; // workers[0] is the thread calling thread_pool_run
+    uint32_t thread_count;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    uint64_t generation;
+    bool shutting_down;
+
+    ThreadPoolTask task;
+    void *context;
+    uint32_t busy_threads;
+};
+
+static uint64_t pack_range(uint32_t next, uint32_t end) {
+    return (uint64_t) end << 32 | next;
+}
+
+static bool take_front(Worker *worker, uint32_t *index) {
+    uint64_t range = atomic_load(&worker->range);
+    for (;;) {
+        uint32_t next = (uint32_t) range;
+        uint32_t end = (uint32_t) (range >> 32);
+        if (next >= end) return false;
+        if (atomic_compare_exchange_weak(&worker->range, &range, pack_range(next + 1, end))) {
+            *index = next;
+            return true;
+        }
+    }
+}
+
+// Moves the back half of some other participant's remaining range into the thief's own (empty) range.
+static bool steal(ThreadPool *pool, Worker *thief) {
+    uint32_t participants = pool->thread_count + 1;
+    for (uint32_t offset = 1; offset < participants; offset++) {
+        Worker *victim = &pool->workers[(thief->index + offset) % participants];
+        uint64_t range = atomic_load(&victim->range);
+        for (;;) {
+            uint32_t next = (uint32_t) range;
+            uint32_t end = (uint32_t) (range >> 32);
+            if (next >= end) break;
+            uint32_t split = end - (end - next + 1) / 2;
+            if (atomic_compare_exchange_weak(&victim->range, &range, pack_range(next, split))) {
+                atomic_store(&thief->range, pack_range(split, end));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void thread_pool_drain(ThreadPool *pool, Worker *worker) {
+    uint32_t index;
+    do {
+        while (take_front(worker, &index)) {
+            pool->task(pool->context, worker->index, index);
+        }
+    } while (steal(pool, worker));
+}
+
+static void *thread_pool_worker(void *argument) {
+    Worker *worker = argument;
+    ThreadPool *pool = worker->pool;
+    uint64_t seen_generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutting_down && pool->generation == seen_generation) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->shutting_down) break;
+        seen_generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        thread_pool_drain(pool, worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy_threads == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool *thread_pool_create(uint32_t thread_count) {
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) return NULL;
+
+    // The caller participates in every run, so one thread fewer is spawned than requested.
+    uint32_t workers = thread_count > 1 ? thread_count - 1 : 0;
+    pool->threads = calloc(workers ? workers : 1, sizeof(pthread_t));
+    pool->workers = aligned_alloc(_Alignof(Worker), sizeof(Worker) * (workers + 1));
+    if (!pool->threads || !pool->workers) {
+        free(pool->threads);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    for (uint32_t i = 0; i <= workers; i++) {
+        atomic_init(&pool->workers[i].range, 0);
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+    }
+
+    for (uint32_t i = 0; i < workers; i++) {
+        if (pthread_create(&pool->threads[i], NULL, thread_pool_worker, &pool->workers[i + 1]) != 0) {
+            break;
+        }
+        pool->thread_count++;
+    }
+    return pool;
+}
+
+void thread_pool_destroy(ThreadPool *pool) {
+    if (pool) {
+        pthread_mutex_lock(&pool->lock);
+        pool->shutting_down = true;
+        pthread_cond_broadcast(&pool->work_ready);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (uint32_t i = 0; i < pool->thread_count; i++) {
+            pthread_join(pool->threads[i], NULL);
+        }
+
+        pthread_cond_destroy(&pool->work_done);
+        pthread_cond_destroy(&pool->work_ready);
+        pthread_mutex_destroy(&pool->lock);
+        free(pool->workers);
+        free(pool->threads);
+        free(pool);
+    }
+}
+
+uint32_t thread_pool_size(const ThreadPool *pool) {
+    return pool ? pool->thread_count + 1 : 1;
+}
+
+void thread_pool_run(ThreadPool *pool, uint32_t task_count, ThreadPoolTask task, void *context) {
+    if (task_count == 0) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->context = context;
+
+    // Every participant starts with an equal contiguous share and steals once its own share runs out.
+    uint32_t participants = pool->thread_count + 1;
+    for (uint32_t i = 0; i < participants; i++) {
+        uint32_t begin = (uint32_t) ((uint64_t) task_count * i / participants);
+        uint32_t end = (uint32_t) ((uint64_t) task_count * (i + 1) / participants);
+        atomic_store(&pool->workers[i].range, pack_range(begin, end));
+    }
+
+    pool->busy_threads = pool->thread_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    thread_pool_drain(pool, &pool->workers[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy_threads > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+
+// worker identifies the participant running the task, from 0 to thread_pool_size() - 1, so tasks can keep
+// per-worker state without locking.
+typedef void (*ThreadPoolTask)(void *context, uint32_t worker, uint32_t index);
+
+typedef struct ThreadPool ThreadPool;
+
+ThreadPool *thread_pool_create(uint32_t thread_count);
+
+void thread_pool_destroy(ThreadPool *pool);
+
+uint32_t thread_pool_size(const ThreadPool *pool);
+
+// Runs task(context, i) for every i in [0, task_count) and returns once all of them have finished.
+// The calling thread works through the tasks alongside the pool's threads. Each participant starts on an
+// equal share of the indices and steals half of another's remaining share when it runs out.
+void thread_pool_run(ThreadPool *pool, uint32_t task_count, ThreadPoolTask task, void *context);